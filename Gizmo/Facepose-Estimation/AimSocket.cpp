@@ -0,0 +1,240 @@
+#include "AimSocket.h"
+#include "WireFormat.h"
+#include <netdb.h>
+#include <poll.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstring>
+#include <ctime>
+#include <iostream>
+#include <random>
+#include <stdexcept>
+
+using namespace std;
+
+uint64_t monotonicMicros()
+{
+   struct timespec ts;
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+   return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+void encodeAimPacket(const AimPacket &packet, uint8_t *buf)
+{
+   putLe(buf, AIM_PACKET_MAGIC, 2);
+   buf[2] = AIM_PACKET_VERSION;
+   buf[3] = 0; // flags, reserved
+   putLe(buf + 4, packet.session, 4);
+   putLe(buf + 8, packet.sequence, 4);
+   putLe(buf + 12, packet.timestampUs, 8);
+   putLe(buf + 20, (uint16_t)packet.pan, 2);
+   putLe(buf + 22, (uint16_t)packet.tilt, 2);
+}
+
+bool decodeAimPacket(const uint8_t *buf, size_t size, AimPacket &packet)
+{
+   if (size != AIM_PACKET_SIZE || getLe(buf, 2) != AIM_PACKET_MAGIC || buf[2] != AIM_PACKET_VERSION)
+   {
+      return false;
+   }
+   packet.session = (uint32_t)getLe(buf + 4, 4);
+   packet.sequence = (uint32_t)getLe(buf + 8, 4);
+   packet.timestampUs = getLe(buf + 12, 8);
+   packet.pan = (int16_t)getLe(buf + 20, 2);
+   packet.tilt = (int16_t)getLe(buf + 22, 2);
+   return true;
+}
+
+/**
+ * Resolves "udp:host:port" or "unix:/path" into a socket address.
+ * For udp a missing host ("udp::5001" or "udp:5001") means any address when binding, localhost otherwise.
+ */
+static void resolveEndpoint(const string &endpoint, bool passive, sockaddr_storage &addr, socklen_t &addrLen)
+{
+   memset(&addr, 0, sizeof(addr));
+
+   if (endpoint.compare(0, 5, "unix:") == 0)
+   {
+      string path = endpoint.substr(5);
+      sockaddr_un *un = (sockaddr_un *)&addr;
+      if (path.empty() || path.size() >= sizeof(un->sun_path))
+      {
+         throw runtime_error("Invalid unix aim endpoint " + endpoint);
+      }
+      un->sun_family = AF_UNIX;
+      strncpy(un->sun_path, path.c_str(), sizeof(un->sun_path) - 1);
+      addrLen = sizeof(sockaddr_un);
+      return;
+   }
+
+   if (endpoint.compare(0, 4, "udp:") != 0)
+   {
+      throw runtime_error("Unknown aim endpoint " + endpoint + " (expected udp:host:port or unix:/path)");
+   }
+
+   string rest = endpoint.substr(4);
+   size_t colon = rest.rfind(':');
+   string host = (colon == string::npos) ? "" : rest.substr(0, colon);
+   string port = (colon == string::npos) ? rest : rest.substr(colon + 1);
+
+   struct addrinfo hints, *info;
+   memset(&hints, 0, sizeof(hints));
+   hints.ai_family = AF_UNSPEC;
+   hints.ai_socktype = SOCK_DGRAM;
+   hints.ai_flags = passive ? AI_PASSIVE : 0;
+
+   int error = getaddrinfo(host.empty() ? NULL : host.c_str(), port.c_str(), &hints, &info);
+   if (error != 0)
+   {
+      throw runtime_error("Could not resolve aim endpoint " + endpoint + ": " + gai_strerror(error));
+   }
+   memcpy(&addr, info->ai_addr, info->ai_addrlen);
+   addrLen = info->ai_addrlen;
+   freeaddrinfo(info);
+}
+
+AimSocket::AimSocket(const string &endpoint) : sequence(0)
+{
+   sockaddr_storage addr;
+   socklen_t addrLen;
+   resolveEndpoint(endpoint, false, addr, addrLen);
+
+   sd = socket(addr.ss_family, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+   if (sd < 0)
+   {
+      throw runtime_error("Could not create aim socket for " + endpoint);
+   }
+
+   // Connecting a datagram socket only fixes the destination, so each send() is one syscall.
+   if (connect(sd, (sockaddr *)&addr, addrLen) < 0)
+   {
+      close(sd);
+      throw runtime_error("Could not set aim destination " + endpoint);
+   }
+
+   random_device rd;
+   session = rd();
+}
+
+AimSocket::~AimSocket()
+{
+   if (sd >= 0)
+   {
+      close(sd);
+   }
+}
+
+int AimSocket::send(int pan, int tilt, uint64_t timestampUs)
+{
+   AimPacket packet;
+   packet.session = session;
+   packet.sequence = ++sequence;
+   packet.timestampUs = timestampUs ? timestampUs : monotonicMicros();
+   packet.pan = (int16_t)pan;
+   packet.tilt = (int16_t)tilt;
+
+   uint8_t buf[AIM_PACKET_SIZE];
+   encodeAimPacket(packet, buf);
+
+   // Never block the caller. A full buffer or an absent receiver just loses this target; the next one supersedes it.
+   if (::send(sd, buf, sizeof(buf), MSG_DONTWAIT | MSG_NOSIGNAL) < 0)
+   {
+      if (errno != EAGAIN && errno != EWOULDBLOCK && errno != ECONNREFUSED && errno != ENOENT)
+      {
+         cerr << "AIM SEND ERROR" << errno << endl;
+      }
+      return -1;
+   }
+
+   return 0;
+}
+
+AimReceiver::AimReceiver(const string &endpoint, int64_t maxAgeUs) : maxAgeUs(maxAgeUs)
+{
+   sockaddr_storage addr;
+   socklen_t addrLen;
+   resolveEndpoint(endpoint, true, addr, addrLen);
+
+   sd = socket(addr.ss_family, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+   if (sd < 0)
+   {
+      throw runtime_error("Could not create aim socket for " + endpoint);
+   }
+
+   if (addr.ss_family == AF_UNIX)
+   {
+      unixPath = ((sockaddr_un *)&addr)->sun_path;
+      unlink(unixPath.c_str()); // stale socket file from a previous run
+   }
+   else
+   {
+      const int yes = 1;
+      setsockopt(sd, SOL_SOCKET, SO_REUSEADDR, (char *)&yes, sizeof(yes));
+   }
+
+   if (bind(sd, (sockaddr *)&addr, addrLen) < 0)
+   {
+      close(sd);
+      throw runtime_error("Could not bind aim endpoint " + endpoint);
+   }
+}
+
+AimReceiver::~AimReceiver()
+{
+   close(sd);
+   if (!unixPath.empty())
+   {
+      unlink(unixPath.c_str());
+   }
+}
+
+int AimReceiver::receive(AimPacket &packet, int timeoutMs)
+{
+   while (true)
+   {
+      struct pollfd pfd = {sd, POLLIN, 0};
+      int ready = poll(&pfd, 1, timeoutMs);
+      if (ready < 0)
+      {
+         return (errno == EINTR) ? 0 : -1;
+      }
+      if (ready == 0)
+      {
+         return 0;
+      }
+
+      uint8_t buf[AIM_PACKET_SIZE + 1]; // one spare byte so oversized datagrams are detected
+      ssize_t size = recv(sd, buf, sizeof(buf), 0);
+      if (size < 0)
+      {
+         return -1;
+      }
+
+      if (!decodeAimPacket(buf, size, packet))
+      {
+         discardedMalformed++;
+         continue;
+      }
+
+      // Serial number arithmetic, so the comparison survives the sequence wrapping around.
+      if (haveLast && packet.session == lastSession && (int32_t)(packet.sequence - lastSequence) <= 0)
+      {
+         discardedOutOfOrder++;
+         continue;
+      }
+
+      // Age only means something when the sender shares our monotonic clock, i.e. runs on this host.
+      if (maxAgeUs > 0 && (int64_t)(monotonicMicros() - packet.timestampUs) > maxAgeUs)
+      {
+         discardedStale++;
+         continue;
+      }
+
+      haveLast = true;
+      lastSession = packet.session;
+      lastSequence = packet.sequence;
+      accepted++;
+      return 1;
+   }
+}
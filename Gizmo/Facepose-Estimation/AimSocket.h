@@ -0,0 +1,110 @@
+#ifndef AIMSOCKET_H
+#define AIMSOCKET_H
+
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <cstdint>
+#include <string>
+
+/**
+ * Binary aim datagram, little endian, 24 bytes on the wire:
+ *
+ *   u16 magic | u8 version | u8 flags | u32 session | u32 sequence | u64 timestampUs | i16 pan | i16 tilt
+ *
+ * The session is picked at random every time a sender starts so a receiver can tell a restarted
+ * sender (whose sequence starts over) from an old, reordered datagram.
+ * The timestamp is CLOCK_MONOTONIC in microseconds, which is shared by all processes on one host.
+ */
+#define AIM_PACKET_MAGIC 0x4147 // "GA"
+#define AIM_PACKET_VERSION 1
+#define AIM_PACKET_SIZE 24
+
+// Targets older than this are not worth moving the servos for.
+#define AIM_MAX_AGE_US 250000
+
+struct AimPacket
+{
+   uint32_t session;
+   uint32_t sequence;
+   uint64_t timestampUs;
+   int16_t pan;
+   int16_t tilt;
+};
+
+/**
+ * encodeAimPacket - Writes a packet into buf, which must hold AIM_PACKET_SIZE bytes.
+ */
+void encodeAimPacket(const AimPacket &packet, uint8_t *buf);
+
+/**
+ * decodeAimPacket - Parses a datagram. Returns false if it is not a valid aim packet.
+ */
+bool decodeAimPacket(const uint8_t *buf, size_t size, AimPacket &packet);
+
+/**
+ * monotonicMicros - CLOCK_MONOTONIC in microseconds, the time base of AimPacket::timestampUs.
+ */
+uint64_t monotonicMicros();
+
+/**
+ * Datagram transport for aim commands.
+ *
+ * Endpoints are written as "udp:host:port" or "unix:/path/to/socket".
+ * A send is a single non-blocking syscall; nothing is ever waited for.
+ */
+class AimSocket
+{
+public:
+   AimSocket(const std::string &endpoint);
+   ~AimSocket();
+
+   /**
+    * send - Sends one target.
+    *
+    * @param timestampUs What the target is as of, e.g. when the frame it was found in was captured, so the receiver's
+    *                    age check covers the whole way from the camera. 0 for now.
+    * @return 0 if the datagram was queued, -1 otherwise.
+    */
+   int send(int pan, int tilt, uint64_t timestampUs = 0);
+
+private:
+   int sd;
+   uint32_t session;
+   uint32_t sequence;
+};
+
+/**
+ * Receiving end of the aim datagram protocol.
+ *
+ * Binds the endpoint and hands out only targets that are newer than everything accepted so far
+ * and younger than maxAgeUs. Mirrors the listener in ServoServer.py.
+ * Pass maxAgeUs = 0 for senders on another host, whose monotonic clock is unrelated to ours.
+ */
+class AimReceiver
+{
+public:
+   AimReceiver(const std::string &endpoint, int64_t maxAgeUs = AIM_MAX_AGE_US);
+   ~AimReceiver();
+
+   /**
+    * receive - Waits up to timeoutMs for the next acceptable target.
+    *
+    * @return 1 if packet was filled in, 0 on timeout, -1 on socket error.
+    */
+   int receive(AimPacket &packet, int timeoutMs);
+
+   unsigned long accepted = 0;
+   unsigned long discardedStale = 0;
+   unsigned long discardedOutOfOrder = 0;
+   unsigned long discardedMalformed = 0;
+
+private:
+   int sd;
+   int64_t maxAgeUs;
+   std::string unixPath;
+   bool haveLast = false;
+   uint32_t lastSession = 0;
+   uint32_t lastSequence = 0;
+};
+
+#endif
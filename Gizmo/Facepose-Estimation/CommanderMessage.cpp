@@ -0,0 +1,73 @@
+#include "CommanderMessage.h"
+#include "WireFormat.h"
+
+// Anything longer is not a frame of any version we would ever send.
+#define COMMANDER_MESSAGE_MAX_BODY 1024
+
+size_t encodeCommanderMessage(const CommanderMessage &msg, uint8_t *buf, size_t capacity)
+{
+   if (capacity < COMMANDER_MESSAGE_SIZE)
+   {
+      return 0;
+   }
+
+   putLe(buf, COMMANDER_MESSAGE_BODY_SIZE, 2);
+   buf[2] = COMMANDER_MESSAGE_VERSION;
+   buf[3] = msg.face;
+   buf[4] = msg.direction;
+   buf[5] = msg.flags;
+   putLe(buf + 6, msg.sequence, 4);
+   putLe(buf + 10, msg.timestampUs, 8);
+   putFloatLe(buf + 18, msg.yaw);
+   putFloatLe(buf + 22, msg.pitch);
+   putFloatLe(buf + 26, msg.roll);
+   putFloatLe(buf + 30, msg.translation[0]);
+   putFloatLe(buf + 34, msg.translation[1]);
+   putFloatLe(buf + 38, msg.translation[2]);
+   putFloatLe(buf + 42, msg.confidence);
+
+   return COMMANDER_MESSAGE_SIZE;
+}
+
+CommanderDecodeResult decodeCommanderMessage(const uint8_t *buf, size_t len, CommanderMessage &msg, size_t &consumed)
+{
+   if (len < 3)
+   {
+      return COMMANDER_INCOMPLETE;
+   }
+
+   size_t bodySize = getLe(buf, 2);
+   if (bodySize < 1 || bodySize > COMMANDER_MESSAGE_MAX_BODY)
+   {
+      return COMMANDER_CORRUPT;
+   }
+   if (len < 2 + bodySize)
+   {
+      return COMMANDER_INCOMPLETE;
+   }
+   consumed = 2 + bodySize;
+
+   if (buf[2] != COMMANDER_MESSAGE_VERSION)
+   {
+      return COMMANDER_SKIPPED;
+   }
+   if (bodySize < COMMANDER_MESSAGE_BODY_SIZE)
+   {
+      return COMMANDER_CORRUPT;
+   }
+
+   msg.face = buf[3];
+   msg.direction = buf[4];
+   msg.flags = buf[5];
+   msg.sequence = (uint32_t)getLe(buf + 6, 4);
+   msg.timestampUs = getLe(buf + 10, 8);
+   msg.yaw = getFloatLe(buf + 18);
+   msg.pitch = getFloatLe(buf + 22);
+   msg.roll = getFloatLe(buf + 26);
+   msg.translation[0] = getFloatLe(buf + 30);
+   msg.translation[1] = getFloatLe(buf + 34);
+   msg.translation[2] = getFloatLe(buf + 38);
+   msg.confidence = getFloatLe(buf + 42);
+
+   return COMMANDER_DECODED;
+}
@@ -0,0 +1,74 @@
+#ifndef COMMANDERMESSAGE_H
+#define COMMANDERMESSAGE_H
+
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * Binary head pose message for the GizmoCommander link, replacing the single "0"/"1" byte.
+ *
+ * Every message is a little-endian frame: a u16 length (of everything after it) followed by
+ *
+ *   u8 version | u8 face | u8 direction | u8 flags | u32 sequence | u64 timestampUs |
+ *   f32 yaw | f32 pitch | f32 roll | f32 tx | f32 ty | f32 tz | f32 confidence
+ *
+ * flags bit 0 is the facing decision, bit 1 marks a heartbeat (state unchanged, resent so the
+ * receiver knows the link is alive), bit 2 says the face is gone: fewer faces were found than its index, so it is no
+ * longer facing and nothing more will be sent for it until a face is found there again. A receiver must also treat a
+ * face that has had no message for longer than the heartbeat period (plus slack for the link) as stale, since
+ * neither a lost message nor a heartbeat arrives once the link itself has failed.
+ *
+ * face is the position in detection order, not an identity: when two faces swap places between detections, both
+ * slots report a change.
+ *
+ * timestampUs is CLOCK_MONOTONIC on the Gizmo; angles are in degrees and translation in model units (the 3D face model
+ * is in millimetre scale).
+ */
+#define COMMANDER_MESSAGE_VERSION 1
+#define COMMANDER_MESSAGE_BODY_SIZE 44
+#define COMMANDER_MESSAGE_SIZE (2 + COMMANDER_MESSAGE_BODY_SIZE)
+
+#define COMMANDER_FLAG_FACING 0x01
+#define COMMANDER_FLAG_HEARTBEAT 0x02
+#define COMMANDER_FLAG_LOST 0x04
+
+struct CommanderMessage
+{
+   uint8_t face;
+   uint8_t direction; // FaceDirection
+   uint8_t flags;
+   uint32_t sequence;
+   uint64_t timestampUs; // when the frame the decision was made on was captured
+   float yaw;
+   float pitch;
+   float roll;
+   float translation[3];
+   float confidence; // 0 when the decision sits on the facing threshold, 1 when far from it
+};
+
+/**
+ * encodeCommanderMessage - Serialises msg into buf without allocating.
+ *
+ * @return The number of bytes written (COMMANDER_MESSAGE_SIZE), or 0 if capacity is too small.
+ */
+size_t encodeCommanderMessage(const CommanderMessage &msg, uint8_t *buf, size_t capacity);
+
+enum CommanderDecodeResult
+{
+   COMMANDER_DECODED,    // msg filled in, consumed bytes used
+   COMMANDER_INCOMPLETE, // not a whole frame yet, read more and retry
+   COMMANDER_SKIPPED,    // a frame from a newer version, consumed bytes skipped
+   COMMANDER_CORRUPT     // impossible length, the stream cannot be resynchronised
+};
+
+/**
+ * decodeCommanderMessage - Reference decoder. Parses one frame from the start of a byte stream.
+ *
+ * @param buf Received bytes, starting at a frame boundary.
+ * @param len Number of bytes in buf.
+ * @param msg Receives the message.
+ * @param consumed Receives the size of the frame that was decoded or skipped.
+ */
+CommanderDecodeResult decodeCommanderMessage(const uint8_t *buf, size_t len, CommanderMessage &msg, size_t &consumed);
+
+#endif
@@ -0,0 +1,250 @@
+#include "CommanderStandIn.h"
+#include "AimSocket.h"
+#include "CommanderMessage.h"
+#include <netdb.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cstring>
+
+using namespace std;
+
+#define STANDIN_POLL_MS 10
+#define STANDIN_MAX_READ_BYTES 65536
+
+CommanderStandIn::CommanderStandIn(const char *port, bool binary, const CommanderFaults &faults)
+    : port(port), binary(binary), faults(faults)
+{
+   this->faults.readBytes = clamp(faults.readBytes, 1, STANDIN_MAX_READ_BYTES);
+}
+
+CommanderStandIn::~CommanderStandIn()
+{
+   stop();
+}
+
+int CommanderStandIn::start()
+{
+   if (listenOn() < 0)
+   {
+      return -1;
+   }
+   serving = true;
+   server = thread(&CommanderStandIn::serve, this);
+   return 0;
+}
+
+void CommanderStandIn::stop()
+{
+   serving = false;
+   if (server.joinable())
+   {
+      server.join();
+   }
+   closeAll(true);
+   if (listenSd >= 0)
+   {
+      close(listenSd);
+      listenSd = -1;
+   }
+}
+
+vector<CommanderReceipt> CommanderStandIn::receipts()
+{
+   lock_guard<mutex> guard(receiptsLock);
+   return received;
+}
+
+int CommanderStandIn::listenOn()
+{
+   struct addrinfo hints, *servInfo;
+   memset(&hints, 0, sizeof(hints));
+   hints.ai_family = AF_UNSPEC;
+   hints.ai_socktype = SOCK_STREAM;
+   hints.ai_flags = AI_PASSIVE;
+   if (getaddrinfo(NULL, port, &hints, &servInfo) != 0)
+   {
+      return -1;
+   }
+
+   listenSd = socket(servInfo->ai_family, servInfo->ai_socktype | SOCK_CLOEXEC, servInfo->ai_protocol);
+   if (listenSd >= 0)
+   {
+      const int yes = 1;
+      setsockopt(listenSd, SOL_SOCKET, SO_REUSEADDR, (char *)&yes, sizeof(yes));
+      // Set before listen() so accepted connections inherit it and advertise the small window from the start.
+      if (faults.receiveBufferBytes > 0)
+      {
+         setsockopt(listenSd, SOL_SOCKET, SO_RCVBUF, (char *)&faults.receiveBufferBytes, sizeof(faults.receiveBufferBytes));
+      }
+      if (bind(listenSd, servInfo->ai_addr, servInfo->ai_addrlen) < 0 || listen(listenSd, 4) < 0)
+      {
+         close(listenSd);
+         listenSd = -1;
+      }
+   }
+   freeaddrinfo(servInfo);
+   return listenSd < 0 ? -1 : 0;
+}
+
+// Closes every connection; with reset, as an abort (RST) rather than an orderly FIN.
+void CommanderStandIn::closeAll(bool reset)
+{
+   for (Connection &client : clients)
+   {
+      if (reset)
+      {
+         struct linger abort = {1, 0};
+         setsockopt(client.sd, SOL_SOCKET, SO_LINGER, (char *)&abort, sizeof(abort));
+      }
+      close(client.sd);
+   }
+   clients.clear();
+}
+
+// Takes one read's worth from client. Returns false once the connection is finished with.
+bool CommanderStandIn::readFrom(Connection &client)
+{
+   uint8_t buf[STANDIN_MAX_READ_BYTES];
+   ssize_t size = recv(client.sd, buf, faults.readBytes, MSG_DONTWAIT);
+   if (size == 0 || (size < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR))
+   {
+      return false;
+   }
+   if (size < 0)
+   {
+      return true;
+   }
+
+   bytes += size;
+   uint64_t now = monotonicMicros();
+   lock_guard<mutex> guard(receiptsLock);
+
+   if (!binary)
+   {
+      for (ssize_t i = 0; i < size; i++)
+      {
+         received.push_back({now, 0, 0, 0, (uint8_t)(buf[i] == '1' ? COMMANDER_FLAG_FACING : 0)});
+      }
+      messages += size;
+      return true;
+   }
+
+   client.pending.insert(client.pending.end(), buf, buf + size);
+   size_t offset = 0;
+   while (true)
+   {
+      CommanderMessage msg;
+      size_t consumed = 0;
+      CommanderDecodeResult result = decodeCommanderMessage(client.pending.data() + offset, client.pending.size() - offset,
+                                                            msg, consumed);
+      if (result == COMMANDER_INCOMPLETE)
+      {
+         break;
+      }
+      if (result == COMMANDER_CORRUPT)
+      {
+         corrupt++;
+         return false;
+      }
+      if (result == COMMANDER_DECODED)
+      {
+         received.push_back({now, msg.timestampUs, msg.sequence, msg.face, msg.flags});
+         messages++;
+      }
+      offset += consumed;
+   }
+   client.pending.erase(client.pending.begin(), client.pending.begin() + offset);
+   return true;
+}
+
+void CommanderStandIn::serve()
+{
+   uint64_t startUs = monotonicMicros();
+   uint64_t nextResetUs = startUs + (uint64_t)(faults.resetEveryS * 1e6);
+   uint64_t nextRestartUs = startUs + (uint64_t)(faults.restartEveryS * 1e6);
+   uint64_t upAgainUs = 0;
+   vector<struct pollfd> fds;
+
+   while (serving)
+   {
+      uint64_t now = monotonicMicros();
+
+      if (listenSd < 0)
+      {
+         // restarting: nothing listens, so connection attempts are refused
+         if (now < upAgainUs || listenOn() < 0)
+         {
+            usleep(STANDIN_POLL_MS * 1000);
+            continue;
+         }
+      }
+
+      if (faults.restartEveryS > 0 && now >= nextRestartUs)
+      {
+         closeAll(false);
+         close(listenSd);
+         listenSd = -1;
+         restarts++;
+         upAgainUs = now + (uint64_t)(faults.restartDownS * 1e6);
+         nextRestartUs = upAgainUs + (uint64_t)(faults.restartEveryS * 1e6);
+         continue;
+      }
+
+      if (faults.resetEveryS > 0 && now >= nextResetUs)
+      {
+         if (!clients.empty())
+         {
+            closeAll(true);
+            resets++;
+         }
+         nextResetUs = now + (uint64_t)(faults.resetEveryS * 1e6);
+      }
+
+      double elapsedS = (now - startUs) / 1e6;
+      bool stalled = faults.stallAfterS > 0 && elapsedS >= faults.stallAfterS &&
+                     (faults.stallForS <= 0 || elapsedS < faults.stallAfterS + faults.stallForS);
+
+      fds.clear();
+      fds.push_back({listenSd, POLLIN, 0});
+      for (Connection &client : clients)
+      {
+         fds.push_back({client.sd, (short)(stalled ? 0 : POLLIN), 0});
+      }
+      if (poll(fds.data(), fds.size(), STANDIN_POLL_MS) <= 0)
+      {
+         continue;
+      }
+
+      // clients[i] is fds[i + 1]; walk backwards so erasing keeps the two in step
+      for (size_t i = clients.size(); i-- > 0;)
+      {
+         if (!fds[i + 1].revents)
+         {
+            continue;
+         }
+         if (faults.readDelayMs > 0)
+         {
+            usleep(faults.readDelayMs * 1000);
+         }
+         if (!readFrom(clients[i]))
+         {
+            close(clients[i].sd);
+            clients.erase(clients.begin() + i);
+         }
+      }
+
+      if (fds[0].revents & POLLIN)
+      {
+         int clientSd = accept4(listenSd, NULL, NULL, SOCK_CLOEXEC);
+         if (clientSd >= 0)
+         {
+            clients.push_back({clientSd, {}});
+            connections++;
+         }
+      }
+   }
+
+   closeAll(true);
+}
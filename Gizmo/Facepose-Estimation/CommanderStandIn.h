@@ -0,0 +1,95 @@
+#ifndef COMMANDERSTANDIN_H
+#define COMMANDERSTANDIN_H
+
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+/**
+ * Faults the stand-in commander can put on the link. Times are measured from start(); 0 turns a fault off.
+ */
+struct CommanderFaults
+{
+   int readDelayMs = 0;        // pause before every read: a base station that is slow to drain its socket
+   int readBytes = 4096;       // most bytes taken per read
+   int receiveBufferBytes = 0; // SO_RCVBUF of accepted connections, 0 for the kernel default
+   double stallAfterS = 0;     // stop reading altogether after this long, so the receive and send buffers fill up
+   double stallForS = 0;       // and start again after this long; 0 stalls until stop()
+   double resetEveryS = 0;     // abort the connections (RST) this often
+   double restartEveryS = 0;   // close everything and stop listening this often,
+   double restartDownS = 1;    // for this long
+};
+
+/**
+ * One message as it arrived.
+ */
+struct CommanderReceipt
+{
+   uint64_t receivedUs; // CLOCK_MONOTONIC
+   uint64_t sentUs;     // the message's own timestamp (the frame's capture time), 0 for ascii
+   uint32_t sequence;   // 0 for ascii
+   uint8_t face;        // 0 for ascii, which does not say
+   uint8_t flags;       // COMMANDER_FLAG_*; for ascii only COMMANDER_FLAG_FACING
+};
+
+/**
+ * A GizmoCommander for testing the commander link: accepts FaceposeEstimation's connection on port, takes in its ascii
+ * "0"/"1" bytes or CommanderMessage frames, keeps a CommanderReceipt for each, and misbehaves as faults says.
+ */
+class CommanderStandIn
+{
+public:
+   CommanderStandIn(const char *port, bool binary, const CommanderFaults &faults);
+   ~CommanderStandIn();
+
+   /**
+    * start - Listens on the port and serves from a thread of its own.
+    * @return 0 on success, -1 if the port could not be bound.
+    */
+   int start();
+
+   /**
+    * stop - Resets any connection still open and joins the thread. A sender blocked on a full socket gets an error.
+    */
+   void stop();
+
+   vector<CommanderReceipt> receipts();
+
+   atomic<unsigned long> messages{0};
+   atomic<unsigned long> bytes{0};
+   atomic<unsigned long> connections{0};
+   atomic<unsigned long> resets{0};
+   atomic<unsigned long> restarts{0};
+   atomic<unsigned long> corrupt{0}; // connections closed because a frame could not be parsed
+
+private:
+   struct Connection
+   {
+      int sd;
+      vector<uint8_t> pending; // bytes of an incomplete frame
+   };
+
+   const char *port;
+   bool binary;
+   CommanderFaults faults;
+
+   int listenSd = -1;
+   vector<Connection> clients;
+   atomic<bool> serving{false};
+   thread server;
+
+   mutex receiptsLock;
+   vector<CommanderReceipt> received;
+
+   int listenOn();
+   void serve();
+   bool readFrom(Connection &client);
+   void closeAll(bool reset);
+};
+
+#endif
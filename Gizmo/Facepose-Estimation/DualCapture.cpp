@@ -0,0 +1,136 @@
+#include "DualCapture.h"
+
+#include <gst/gst.h>
+#include <gst/app/gstappsink.h>
+#include <gst/video/video.h>
+
+#include <sstream>
+#include <stdexcept>
+
+// Enough for the pairing in read() to catch up when one branch is a frame behind, without letting either fall far back.
+#define DUAL_CAPTURE_QUEUE "queue max-size-buffers=2 leaky=downstream"
+#define DUAL_CAPTURE_SINK "max-buffers=2 drop=true sync=false"
+
+/**
+ * CopySample - Copies a video sample of the given type into out, honouring the stride nvvidconv chose.
+ */
+static bool CopySample(GstSample *sample, int type, cv::Mat &out) {
+    GstVideoInfo info;
+    if (!gst_video_info_from_caps(&info, gst_sample_get_caps(sample))) {
+        return false;
+    }
+    GstBuffer *buffer = gst_sample_get_buffer(sample);
+    GstMapInfo map;
+    if (!gst_buffer_map(buffer, &map, GST_MAP_READ)) {
+        return false;
+    }
+    cv::Mat(GST_VIDEO_INFO_HEIGHT(&info), GST_VIDEO_INFO_WIDTH(&info), type, map.data,
+            GST_VIDEO_INFO_PLANE_STRIDE(&info, 0)).copyTo(out);
+    gst_buffer_unmap(buffer, &map);
+    return true;
+}
+
+static GstClockTime SamplePts(GstSample *sample) { return GST_BUFFER_PTS(gst_sample_get_buffer(sample)); }
+
+DualCapture::DualCapture(cv::Size cameraSize, int fps, int flipMethod, cv::Size detectSize, cv::Size landmarkSize) {
+    std::stringstream ss;
+    ss << "nvarguscamerasrc ! video/x-raw(memory:NVMM), width=" << cameraSize.width << ", height=" << cameraSize.height
+       << ", format=NV12, framerate=" << fps << "/1 ! nvvidconv flip-method=" << flipMethod
+       << " ! video/x-raw(memory:NVMM), format=NV12 ! tee name=t"
+       << " t. ! " DUAL_CAPTURE_QUEUE " ! nvvidconv ! video/x-raw, width=" << detectSize.width << ", height="
+       << detectSize.height << ", format=GRAY8 ! appsink name=detect " DUAL_CAPTURE_SINK
+       << " t. ! " DUAL_CAPTURE_QUEUE " ! nvvidconv ! video/x-raw, width=" << landmarkSize.width << ", height="
+       << landmarkSize.height << ", format=BGRx ! videoconvert ! video/x-raw, format=BGR ! appsink name=landmark "
+       DUAL_CAPTURE_SINK;
+    pipelineDescription = ss.str();
+
+    gst_init(nullptr, nullptr);
+
+    GError *error = nullptr;
+    pipeline = gst_parse_launch(pipelineDescription.c_str(), &error);
+    if (error) { // gst_parse_launch can return a pipeline and an error together
+        std::string message = error->message;
+        g_clear_error(&error);
+        close();
+        throw std::runtime_error("Could not build the dual capture pipeline: " + message);
+    }
+
+    detectSink = gst_bin_get_by_name(GST_BIN(pipeline), "detect");
+    landmarkSink = gst_bin_get_by_name(GST_BIN(pipeline), "landmark");
+    if (gst_element_set_state(pipeline, GST_STATE_PLAYING) == GST_STATE_CHANGE_FAILURE) {
+        close();
+        throw std::runtime_error("Could not start the dual capture pipeline");
+    }
+}
+
+DualCapture::~DualCapture() { close(); }
+
+void DualCapture::close() {
+    if (pipeline) {
+        gst_element_set_state(pipeline, GST_STATE_NULL);
+    }
+    if (detectSink) {
+        gst_object_unref(detectSink);
+    }
+    if (landmarkSink) {
+        gst_object_unref(landmarkSink);
+    }
+    if (pipeline) {
+        gst_object_unref(pipeline);
+    }
+    pipeline = detectSink = landmarkSink = nullptr;
+}
+
+bool DualCapture::read(cv::Mat &detectGray, cv::Mat &landmarkBgr) {
+    GstSample *detect = gst_app_sink_pull_sample(GST_APP_SINK(detectSink));
+    GstSample *landmark = gst_app_sink_pull_sample(GST_APP_SINK(landmarkSink));
+
+    // Both branches keep the timestamp of the camera buffer they were scaled from. When a leaky queue or a sink
+    // dropped a frame on one side only, move the side that is behind forward until they meet again.
+    while (detect && landmark && SamplePts(detect) != SamplePts(landmark)) {
+        unmatched++;
+        if (SamplePts(detect) < SamplePts(landmark)) {
+            gst_sample_unref(detect);
+            detect = gst_app_sink_pull_sample(GST_APP_SINK(detectSink));
+        } else {
+            gst_sample_unref(landmark);
+            landmark = gst_app_sink_pull_sample(GST_APP_SINK(landmarkSink));
+        }
+    }
+
+    bool ok = detect && landmark && CopySample(detect, CV_8UC1, detectGray) && CopySample(landmark, CV_8UC3, landmarkBgr);
+    if (ok) {
+        lastPtsNs = SamplePts(detect);
+        lastCaptureUs = captureTimeUs(lastPtsNs);
+    }
+    if (detect) {
+        gst_sample_unref(detect);
+    }
+    if (landmark) {
+        gst_sample_unref(landmark);
+    }
+    return ok;
+}
+
+// nvarguscamerasrc stamps buffers with running time, the pipeline clock minus the pipeline's base time. With GStreamer's
+// default system clock that clock is CLOCK_MONOTONIC, so the base time plus the PTS is when the frame was taken, on
+// the clock the rest of the program uses.
+uint64_t DualCapture::captureTimeUs(uint64_t ptsNs) {
+    if (clockIsMonotonic < 0) {
+        clockIsMonotonic = 0;
+        GstClock *clock = gst_element_get_clock(pipeline);
+        if (clock && GST_IS_SYSTEM_CLOCK(clock)) {
+            GstClockType type = GST_CLOCK_TYPE_REALTIME;
+            g_object_get(clock, "clock-type", &type, nullptr);
+            clockIsMonotonic = type == GST_CLOCK_TYPE_MONOTONIC;
+        }
+        if (clock) {
+            gst_object_unref(clock);
+        }
+        baseTimeNs = gst_element_get_base_time(pipeline);
+    }
+    if (!clockIsMonotonic || !GST_CLOCK_TIME_IS_VALID(ptsNs)) {
+        return 0;
+    }
+    return (baseTimeNs + ptsNs) / 1000;
+}
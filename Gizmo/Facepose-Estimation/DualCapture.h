@@ -0,0 +1,58 @@
+#ifndef DUALCAPTURE_H
+#define DUALCAPTURE_H
+
+#include <opencv2/core.hpp>
+
+#include <cstdint>
+#include <string>
+
+typedef struct _GstElement GstElement;
+typedef struct _GstSample GstSample;
+
+/**
+ * DualCapture - The camera as two streams scaled by the Jetson's video converter instead of the CPU.
+ *
+ * One nvarguscamerasrc frame is teed inside NVMM memory to two nvvidconv outputs: a small GRAY8 image for the face
+ * detector and a BGR image at a moderate resolution for the landmarker. Each goes to its own appsink, and read() pairs
+ * the two samples that carry the same camera timestamp. The full-resolution frame never reaches system memory.
+ */
+class DualCapture {
+public:
+    /**
+     * @param cameraSize What the sensor is asked for, e.g. 1280x720.
+     * @param fps Camera frame rate.
+     * @param flipMethod nvvidconv flip-method (2 turns the Gizmo's camera the right way up).
+     * @param detectSize Size of the gray detection stream.
+     * @param landmarkSize Size of the BGR landmark stream.
+     */
+    DualCapture(cv::Size cameraSize, int fps, int flipMethod, cv::Size detectSize, cv::Size landmarkSize);
+    ~DualCapture();
+
+    /**
+     * read - Waits for the next pair of frames with matching timestamps.
+     *
+     * @param detectGray Receives the detection frame (CV_8UC1). Reallocated only if the size changes.
+     * @param landmarkBgr Receives the landmark frame (CV_8UC3), likewise.
+     * @return false once the camera stops delivering.
+     */
+    bool read(cv::Mat &detectGray, cv::Mat &landmarkBgr);
+
+    const std::string &description() const { return pipelineDescription; }
+
+    uint64_t lastPtsNs = 0;         // camera timestamp of the last pair
+    uint64_t lastCaptureUs = 0;     // the same on CLOCK_MONOTONIC, or 0 if the pipeline clock is some other clock
+    unsigned long unmatched = 0;    // samples dropped because the other stream had no partner for them
+
+private:
+    void close();
+    uint64_t captureTimeUs(uint64_t ptsNs);
+
+    std::string pipelineDescription;
+    GstElement *pipeline = nullptr;
+    GstElement *detectSink = nullptr;
+    GstElement *landmarkSink = nullptr;
+    int clockIsMonotonic = -1;      // not looked at yet
+    uint64_t baseTimeNs = 0;
+};
+
+#endif
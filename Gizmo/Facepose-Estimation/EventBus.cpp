@@ -0,0 +1,129 @@
+#include "EventBus.h"
+#include "ThreadPolicy.h"
+#include "Trace.h"
+
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <climits>
+#include <cstdio>
+#include <ctime>
+
+static_assert((EVENT_BUS_CAPACITY & (EVENT_BUS_CAPACITY - 1)) == 0, "EVENT_BUS_CAPACITY must be a power of two");
+static_assert(sizeof(std::atomic<uint32_t>) == sizeof(uint32_t), "futexes need a plain 32-bit word");
+
+// A sleeping sink looks at the stop flag at least this often.
+#define EVENT_BUS_SLEEP_NS 100000000
+
+static void FutexWait(std::atomic<uint32_t> &word, uint32_t expected) {
+    struct timespec timeout = {0, EVENT_BUS_SLEEP_NS};
+    syscall(SYS_futex, (uint32_t *)&word, FUTEX_WAIT_PRIVATE, expected, &timeout, nullptr, 0);
+}
+
+static void FutexWakeAll(std::atomic<uint32_t> &word) {
+    syscall(SYS_futex, (uint32_t *)&word, FUTEX_WAKE_PRIVATE, INT_MAX, nullptr, nullptr, 0);
+}
+
+EventBus::~EventBus() { stop(); }
+
+void EventBus::addSink(const char *name, const char *role, Handler handler) {
+    std::unique_ptr<Sink> sink(new Sink);
+    sink->name = name;
+    sink->role = role;
+    sink->handler = std::move(handler);
+    sink->thread = std::thread(&EventBus::sinkLoop, this, sink.get(), head.load());
+    sinks.push_back(std::move(sink));
+}
+
+void EventBus::publish(const BusEvent &event) {
+    uint64_t sequence = head.load(std::memory_order_relaxed); // only this thread writes head
+    Slot &slot = slots[sequence & (EVENT_BUS_CAPACITY - 1)];
+
+    // Same protocol as a seqlock: a reader that sees the stamp change while it copies throws the copy away.
+    slot.stamp.store(0, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    slot.event = event;
+    slot.stamp.store(sequence + 1, std::memory_order_release);
+
+    head.store(sequence + 1);
+    wakeWord.store((uint32_t)(sequence + 1));
+    if (sleepers.load() > 0) {
+        FutexWakeAll(wakeWord);
+    }
+}
+
+bool EventBus::read(uint64_t sequence, BusEvent &event) const {
+    const Slot &slot = slots[sequence & (EVENT_BUS_CAPACITY - 1)];
+    uint64_t stamp = slot.stamp.load(std::memory_order_acquire);
+    if (stamp != sequence + 1) {
+        return false; // already being overwritten
+    }
+    event = slot.event;
+    std::atomic_thread_fence(std::memory_order_acquire);
+    return slot.stamp.load(std::memory_order_relaxed) == stamp;
+}
+
+void EventBus::sinkLoop(Sink *sink, uint64_t next) {
+    traceSetThreadName(sink->name.c_str());
+    applyThreadPolicy(sink->role);
+
+    BusEvent event;
+    while (true) {
+        uint64_t available = head.load();
+        if (next == available) {
+            if (stopping.load()) {
+                return; // everything published has been handled
+            }
+            // Announce the sleep before the last look at head, so publish() either is seen or sees us.
+            sleepers.fetch_add(1);
+            uint32_t observed = wakeWord.load();
+            if (head.load() == next && !stopping.load()) {
+                FutexWait(wakeWord, observed);
+            }
+            sleepers.fetch_sub(1);
+            continue;
+        }
+
+        if (available - next > EVENT_BUS_CAPACITY) { // overtaken: resume at the oldest event still in the ring
+            sink->lost += available - EVENT_BUS_CAPACITY - next;
+            next = available - EVENT_BUS_CAPACITY;
+        }
+        if (!read(next, event)) {
+            sink->lost++;
+            next++;
+            continue;
+        }
+        next++;
+        sink->handler(event, next == head.load(std::memory_order_acquire));
+        sink->consumed++;
+    }
+}
+
+void EventBus::stop() {
+    stopping = true;
+    FutexWakeAll(wakeWord);
+    for (auto &sink : sinks) {
+        if (sink->thread.joinable()) {
+            sink->thread.join();
+        }
+    }
+}
+
+std::string EventBus::describe() {
+    char line[128];
+    snprintf(line, sizeof(line), "events: %llu published", (unsigned long long)head.load());
+    std::string text = line;
+    for (auto &sink : sinks) {
+        snprintf(line, sizeof(line), " | %s %lu (%lu lost)", sink->name.c_str(), sink->consumed.load(), sink->lost.load());
+        text += line;
+    }
+    return text;
+}
+
+unsigned long EventBus::lost() {
+    unsigned long total = 0;
+    for (auto &sink : sinks) {
+        total += sink->lost.load();
+    }
+    return total;
+}
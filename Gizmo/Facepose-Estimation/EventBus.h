@@ -0,0 +1,113 @@
+#ifndef EVENTBUS_H
+#define EVENTBUS_H
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Events kept for the sinks; a power of two. A sink that falls further behind than this loses the oldest ones.
+#define EVENT_BUS_CAPACITY 1024
+
+enum BusEventType : uint8_t {
+    BUS_FRAME, // a processed frame; faces BUS_FACE events follow
+    BUS_FACE,  // one face's pose and facing decision
+    BUS_AIM    // where the camera should turn: the offset of a face from the frame center
+};
+
+/**
+ * BusEvent - What the vision loop decided about a frame. Plain data, copied into and out of the ring.
+ */
+struct BusEvent {
+    BusEventType type;
+    uint8_t facing;        // BUS_FACE
+    uint8_t direction;     // BUS_FACE: FaceDirection
+    uint8_t camera;        // 0 for the main camera, then in -camera order
+    uint32_t face;         // BUS_FACE, BUS_AIM: index in detection order
+    uint32_t faces;        // BUS_FRAME
+    uint64_t frameNumber;
+    uint64_t timestampUs;  // CLOCK_MONOTONIC when published, i.e. when the decision was made
+    uint64_t captureUs;    // CLOCK_MONOTONIC when the camera took the frame it was made on
+    float euler[3];        // BUS_FACE: pitch, yaw, roll
+    float translation[3];  // BUS_FACE
+    float dist;            // BUS_FACE: nose line length the decision was made on
+    int32_t aimX, aimY;    // BUS_AIM
+};
+
+/**
+ * EventBus - Hands the vision loop's decisions to any number of sinks, each on its own thread.
+ *
+ * publish() copies the event into a broadcast ring and moves on: it takes no lock and never waits, however slow a
+ * sink is. Every sink reads the ring at its own pace with its own cursor. One that is overtaken by the producer skips
+ * to the oldest event still there and counts what it missed. An idle sink sleeps on a futex; publish() only makes the
+ * wake-up system call when a sink is asleep.
+ *
+ * One producer thread; add every sink before the first publish().
+ */
+class EventBus {
+public:
+    /**
+     * Handler - Called on the sink's thread for every event in order. caughtUp is true when no newer event was waiting,
+     * so a sink that only cares about the latest state (the servos) can skip stale ones.
+     */
+    typedef std::function<void(const BusEvent &event, bool caughtUp)> Handler;
+
+    EventBus() = default;
+    ~EventBus();
+
+    /**
+     * addSink - Starts a sink thread.
+     *
+     * @param name Thread name, for traces and the stats output.
+     * @param role Thread policy role (see ThreadPolicy.h).
+     * @param handler What the sink does with each event.
+     */
+    void addSink(const char *name, const char *role, Handler handler);
+
+    void publish(const BusEvent &event);
+
+    /**
+     * stop - Lets every sink finish the events already published, then joins them.
+     */
+    void stop();
+
+    /**
+     * describe - Events published, and consumed and lost per sink, for the stats output.
+     */
+    std::string describe();
+
+    /**
+     * lost - Events missed by falling behind, summed over the sinks.
+     */
+    unsigned long lost();
+
+private:
+    struct Slot {
+        std::atomic<uint64_t> stamp{0}; // sequence number + 1 of the event in the slot, 0 while it is being written
+        BusEvent event;
+    };
+
+    struct Sink {
+        std::string name;
+        const char *role;
+        Handler handler;
+        std::thread thread;
+        std::atomic<unsigned long> consumed{0};
+        std::atomic<unsigned long> lost{0};
+    };
+
+    bool read(uint64_t sequence, BusEvent &event) const;
+    void sinkLoop(Sink *sink, uint64_t next);
+
+    Slot slots[EVENT_BUS_CAPACITY];
+    std::atomic<uint64_t> head{0};      // sequence number of the next event
+    std::atomic<uint32_t> wakeWord{0};  // low half of head, which sleeping sinks wait on
+    std::atomic<int> sleepers{0};
+    std::atomic<bool> stopping{false};
+    std::vector<std::unique_ptr<Sink>> sinks;
+};
+
+#endif
@@ -0,0 +1,296 @@
+#include "FastDownsample.h"
+
+#include <cstring>
+#include <vector>
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define FAST_DOWNSAMPLE_NEON 1
+#elif defined(__AVX2__)
+#include <immintrin.h>
+#define FAST_DOWNSAMPLE_AVX2 1
+#endif
+
+// BT.601 luma weights in 1/256ths, the same ones OpenCV's BGR2GRAY uses.
+#define GRAY_WEIGHT_B 29
+#define GRAY_WEIGHT_G 150
+#define GRAY_WEIGHT_R 77
+
+const char *FastDownsampleIsa() {
+#if defined(FAST_DOWNSAMPLE_NEON)
+    return "NEON";
+#elif defined(FAST_DOWNSAMPLE_AVX2)
+    return "AVX2";
+#else
+    return "scalar";
+#endif
+}
+
+/**
+ * GrayFromSums - Gray value of a 4x4 block from its per-channel sums (each at most 16 * 255).
+ */
+static inline uint8_t GrayFromSums(uint32_t b, uint32_t g, uint32_t r) {
+    return (uint8_t)((GRAY_WEIGHT_B * b + GRAY_WEIGHT_G * g + GRAY_WEIGHT_R * r + (1 << 11)) >> 12);
+}
+
+/**
+ * AddRows - sum[i] = a[i] + b[i] for count bytes.
+ */
+static void AddRows(const uint8_t *a, const uint8_t *b, uint16_t *sum, int count) {
+    int i = 0;
+#if defined(FAST_DOWNSAMPLE_AVX2)
+    for (; i + 16 <= count; i += 16) {
+        __m256i wideA = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i *)(a + i)));
+        __m256i wideB = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i *)(b + i)));
+        _mm256_storeu_si256((__m256i *)(sum + i), _mm256_add_epi16(wideA, wideB));
+    }
+#endif
+    for (; i < count; ++i) {
+        sum[i] = a[i] + b[i];
+    }
+}
+
+/**
+ * DownsampleRowGroup - Four source rows into one gray row and (optionally) two display rows, from pixel `from` on.
+ *
+ * top and bottom are the vertical sums of rows 0+1 and 2+3, three channels per pixel.
+ */
+static void DownsampleRowGroup(const uint16_t *top, const uint16_t *bottom, int width, int from,
+                               uint8_t *gray, uint8_t *half0, uint8_t *half1) {
+    int quarterWidth = width / 4;
+    for (int k = from / 4; k < quarterWidth; ++k) {
+        uint32_t block[3];
+        for (int c = 0; c < 3; ++c) {
+            uint32_t left0 = top[12 * k + c] + top[12 * k + 3 + c];
+            uint32_t right0 = top[12 * k + 6 + c] + top[12 * k + 9 + c];
+            uint32_t left1 = bottom[12 * k + c] + bottom[12 * k + 3 + c];
+            uint32_t right1 = bottom[12 * k + 6 + c] + bottom[12 * k + 9 + c];
+            block[c] = left0 + right0 + left1 + right1;
+            if (half0) {
+                half0[6 * k + c] = (uint8_t)((left0 + 2) >> 2);
+                half0[6 * k + 3 + c] = (uint8_t)((right0 + 2) >> 2);
+                half1[6 * k + c] = (uint8_t)((left1 + 2) >> 2);
+                half1[6 * k + 3 + c] = (uint8_t)((right1 + 2) >> 2);
+            }
+        }
+        gray[k] = GrayFromSums(block[0], block[1], block[2]);
+    }
+
+    // An odd number of half-scale columns leaves one display pixel without a gray block.
+    if (half0 && (width / 2) > 2 * quarterWidth) {
+        int j = width / 2 - 1;
+        for (int c = 0; c < 3; ++c) {
+            half0[3 * j + c] = (uint8_t)((top[6 * j + c] + top[6 * j + 3 + c] + 2) >> 2);
+            half1[3 * j + c] = (uint8_t)((bottom[6 * j + c] + bottom[6 * j + 3 + c] + 2) >> 2);
+        }
+    }
+}
+
+#if defined(FAST_DOWNSAMPLE_NEON)
+/**
+ * DownsampleRowGroupNeon - DownsampleRowGroup straight from the four source rows, 16 source pixels per step.
+ *
+ * vld3 splits the channels, so the horizontal pair sums are plain pairwise adds.
+ * @return The first source pixel left for the scalar code.
+ */
+static int DownsampleRowGroupNeon(const uint8_t *r0, const uint8_t *r1, const uint8_t *r2, const uint8_t *r3, int width,
+                                  uint8_t *gray, uint8_t *half0, uint8_t *half1) {
+    int x = 0;
+    for (; x + 16 <= width; x += 16) {
+        uint8x16x3_t p0 = vld3q_u8(r0 + 3 * x);
+        uint8x16x3_t p1 = vld3q_u8(r1 + 3 * x);
+        uint8x16x3_t p2 = vld3q_u8(r2 + 3 * x);
+        uint8x16x3_t p3 = vld3q_u8(r3 + 3 * x);
+
+        uint8x8x3_t top, bottom;
+        uint32x4_t block[3];
+        for (int c = 0; c < 3; ++c) {
+            // 2x2 sums: eight half-scale pixels per channel.
+            uint16x8_t sum01 = vaddq_u16(vpaddlq_u8(p0.val[c]), vpaddlq_u8(p1.val[c]));
+            uint16x8_t sum23 = vaddq_u16(vpaddlq_u8(p2.val[c]), vpaddlq_u8(p3.val[c]));
+            top.val[c] = vrshrn_n_u16(sum01, 2);
+            bottom.val[c] = vrshrn_n_u16(sum23, 2);
+            // 4x4 sums: four quarter-scale pixels per channel.
+            block[c] = vpaddlq_u16(vaddq_u16(sum01, sum23));
+        }
+
+        if (half0) {
+            vst3_u8(half0 + 3 * (x / 2), top);
+            vst3_u8(half1 + 3 * (x / 2), bottom);
+        }
+
+        uint32x4_t luma = vmulq_n_u32(block[0], GRAY_WEIGHT_B);
+        luma = vmlaq_n_u32(luma, block[1], GRAY_WEIGHT_G);
+        luma = vmlaq_n_u32(luma, block[2], GRAY_WEIGHT_R);
+        uint16x4_t luma16 = vmovn_u32(vrshrq_n_u32(luma, 12));
+        uint8x8_t luma8 = vmovn_u16(vcombine_u16(luma16, luma16));
+        uint32_t packed = vget_lane_u32(vreinterpret_u32_u8(luma8), 0);
+        memcpy(gray + x / 4, &packed, sizeof(packed));
+    }
+    return x;
+}
+#endif
+
+#if defined(FAST_DOWNSAMPLE_AVX2)
+// pshufb masks that pick channel c of 16 BGR pixels out of the 16-byte chunk k of their 48 bytes; -1 gives zero.
+static const int8_t DeinterleaveMasks[3][3][16] = {
+    {{0, 3, 6, 9, 12, 15, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+     {-1, -1, -1, -1, -1, -1, 2, 5, 8, 11, 14, -1, -1, -1, -1, -1},
+     {-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 1, 4, 7, 10, 13}},
+    {{1, 4, 7, 10, 13, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+     {-1, -1, -1, -1, -1, 0, 3, 6, 9, 12, 15, -1, -1, -1, -1, -1},
+     {-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 2, 5, 8, 11, 14}},
+    {{2, 5, 8, 11, 14, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+     {-1, -1, -1, -1, -1, 1, 4, 7, 10, 13, -1, -1, -1, -1, -1, -1},
+     {-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 0, 3, 6, 9, 12, 15}},
+};
+
+// pshufb masks that interleave 8 pixels back into 24 BGR bytes, from [B0..B7 G0..G7] and [R0..R7 ...]: the first
+// 16 bytes, then the last 8.
+static const int8_t InterleaveBgMasks[2][16] = {
+    {0, 8, -1, 1, 9, -1, 2, 10, -1, 3, 11, -1, 4, 12, -1, 5},
+    {13, -1, 6, 14, -1, 7, 15, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+};
+static const int8_t InterleaveRMasks[2][16] = {
+    {-1, -1, 0, -1, -1, 1, -1, -1, 2, -1, -1, 3, -1, -1, 4, -1},
+    {-1, 5, -1, -1, 6, -1, -1, 7, -1, -1, -1, -1, -1, -1, -1, -1},
+};
+
+static inline __m256i BothLanes(const int8_t *mask) {
+    return _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *)mask));
+}
+
+/**
+ * DeinterleaveBgr - Splits 16 BGR pixels of two rows into their channels: lane 0 from low, lane 1 from high.
+ */
+static inline void DeinterleaveBgr(const uint8_t *low, const uint8_t *high, __m256i channels[3]) {
+    __m256i chunks[3];
+    for (int k = 0; k < 3; ++k) {
+        __m128i lowChunk = _mm_loadu_si128((const __m128i *)(low + 16 * k));
+        __m128i highChunk = _mm_loadu_si128((const __m128i *)(high + 16 * k));
+        chunks[k] = _mm256_inserti128_si256(_mm256_castsi128_si256(lowChunk), highChunk, 1);
+    }
+    for (int c = 0; c < 3; ++c) {
+        channels[c] = _mm256_or_si256(
+            _mm256_or_si256(_mm256_shuffle_epi8(chunks[0], BothLanes(DeinterleaveMasks[c][0])),
+                            _mm256_shuffle_epi8(chunks[1], BothLanes(DeinterleaveMasks[c][1]))),
+            _mm256_shuffle_epi8(chunks[2], BothLanes(DeinterleaveMasks[c][2])));
+    }
+}
+
+/**
+ * DownsampleRowGroupAvx2 - DownsampleRowGroupNeon for x86, 16 source pixels per step.
+ *
+ * Rows 0 and 2 share one register (a 128-bit lane each), as do rows 1 and 3, so one pass of shuffles splits the
+ * channels of all four rows. maddubs against ones gives the horizontal pair sums; adding the two registers gives the
+ * 2x2 sums of rows 0+1 in lane 0 and of rows 2+3 in lane 1, which are the two display rows.
+ * @return The first source pixel left for the scalar code.
+ */
+static int DownsampleRowGroupAvx2(const uint8_t *r0, const uint8_t *r1, const uint8_t *r2, const uint8_t *r3, int width,
+                                  uint8_t *gray, uint8_t *half0, uint8_t *half1) {
+    const __m256i ones8 = _mm256_set1_epi8(1);
+    const __m256i two = _mm256_set1_epi16(2);
+    const __m128i ones16 = _mm_set1_epi16(1);
+
+    int x = 0;
+    for (; x + 16 <= width; x += 16) {
+        __m256i rows02[3], rows13[3];
+        DeinterleaveBgr(r0 + 3 * x, r2 + 3 * x, rows02);
+        DeinterleaveBgr(r1 + 3 * x, r3 + 3 * x, rows13);
+
+        __m256i pairs[3];   // 2x2 sums, eight per lane: rows 0+1 in lane 0, rows 2+3 in lane 1
+        __m128i block[3];   // 4x4 sums, four per channel
+        for (int c = 0; c < 3; ++c) {
+            pairs[c] = _mm256_add_epi16(_mm256_maddubs_epi16(rows02[c], ones8), _mm256_maddubs_epi16(rows13[c], ones8));
+            __m128i quad = _mm_add_epi16(_mm256_castsi256_si128(pairs[c]), _mm256_extracti128_si256(pairs[c], 1));
+            block[c] = _mm_madd_epi16(quad, ones16);
+        }
+
+        if (half0) {
+            __m256i b = _mm256_srli_epi16(_mm256_add_epi16(pairs[0], two), 2);
+            __m256i g = _mm256_srli_epi16(_mm256_add_epi16(pairs[1], two), 2);
+            __m256i r = _mm256_srli_epi16(_mm256_add_epi16(pairs[2], two), 2);
+            __m256i bg = _mm256_packus_epi16(b, g);
+            __m256i rr = _mm256_packus_epi16(r, r);
+            __m256i first = _mm256_or_si256(_mm256_shuffle_epi8(bg, BothLanes(InterleaveBgMasks[0])),
+                                            _mm256_shuffle_epi8(rr, BothLanes(InterleaveRMasks[0])));
+            __m256i last = _mm256_or_si256(_mm256_shuffle_epi8(bg, BothLanes(InterleaveBgMasks[1])),
+                                           _mm256_shuffle_epi8(rr, BothLanes(InterleaveRMasks[1])));
+            uint8_t *out0 = half0 + 3 * (x / 2);
+            uint8_t *out1 = half1 + 3 * (x / 2);
+            _mm_storeu_si128((__m128i *)out0, _mm256_castsi256_si128(first));
+            _mm_storel_epi64((__m128i *)(out0 + 16), _mm256_castsi256_si128(last));
+            _mm_storeu_si128((__m128i *)out1, _mm256_extracti128_si256(first, 1));
+            _mm_storel_epi64((__m128i *)(out1 + 16), _mm256_extracti128_si256(last, 1));
+        }
+
+        __m128i luma = _mm_mullo_epi32(block[0], _mm_set1_epi32(GRAY_WEIGHT_B));
+        luma = _mm_add_epi32(luma, _mm_mullo_epi32(block[1], _mm_set1_epi32(GRAY_WEIGHT_G)));
+        luma = _mm_add_epi32(luma, _mm_mullo_epi32(block[2], _mm_set1_epi32(GRAY_WEIGHT_R)));
+        luma = _mm_srli_epi32(_mm_add_epi32(luma, _mm_set1_epi32(1 << 11)), 12);
+        __m128i luma16 = _mm_packus_epi32(luma, luma);
+        uint32_t packed = (uint32_t)_mm_cvtsi128_si32(_mm_packus_epi16(luma16, luma16));
+        memcpy(gray + x / 4, &packed, sizeof(packed));
+    }
+    return x;
+}
+#endif
+
+void DownsampleBgr(const uint8_t *src, size_t srcStep, int width, int height,
+                   uint8_t *gray, size_t grayStep, uint8_t *half, size_t halfStep) {
+    // Vertical sums of a row pair; kept per thread so steady state does not allocate.
+    static thread_local std::vector<uint16_t> top, bottom;
+    top.resize(3 * width);
+    bottom.resize(3 * width);
+
+    int groups = height / 4;
+    for (int q = 0; q < groups; ++q) {
+        const uint8_t *r0 = src + (4 * q) * srcStep;
+        const uint8_t *r1 = r0 + srcStep;
+        const uint8_t *r2 = r1 + srcStep;
+        const uint8_t *r3 = r2 + srcStep;
+        uint8_t *grayRow = gray + q * grayStep;
+        uint8_t *half0 = half ? half + (2 * q) * halfStep : nullptr;
+        uint8_t *half1 = half ? half0 + halfStep : nullptr;
+
+        int from = 0;
+#if defined(FAST_DOWNSAMPLE_NEON)
+        from = DownsampleRowGroupNeon(r0, r1, r2, r3, width, grayRow, half0, half1);
+#elif defined(FAST_DOWNSAMPLE_AVX2)
+        from = DownsampleRowGroupAvx2(r0, r1, r2, r3, width, grayRow, half0, half1);
+#endif
+        if (from == width) {
+            continue;
+        }
+        AddRows(r0, r1, top.data(), 3 * width);
+        AddRows(r2, r3, bottom.data(), 3 * width);
+        DownsampleRowGroup(top.data(), bottom.data(), width, from, grayRow, half0, half1);
+    }
+
+    // A height of 4n + 2 or 4n + 3 leaves one display row without a gray row.
+    if (half && (height / 2) > 2 * groups) {
+        const uint8_t *r0 = src + (4 * groups) * srcStep;
+        uint8_t *halfRow = half + (2 * groups) * halfStep;
+        AddRows(r0, r0 + srcStep, top.data(), 3 * width);
+        for (int j = 0; j < width / 2; ++j) {
+            for (int c = 0; c < 3; ++c) {
+                halfRow[3 * j + c] = (uint8_t)((top[6 * j + c] + top[6 * j + 3 + c] + 2) >> 2);
+            }
+        }
+    }
+}
+
+void FastDownsample(const cv::Mat &bgr, cv::Mat &graySmall, cv::Mat *displayHalf) {
+    CV_Assert(bgr.type() == CV_8UC3);
+
+    graySmall.create(bgr.rows / FAST_DOWNSAMPLE_RATIO, bgr.cols / FAST_DOWNSAMPLE_RATIO, CV_8UC1);
+    uint8_t *half = nullptr;
+    size_t halfStep = 0;
+    if (displayHalf) {
+        displayHalf->create(bgr.rows / 2, bgr.cols / 2, CV_8UC3);
+        half = displayHalf->data;
+        halfStep = displayHalf->step[0];
+    }
+
+    DownsampleBgr(bgr.data, bgr.step[0], bgr.cols, bgr.rows, graySmall.data, graySmall.step[0], half, halfStep);
+}
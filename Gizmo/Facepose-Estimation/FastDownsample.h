@@ -0,0 +1,48 @@
+#ifndef FASTDOWNSAMPLE_H
+#define FASTDOWNSAMPLE_H
+
+#include <opencv2/core.hpp>
+
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * Fused downsampling of camera frames.
+ *
+ * The vision loop needs a 1/4 scale image for face detection and, when a window is open, a 1/2 scale image for display.
+ * Instead of cv::resize twice plus dlib's own BGR to gray conversion for HOG, the frame is read once, four rows at a
+ * time: each 2x2 block is averaged into the BGR display image and each 4x4 block is averaged and converted to gray
+ * (BT.601 weights) for detection. Both are box filters, so every source pixel contributes.
+ *
+ * Whole row groups are done with NEON on the Jetson and with AVX2 on an x86 machine when FastDownsample.cpp is built
+ * with -mavx2 (cmake -DGIZMO_AVX2=ON), with a scalar fallback. All three give the same bytes.
+ */
+#define FAST_DOWNSAMPLE_RATIO 4
+
+/**
+ * DownsampleBgr - The kernel, on raw 8-bit BGR rows.
+ *
+ * @param src First row of the BGR source, srcStep bytes apart.
+ * @param width Width of the source in pixels.
+ * @param height Height of the source in rows.
+ * @param gray Output of (width / 4) x (height / 4) gray pixels, grayStep bytes apart.
+ * @param half Output of (width / 2) x (height / 2) BGR pixels, halfStep bytes apart. May be nullptr.
+ */
+void DownsampleBgr(const uint8_t *src, size_t srcStep, int width, int height,
+                   uint8_t *gray, size_t grayStep, uint8_t *half, size_t halfStep);
+
+/**
+ * FastDownsample - DownsampleBgr on cv::Mats. The outputs are (re)allocated as needed, so they can be reused every frame.
+ *
+ * @param bgr A CV_8UC3 frame.
+ * @param graySmall Receives the CV_8UC1 1/4 scale detection image.
+ * @param displayHalf If not null, receives the CV_8UC3 1/2 scale display image.
+ */
+void FastDownsample(const cv::Mat &bgr, cv::Mat &graySmall, cv::Mat *displayHalf = nullptr);
+
+/**
+ * FastDownsampleIsa - Which code path this build uses: "NEON", "AVX2" or "scalar".
+ */
+const char *FastDownsampleIsa();
+
+#endif
@@ -0,0 +1,185 @@
+#include "FrameBus.h"
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <cstring>
+#include <new>
+#include <stdexcept>
+
+using namespace std;
+
+static_assert(sizeof(FrameSlotHeader) <= FRAME_SLOT_DATA_OFFSET, "slot header must fit before the pixels");
+static_assert(sizeof(FrameBusHeader) <= FRAME_SLOT_DATA_OFFSET, "bus header must fit before the first slot");
+static_assert(atomic<uint64_t>::is_always_lock_free, "the shared counters must be lock free to work across processes");
+
+static size_t roundUp(size_t value, size_t alignment)
+{
+   return (value + alignment - 1) / alignment * alignment;
+}
+
+FrameBusWriter::FrameBusWriter(const string &name, size_t maxFrameBytes, uint32_t slotCount) : name(name)
+{
+   size_t slotStride = roundUp(FRAME_SLOT_DATA_OFFSET + maxFrameBytes, 4096);
+   mappedSize = FRAME_SLOT_DATA_OFFSET + slotStride * slotCount;
+
+   shm_unlink(name.c_str()); // a ring left behind by a crashed run may have another geometry
+   int fd = shm_open(name.c_str(), O_CREAT | O_RDWR | O_CLOEXEC, 0644);
+   if (fd < 0)
+   {
+      throw runtime_error("Could not create shared memory " + name);
+   }
+   if (ftruncate(fd, mappedSize) < 0)
+   {
+      close(fd);
+      throw runtime_error("Could not size shared memory " + name);
+   }
+
+   void *mapped = mmap(NULL, mappedSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+   close(fd);
+   if (mapped == MAP_FAILED)
+   {
+      throw runtime_error("Could not map shared memory " + name);
+   }
+
+   base = (uint8_t *)mapped;
+   header = new (base) FrameBusHeader();
+   header->slotCount = slotCount;
+   header->slotStride = slotStride;
+   header->maxFrameBytes = maxFrameBytes;
+   header->version = FRAME_BUS_VERSION;
+   header->published.store(0);
+   header->closed.store(0);
+   for (uint32_t slot = 0; slot < slotCount; slot++)
+   {
+      FrameSlotHeader *slotHeader = new (base + FRAME_SLOT_DATA_OFFSET + (size_t)slot * slotStride) FrameSlotHeader();
+      slotHeader->sequence.store(0);
+   }
+
+   // readers check the magic last, so they never see a half-initialised header
+   atomic_thread_fence(memory_order_release);
+   header->magic = FRAME_BUS_MAGIC;
+}
+
+FrameBusWriter::~FrameBusWriter()
+{
+   header->closed.store(1, memory_order_release);
+   munmap(base, mappedSize);
+   shm_unlink(name.c_str());
+}
+
+int FrameBusWriter::publish(const uint8_t *data, int rows, int cols, int type, int step, uint64_t frameNumber, uint64_t timestampUs)
+{
+   if ((size_t)rows * step > header->maxFrameBytes)
+   {
+      return -1;
+   }
+
+   uint64_t published = header->published.load(memory_order_relaxed);
+   uint32_t slot = published % header->slotCount;
+   uint8_t *slotBase = base + FRAME_SLOT_DATA_OFFSET + (size_t)slot * header->slotStride;
+   FrameSlotHeader *slotHeader = (FrameSlotHeader *)slotBase;
+
+   uint32_t sequence = slotHeader->sequence.load(memory_order_relaxed);
+   slotHeader->sequence.store(sequence + 1, memory_order_relaxed);
+   atomic_thread_fence(memory_order_release);
+
+   slotHeader->frameNumber = frameNumber;
+   slotHeader->timestampUs = timestampUs;
+   slotHeader->rows = rows;
+   slotHeader->cols = cols;
+   slotHeader->type = type;
+   slotHeader->step = step;
+   memcpy(slotBase + FRAME_SLOT_DATA_OFFSET, data, (size_t)rows * step);
+
+   slotHeader->sequence.store(sequence + 2, memory_order_release);
+   header->published.store(published + 1, memory_order_release);
+
+   return 0;
+}
+
+FrameBusReader::FrameBusReader(const string &name)
+{
+   int fd = shm_open(name.c_str(), O_RDONLY | O_CLOEXEC, 0);
+   if (fd < 0)
+   {
+      throw runtime_error("No frame bus named " + name + " (is FaceposeEstimation running with -framebus?)");
+   }
+
+   struct stat st;
+   fstat(fd, &st);
+   mappedSize = st.st_size;
+
+   void *mapped = mmap(NULL, mappedSize, PROT_READ, MAP_SHARED, fd, 0);
+   close(fd);
+   if (mapped == MAP_FAILED)
+   {
+      throw runtime_error("Could not map frame bus " + name);
+   }
+
+   base = (const uint8_t *)mapped;
+   header = (const FrameBusHeader *)base;
+   if (mappedSize < FRAME_SLOT_DATA_OFFSET || header->magic != FRAME_BUS_MAGIC || header->version != FRAME_BUS_VERSION ||
+       FRAME_SLOT_DATA_OFFSET + (size_t)header->slotStride * header->slotCount > mappedSize)
+   {
+      munmap((void *)base, mappedSize);
+      throw runtime_error("Frame bus " + name + " is not initialised or has an unknown version");
+   }
+}
+
+FrameBusReader::~FrameBusReader()
+{
+   munmap((void *)base, mappedSize);
+}
+
+const FrameSlotHeader *FrameBusReader::slotHeader(uint32_t slot)
+{
+   return (const FrameSlotHeader *)(base + FRAME_SLOT_DATA_OFFSET + (size_t)slot * header->slotStride);
+}
+
+bool FrameBusReader::latest(FrameView &view)
+{
+   uint64_t published = header->published.load(memory_order_acquire);
+   if (published == 0)
+   {
+      return false;
+   }
+
+   uint32_t slot = (published - 1) % header->slotCount;
+   const FrameSlotHeader *slotHeader = this->slotHeader(slot);
+
+   uint32_t sequence = slotHeader->sequence.load(memory_order_acquire);
+   if (sequence & 1)
+   {
+      return false;
+   }
+
+   view.data = (const uint8_t *)slotHeader + FRAME_SLOT_DATA_OFFSET;
+   view.frameNumber = slotHeader->frameNumber;
+   view.timestampUs = slotHeader->timestampUs;
+   view.rows = slotHeader->rows;
+   view.cols = slotHeader->cols;
+   view.type = slotHeader->type;
+   view.step = slotHeader->step;
+   view.slot = slot;
+   view.sequence = sequence;
+
+   // the fields above are only consistent if nobody entered the slot while they were read
+   return stillValid(view);
+}
+
+bool FrameBusReader::next(uint64_t afterFrame, FrameView &view)
+{
+   return latest(view) && view.frameNumber > afterFrame;
+}
+
+bool FrameBusReader::stillValid(const FrameView &view)
+{
+   atomic_thread_fence(memory_order_acquire);
+   return slotHeader(view.slot)->sequence.load(memory_order_relaxed) == view.sequence;
+}
+
+bool FrameBusReader::closed()
+{
+   return header->closed.load(memory_order_acquire) != 0;
+}
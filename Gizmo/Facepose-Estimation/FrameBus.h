@@ -0,0 +1,129 @@
+#ifndef FRAMEBUS_H
+#define FRAMEBUS_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+/**
+ * Shared-memory frame bus.
+ *
+ * FaceposeEstimation owns the camera and copies every captured frame once into a POSIX shared-memory ring
+ * (/dev/shm/<name>). Other local processes map the ring read-only and look at frames in place.
+ *
+ * Each slot is guarded by a sequence lock: the writer makes the slot's sequence odd while it fills the slot
+ * and even when done. A reader notes the sequence before using a frame and checks it afterwards with
+ * FrameBusReader::stillValid(). The writer never waits for readers; a reader that holds on to a frame for
+ * longer than slotCount frame periods sees it overwritten and just drops what it computed.
+ */
+#define FRAME_BUS_MAGIC 0x46425553 // "FBUS"
+#define FRAME_BUS_VERSION 1
+#define FRAME_BUS_SLOTS 4
+
+struct FrameBusHeader
+{
+   uint32_t magic;
+   uint32_t version;
+   uint32_t slotCount;
+   uint32_t slotStride;    // bytes from one slot header to the next
+   uint32_t maxFrameBytes; // pixel capacity of each slot
+   std::atomic<uint32_t> closed; // set when the writer goes; no frame will follow
+   std::atomic<uint64_t> published; // frames written so far; the newest is in slot (published - 1) % slotCount
+};
+
+struct FrameSlotHeader
+{
+   std::atomic<uint32_t> sequence; // odd while the writer is inside the slot
+   uint32_t reserved;
+   uint64_t frameNumber;
+   uint64_t timestampUs; // CLOCK_MONOTONIC at capture
+   int32_t rows;
+   int32_t cols;
+   int32_t type; // OpenCV type, e.g. CV_8UC3
+   int32_t step; // bytes per row
+};
+
+// Pixels start this far into a slot, so rows are cache line aligned.
+#define FRAME_SLOT_DATA_OFFSET 64
+
+/**
+ * A frame inside the shared ring. data points into shared memory and is only trustworthy while
+ * FrameBusReader::stillValid() says so.
+ */
+struct FrameView
+{
+   const uint8_t *data;
+   uint64_t frameNumber;
+   uint64_t timestampUs;
+   int rows;
+   int cols;
+   int type;
+   int step;
+
+   uint32_t slot;
+   uint32_t sequence;
+};
+
+class FrameBusWriter
+{
+public:
+   /**
+    * Creates (or replaces) the shared-memory object name, e.g. "/gizmo_frames", sized for frames of up to maxFrameBytes.
+    */
+   FrameBusWriter(const std::string &name, size_t maxFrameBytes, uint32_t slotCount = FRAME_BUS_SLOTS);
+   /**
+    * Marks the ring closed for readers that still have it mapped, then unmaps and unlinks it.
+    */
+   ~FrameBusWriter();
+
+   /**
+    * publish - Copies one frame into the next slot. Frames larger than maxFrameBytes are skipped.
+    * @return 0 on success, -1 if the frame did not fit.
+    */
+   int publish(const uint8_t *data, int rows, int cols, int type, int step, uint64_t frameNumber, uint64_t timestampUs);
+
+private:
+   std::string name;
+   size_t mappedSize;
+   uint8_t *base;
+   FrameBusHeader *header;
+};
+
+class FrameBusReader
+{
+public:
+   FrameBusReader(const std::string &name);
+   ~FrameBusReader();
+
+   /**
+    * latest - Points view at the newest complete frame.
+    * @return false if nothing has been published yet, or the writer is in the middle of that slot.
+    */
+   bool latest(FrameView &view);
+
+   /**
+    * next - Like latest(), but only succeeds once a frame newer than afterFrame is available.
+    */
+   bool next(uint64_t afterFrame, FrameView &view);
+
+   /**
+    * stillValid - True if the frame behind view has not been touched since it was handed out.
+    * Check after using the pixels; if false, whatever was computed from them must be discarded.
+    */
+   bool stillValid(const FrameView &view);
+
+   /**
+    * closed - True once the writer has gone. The ring is unlinked by then, so a new writer makes a new one to open.
+    */
+   bool closed();
+
+private:
+   size_t mappedSize;
+   const uint8_t *base;
+   const FrameBusHeader *header;
+
+   const FrameSlotHeader *slotHeader(uint32_t slot);
+};
+
+#endif
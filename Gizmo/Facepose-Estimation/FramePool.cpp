@@ -0,0 +1,100 @@
+#include "FramePool.h"
+#include "Trace.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <stdexcept>
+#include <utility>
+
+FrameRef::FrameRef(const FrameRef &other) : slot(other.slot) {
+    if (slot) {
+        slot->refs.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+FrameRef &FrameRef::operator=(FrameRef other) noexcept {
+    std::swap(slot, other.slot);
+    return *this;
+}
+
+void FrameRef::reset() {
+    if (slot && slot->refs.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+        slot->pool->release(slot);
+    }
+    slot = nullptr;
+}
+
+FramePool::FramePool(int capacity, cv::Size size, int type) : size(size), type(type) {
+    size_t rowBytes = (size_t)size.width * CV_ELEM_SIZE(type);
+    step = (rowBytes + FRAME_POOL_ALIGNMENT - 1) / FRAME_POOL_ALIGNMENT * FRAME_POOL_ALIGNMENT;
+
+    for (int i = 0; i < capacity; i++) {
+        std::unique_ptr<FrameSlot> slot(new FrameSlot);
+        slot->pool = this;
+        slot->data = (unsigned char *)aligned_alloc(FRAME_POOL_ALIGNMENT, step * size.height);
+        if (!slot->data) {
+            throw std::runtime_error("Could not allocate the frame pool");
+        }
+        slot->mat = cv::Mat(size, type, slot->data, step);
+        freeSlots.push_back(slot.get());
+        slots.push_back(std::move(slot));
+    }
+}
+
+FramePool::~FramePool() {
+    for (auto &slot : slots) {
+        free(slot->data);
+    }
+}
+
+FrameRef FramePool::take() {
+    FrameSlot *slot = freeSlots.back();
+    freeSlots.pop_back();
+    slot->refs.store(1, std::memory_order_relaxed);
+    peakInUse = std::max(peakInUse, capacity() - (int)freeSlots.size());
+    return FrameRef(slot);
+}
+
+FrameRef FramePool::acquire() {
+    std::unique_lock<std::mutex> guard(lock);
+    if (freeSlots.empty()) {
+        TRACE_SPAN("frame pool wait");
+        waits++;
+        freed.wait(guard, [this] { return !freeSlots.empty(); });
+    }
+    return take();
+}
+
+FrameRef FramePool::tryAcquire() {
+    std::lock_guard<std::mutex> guard(lock);
+    return freeSlots.empty() ? FrameRef() : take();
+}
+
+void FramePool::release(FrameSlot *slot) {
+    // A stage that filled the frame with another size got a buffer of OpenCV's own; go back to ours.
+    if (slot->mat.data != slot->data || slot->mat.size() != size || slot->mat.type() != type) {
+        slot->mat = cv::Mat(size, type, slot->data, step);
+    }
+
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        freeSlots.push_back(slot);
+    }
+    freed.notify_one();
+}
+
+int FramePool::inUse() {
+    std::lock_guard<std::mutex> guard(lock);
+    return capacity() - (int)freeSlots.size();
+}
+
+std::string FramePool::describe() {
+    std::lock_guard<std::mutex> guard(lock);
+    char line[128];
+    snprintf(line, sizeof(line), "frame pool: %d/%d in use, peak %d, %lu waits", capacity() - (int)freeSlots.size(),
+             capacity(), peakInUse, waits);
+    peakInUse = capacity() - (int)freeSlots.size();
+    waits = 0;
+    return line;
+}
@@ -0,0 +1,117 @@
+#ifndef FRAMEPOOL_H
+#define FRAMEPOOL_H
+
+#include <opencv2/core.hpp>
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Rows start on a cache line, so SIMD loads of one row never straddle two.
+#define FRAME_POOL_ALIGNMENT 64
+
+class FramePool;
+
+struct FrameSlot {
+    FramePool *pool;
+    unsigned char *data;
+    cv::Mat mat;               // header over data
+    std::atomic<int> refs{0};
+};
+
+/**
+ * FrameRef - A counted reference to one frame of a FramePool.
+ *
+ * Copies share the frame; when the last copy is destroyed or reset the frame goes back to the pool. Handing a FrameRef
+ * to another thread (a writer, a second stage) keeps the frame alive without copying its pixels.
+ */
+class FrameRef {
+public:
+    FrameRef() = default;
+    FrameRef(const FrameRef &other);
+    FrameRef(FrameRef &&other) noexcept : slot(other.slot) { other.slot = nullptr; }
+    FrameRef &operator=(FrameRef other) noexcept;
+    ~FrameRef() { reset(); }
+
+    void reset();
+    explicit operator bool() const { return slot != nullptr; }
+
+    /**
+     * mat - The frame's pixels. Filling it with something of the pool's size and type (cap >> ref.mat(), copyTo)
+     * writes into the pool buffer; anything else makes OpenCV allocate, which is undone when the frame is returned.
+     */
+    cv::Mat &mat() const { return slot->mat; }
+
+    /**
+     * unique - Whether this is the only reference, so the frame can be written without disturbing another stage.
+     */
+    bool unique() const { return slot && slot->refs.load(std::memory_order_acquire) == 1; }
+
+private:
+    friend class FramePool;
+    explicit FrameRef(FrameSlot *slot) : slot(slot) {}
+
+    FrameSlot *slot = nullptr;
+};
+
+/**
+ * FramePool - A fixed number of frame buffers of one size and type, allocated once and recycled.
+ *
+ * Capture takes a frame with acquire(), stages pass FrameRefs along, and the frame is free again when the last one lets
+ * go. Nothing is allocated after construction. When every frame is in use acquire() waits, which is the pipeline's
+ * back-pressure: occupancy near capacity means a downstream stage cannot keep up.
+ */
+class FramePool {
+public:
+    /**
+     * @param capacity Number of frames.
+     * @param size Frame size.
+     * @param type OpenCV type, e.g. CV_8UC3.
+     */
+    FramePool(int capacity, cv::Size size, int type);
+
+    /**
+     * Every FrameRef must be gone by now.
+     */
+    ~FramePool();
+
+    /**
+     * acquire - A free frame, waiting for one if necessary. Its pixels are whatever the last user left.
+     */
+    FrameRef acquire();
+
+    /**
+     * tryAcquire - A free frame, or an empty FrameRef if none is free.
+     */
+    FrameRef tryAcquire();
+
+    int capacity() const { return (int)slots.size(); }
+    int inUse();
+
+    /**
+     * describe - Occupancy, peak occupancy and waits since the last call, for the stats output.
+     */
+    std::string describe();
+
+private:
+    friend class FrameRef;
+    void release(FrameSlot *slot);
+    FrameRef take();
+
+    cv::Size size;
+    int type;
+    size_t step;
+    std::vector<std::unique_ptr<FrameSlot>> slots;
+
+    std::mutex lock;
+    std::condition_variable freed;
+    std::vector<FrameSlot *> freeSlots;
+    int peakInUse = 0;
+    unsigned long waits = 0;
+};
+
+#endif
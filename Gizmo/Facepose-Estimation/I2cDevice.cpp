@@ -0,0 +1,93 @@
+#include "I2cDevice.h"
+#include <fcntl.h>
+#include <linux/i2c-dev.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+#include <cstring>
+#include <stdexcept>
+
+using namespace std;
+
+LinuxI2cDevice::LinuxI2cDevice(const string &bus, uint8_t address)
+{
+   fd = open(bus.c_str(), O_RDWR | O_CLOEXEC);
+   if (fd < 0)
+   {
+      throw runtime_error("Could not open I2C bus " + bus);
+   }
+
+   if (ioctl(fd, I2C_SLAVE, address) < 0)
+   {
+      close(fd);
+      throw runtime_error("Could not select I2C device " + to_string(address) + " on " + bus);
+   }
+}
+
+LinuxI2cDevice::~LinuxI2cDevice()
+{
+   close(fd);
+}
+
+int LinuxI2cDevice::writeRegisters(uint8_t reg, const uint8_t *data, size_t len)
+{
+   uint8_t buf[33];
+   if (len + 1 > sizeof(buf))
+   {
+      return -1;
+   }
+
+   buf[0] = reg;
+   memcpy(buf + 1, data, len);
+
+   return (write(fd, buf, len + 1) == (ssize_t)(len + 1)) ? 0 : -1;
+}
+
+int LinuxI2cDevice::readRegister(uint8_t reg, uint8_t &value)
+{
+   if (write(fd, &reg, 1) != 1)
+   {
+      return -1;
+   }
+
+   return (read(fd, &value, 1) == 1) ? 0 : -1;
+}
+
+int EmulatedI2cDevice::writeRegisters(uint8_t reg, const uint8_t *data, size_t len)
+{
+   lock_guard<mutex> guard(lock);
+   if (failWrites)
+   {
+      return -1;
+   }
+
+   for (size_t i = 0; i < len; i++)
+   {
+      registers[(uint8_t)(reg + i)] = data[i];
+   }
+   log.push_back({reg, vector<uint8_t>(data, data + len)});
+   if (log.size() > MAX_LOGGED_WRITES)
+   {
+      log.pop_front();
+   }
+
+   return 0;
+}
+
+int EmulatedI2cDevice::readRegister(uint8_t reg, uint8_t &value)
+{
+   lock_guard<mutex> guard(lock);
+   value = registers[reg];
+   return 0;
+}
+
+uint8_t EmulatedI2cDevice::peek(uint8_t reg)
+{
+   lock_guard<mutex> guard(lock);
+   return registers[reg];
+}
+
+vector<EmulatedI2cDevice::Write> EmulatedI2cDevice::writes()
+{
+   lock_guard<mutex> guard(lock);
+   return vector<Write>(log.begin(), log.end());
+}
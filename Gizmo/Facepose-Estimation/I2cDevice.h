@@ -0,0 +1,78 @@
+#ifndef I2CDEVICE_H
+#define I2CDEVICE_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <vector>
+
+/**
+ * Register-level access to a single device on an I2C bus.
+ */
+class I2cDevice
+{
+public:
+   virtual ~I2cDevice() {}
+
+   /**
+    * writeRegisters - Writes len bytes starting at register reg (the device auto-increments).
+    * @return 0 on success, -1 on failure.
+    */
+   virtual int writeRegisters(uint8_t reg, const uint8_t *data, size_t len) = 0;
+
+   /**
+    * readRegister - Reads one register.
+    * @return 0 on success, -1 on failure.
+    */
+   virtual int readRegister(uint8_t reg, uint8_t &value) = 0;
+};
+
+/**
+ * A device behind a Linux i2c-dev node such as /dev/i2c-1.
+ */
+class LinuxI2cDevice : public I2cDevice
+{
+public:
+   LinuxI2cDevice(const std::string &bus, uint8_t address);
+   ~LinuxI2cDevice();
+
+   int writeRegisters(uint8_t reg, const uint8_t *data, size_t len) override;
+   int readRegister(uint8_t reg, uint8_t &value) override;
+
+private:
+   int fd;
+};
+
+/**
+ * In-memory register file standing in for real hardware, for running without a bus and for tests.
+ * The most recent writes are kept so a test can check what would have reached the device.
+ */
+class EmulatedI2cDevice : public I2cDevice
+{
+public:
+   struct Write
+   {
+      uint8_t reg;
+      std::vector<uint8_t> data;
+   };
+
+   int writeRegisters(uint8_t reg, const uint8_t *data, size_t len) override;
+   int readRegister(uint8_t reg, uint8_t &value) override;
+
+   uint8_t peek(uint8_t reg);
+   std::vector<Write> writes();
+
+   static const size_t MAX_LOGGED_WRITES = 4096;
+
+   std::atomic<bool> failWrites{false}; // make every write fail, as a disconnected bus would
+
+private:
+   std::mutex lock;
+   uint8_t registers[256] = {};
+   std::deque<Write> log;
+};
+
+#endif
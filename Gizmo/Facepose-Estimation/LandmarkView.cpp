@@ -0,0 +1,57 @@
+#include "LandmarkView.h"
+#include <opencv2/imgproc.hpp>
+
+#include <algorithm>
+#include <cmath>
+
+void ScaledView(const cv::Mat &image, double imageToFrame, double scale, LandmarkView &view) {
+    if (scale >= 1.0) {
+        view.image = image;
+        view.scale = imageToFrame;
+    } else {
+        cv::Size size(std::max(1L, std::lround(image.cols * scale)), std::max(1L, std::lround(image.rows * scale)));
+        cv::resize(image, view.image, size, 0, 0, cv::INTER_AREA);
+        view.scale = imageToFrame * image.cols / size.width;
+    }
+    view.origin = cv::Point2d(0, 0);
+}
+
+dlib::rectangle CropView(const LandmarkView &parent, const dlib::rectangle &box, int faceWidth, LandmarkView &crop) {
+    double margin = LANDMARK_CROP_MARGIN * std::max(box.width(), box.height());
+    cv::Rect region(cv::Point((int)std::floor(box.left() - margin), (int)std::floor(box.top() - margin)),
+                    cv::Point((int)std::ceil(box.right() + margin) + 1, (int)std::ceil(box.bottom() + margin) + 1));
+    region &= cv::Rect(0, 0, parent.image.cols, parent.image.rows);
+    if (region.empty()) { // the box is off the image; nothing to gain from a crop
+        crop = parent;
+        return box;
+    }
+
+    double shrink = std::min(1.0, (double)faceWidth / box.width());
+    if (shrink < 1.0) {
+        cv::Size size(std::max(1L, std::lround(region.width * shrink)), std::max(1L, std::lround(region.height * shrink)));
+        cv::resize(parent.image(region), crop.image, size, 0, 0, cv::INTER_AREA);
+        shrink = (double)size.width / region.width; // what the rounding of the size made of it
+    } else {
+        crop.image = parent.image(region); // no copy
+    }
+    crop.origin = parent.toFrame(cv::Point2d(region.x, region.y));
+    crop.scale = parent.scale / shrink;
+
+    return dlib::rectangle(std::lround((box.left() - region.x) * shrink), std::lround((box.top() - region.y) * shrink),
+                           std::lround((box.right() - region.x) * shrink), std::lround((box.bottom() - region.y) * shrink));
+}
+
+void MapShape(const LandmarkView &view, dlib::full_object_detection &shape) {
+    if (view.scale == 1.0 && view.origin == cv::Point2d(0, 0)) {
+        return;
+    }
+    for (unsigned long i = 0; i < shape.num_parts(); ++i) {
+        dlib::point &part = shape.part(i);
+        cv::Point2d p = view.toFrame(cv::Point2d(part.x(), part.y()));
+        part = dlib::point(std::lround(p.x), std::lround(p.y));
+    }
+    dlib::rectangle &rect = shape.get_rect();
+    cv::Point2d topLeft = view.toFrame(cv::Point2d(rect.left(), rect.top()));
+    cv::Point2d bottomRight = view.toFrame(cv::Point2d(rect.right(), rect.bottom()));
+    rect = dlib::rectangle(std::lround(topLeft.x), std::lround(topLeft.y), std::lround(bottomRight.x), std::lround(bottomRight.y));
+}
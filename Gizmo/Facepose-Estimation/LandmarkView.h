@@ -0,0 +1,53 @@
+#ifndef LANDMARKVIEW_H
+#define LANDMARKVIEW_H
+
+#include <opencv2/core.hpp>
+#include <dlib/image_processing.h>
+
+// A face crop reaches this fraction of the detection box size beyond each side, so the jaw and brows stay inside.
+#define LANDMARK_CROP_MARGIN 0.25
+
+/**
+ * LandmarkView - An image the landmark predictor runs on, and where its pixels lie in the camera frame:
+ * frame = origin + view * scale.
+ *
+ * The predictor's cost is dominated by scattered pixel reads around the face. On a smaller image (ScaledView) or a
+ * crop normalised to a fixed face width (CropView) those reads stay within a few cache lines, at some cost in
+ * landmark precision that landmark_bench measures.
+ */
+struct LandmarkView {
+    cv::Mat image;
+    cv::Point2d origin;
+    double scale = 1.0;
+
+    cv::Point2d toFrame(const cv::Point2d &p) const { return origin + p * scale; }
+};
+
+/**
+ * ScaledView - The whole image, resized by scale (INTER_AREA). At scale 1 the view shares image's pixels.
+ *
+ * @param image The image to landmark.
+ * @param imageToFrame Camera frame pixels per image pixel (1 unless image is itself a reduced copy).
+ * @param scale Size of the view relative to image, in (0, 1].
+ * @param view Receives the view; its buffer is reused from call to call.
+ */
+void ScaledView(const cv::Mat &image, double imageToFrame, double scale, LandmarkView &view);
+
+/**
+ * CropView - The box plus LANDMARK_CROP_MARGIN on each side, clipped to parent and scaled so that the box is faceWidth
+ * pixels wide. Boxes narrower than faceWidth are cropped but not enlarged.
+ *
+ * @param parent The view the box is in.
+ * @param box The face, in parent pixels.
+ * @param faceWidth Width the box is normalised to.
+ * @param crop Receives the crop.
+ * @return The box in crop pixels.
+ */
+dlib::rectangle CropView(const LandmarkView &parent, const dlib::rectangle &box, int faceWidth, LandmarkView &crop);
+
+/**
+ * MapShape - Moves the parts and box of a shape found on view into camera frame pixels, rounding like dlib does.
+ */
+void MapShape(const LandmarkView &view, dlib::full_object_detection &shape);
+
+#endif
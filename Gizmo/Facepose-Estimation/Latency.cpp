@@ -0,0 +1,55 @@
+#include "Latency.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+
+int LatencyHistogram::bucketOf(uint64_t us) {
+    if (us < LATENCY_EXACT_US) {
+        return (int)us;
+    }
+    int exponent = 63 - __builtin_clzll(us); // at least 4
+    int sub = (int)(us >> (exponent - 3)) & (LATENCY_SUB_BUCKETS - 1);
+    int bucket = LATENCY_EXACT_US + (exponent - 4) * LATENCY_SUB_BUCKETS + sub;
+    return bucket < LATENCY_BUCKETS ? bucket : LATENCY_BUCKETS - 1;
+}
+
+// The largest value that lands in bucket.
+uint64_t LatencyHistogram::bucketTop(int bucket) {
+    if (bucket < LATENCY_EXACT_US) {
+        return bucket;
+    }
+    int exponent = (bucket - LATENCY_EXACT_US) / LATENCY_SUB_BUCKETS + 4;
+    uint64_t sub = (bucket - LATENCY_EXACT_US) % LATENCY_SUB_BUCKETS;
+    return ((uint64_t)(LATENCY_SUB_BUCKETS + sub + 1) << (exponent - 3)) - 1;
+}
+
+std::string LatencyHistogram::describe() {
+    // Each bucket is taken and cleared in one step, so a value recorded meanwhile lands in this window or the next.
+    uint64_t counts[LATENCY_BUCKETS];
+    uint64_t total = 0;
+    for (int i = 0; i < LATENCY_BUCKETS; i++) {
+        counts[i] = buckets[i].exchange(0, std::memory_order_relaxed);
+        total += counts[i];
+    }
+    if (total == 0) {
+        return "";
+    }
+
+    const double points[] = {0.5, 0.9, 0.99, 1.0};
+    double values[4];
+    uint64_t seen = 0;
+    int bucket = 0;
+    for (int p = 0; p < 4; p++) {
+        uint64_t rank = std::max<uint64_t>(1, (uint64_t)std::ceil(points[p] * total));
+        while (seen + counts[bucket] < rank) {
+            seen += counts[bucket++];
+        }
+        values[p] = bucketTop(bucket) / 1000.0;
+    }
+
+    char line[160];
+    snprintf(line, sizeof(line), "%s: %llu | ms p50 %.2f p90 %.2f p99 %.2f max %.2f", name, (unsigned long long)total,
+             values[0], values[1], values[2], values[3]);
+    return line;
+}
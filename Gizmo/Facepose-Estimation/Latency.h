@@ -0,0 +1,61 @@
+#ifndef LATENCY_H
+#define LATENCY_H
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Microsecond values below this are counted exactly; above it each power of two is split into LATENCY_SUB_BUCKETS.
+#define LATENCY_EXACT_US 16
+#define LATENCY_SUB_BUCKETS 8
+#define LATENCY_BUCKETS (LATENCY_EXACT_US + 40 * LATENCY_SUB_BUCKETS) // up to about 2^44 us
+
+/**
+ * LatencyHistogram - A distribution of latencies recorded from any number of threads.
+ *
+ * record() is one relaxed atomic increment, so the sink threads and the vision loop can all feed it without a lock or an
+ * allocation. The buckets are log-linear: values are kept to within 1/LATENCY_SUB_BUCKETS of what was recorded, which
+ * is plenty for percentiles of times that span microseconds to seconds.
+ */
+class LatencyHistogram {
+public:
+    /**
+     * @param name Printed in front of the percentiles, e.g. "capture->decision".
+     */
+    explicit LatencyHistogram(const char *name) : name(name) {}
+
+    /**
+     * record - Adds one latency. Times are CLOCK_MONOTONIC microseconds; a negative latency counts as 0.
+     */
+    void record(uint64_t fromUs, uint64_t toUs) { recordUs(toUs > fromUs ? toUs - fromUs : 0); }
+    void recordUs(uint64_t us) { buckets[bucketOf(us)].fetch_add(1, std::memory_order_relaxed); }
+
+    /**
+     * describe - Count and percentiles of what was recorded since the last call, which starts a new window.
+     * Empty if nothing was.
+     */
+    std::string describe();
+
+private:
+    static int bucketOf(uint64_t us);
+    static uint64_t bucketTop(int bucket);
+
+    const char *name;
+    std::atomic<uint64_t> buckets[LATENCY_BUCKETS] = {};
+};
+
+/**
+ * Percentile - The p-th percentile (0 to 1) of values, exactly, for the tools that keep every sample. Reorders values.
+ */
+inline double Percentile(std::vector<double> &values, double p) {
+    if (values.empty()) {
+        return 0;
+    }
+    size_t index = std::min(values.size() - 1, (size_t)(p * values.size()));
+    std::nth_element(values.begin(), values.begin() + index, values.end());
+    return values[index];
+}
+
+#endif
@@ -0,0 +1,479 @@
+#include "Log.h"
+#include "WireFormat.h"
+
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <condition_variable>
+#include <cstdlib>
+#include <ctime>
+#include <memory>
+#include <mutex>
+#include <sys/syscall.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+// Binary log file: LOG_FILE_MAGIC and a 32-bit version, then entries, each starting with its kind.
+//   site:   'S', id u32, level u8, line u32, file length u16, file, format length u16, format
+//   record: 'R', site u32, thread u32, timestamp us u64, arguments length u16, arguments (see LogArgs)
+// A site is written before the first record that refers to it. All numbers little-endian.
+#define LOG_FILE_MAGIC "GLOG"
+#define LOG_FILE_VERSION 1
+
+// In a ring: total size u32, site u32, thread u32, timestamp us u64, then the arguments.
+#define LOG_RECORD_HEADER 20
+
+static const char *LevelNames[] = {"DEBUG", "INFO", "WARN", "ERROR"};
+
+/**
+ * LogRing - One thread's records, written by the owner and taken by the flusher. Owned by one thread at a time; handed
+ * to a new thread once its owner exits, after the flusher has taken what was left in it.
+ */
+struct LogRing {
+    uint8_t data[LOG_RING_BYTES];
+    std::atomic<uint64_t> head{0}; // bytes written by the owner
+    std::atomic<uint64_t> tail{0}; // bytes taken by the flusher
+    std::atomic<unsigned long> dropped{0};
+    std::atomic<bool> inUse{true};
+};
+
+static std::mutex registryLock;
+static std::vector<std::unique_ptr<LogRing>> rings; // never freed, so the flusher can use them after the lock
+static std::vector<LogSite *> sites;                 // by id - 1
+
+static std::mutex flusherLock;
+static std::condition_variable flusherWake;
+static std::thread flusher;
+static bool running = false;
+static FILE *logFile = nullptr; // nullptr: format to the console
+static size_t sitesWritten = 0;
+static std::vector<uint8_t> batch; // flusher only
+
+/**
+ * LogRingHandle - The calling thread's ring, released for reuse when the thread exits.
+ */
+struct LogRingHandle {
+    LogRing *ring = nullptr;
+    uint32_t tid = 0;
+
+    ~LogRingHandle() {
+        if (ring) {
+            ring->inUse.store(false, std::memory_order_release);
+        }
+    }
+};
+
+static thread_local LogRingHandle currentRing;
+
+static LogRingHandle &ThreadRing() {
+    if (currentRing.ring) {
+        return currentRing;
+    }
+    currentRing.tid = (uint32_t)syscall(SYS_gettid);
+
+    std::lock_guard<std::mutex> guard(registryLock);
+    for (auto &ring : rings) {
+        bool expected = false;
+        if (ring->inUse.compare_exchange_strong(expected, true)) {
+            currentRing.ring = ring.get();
+            return currentRing;
+        }
+    }
+    rings.push_back(std::unique_ptr<LogRing>(new LogRing()));
+    currentRing.ring = rings.back().get();
+    return currentRing;
+}
+
+static uint32_t SiteId(LogSite &site) {
+    uint32_t id = site.id.load(std::memory_order_acquire);
+    if (id) {
+        return id;
+    }
+    std::lock_guard<std::mutex> guard(registryLock);
+    if (!site.id.load(std::memory_order_relaxed)) {
+        sites.push_back(&site);
+        site.id.store((uint32_t)sites.size(), std::memory_order_release);
+    }
+    return site.id.load(std::memory_order_relaxed);
+}
+
+static uint64_t NowMicros() {
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static void CopyIn(LogRing &ring, uint64_t at, const uint8_t *from, size_t size) {
+    size_t offset = at % LOG_RING_BYTES;
+    size_t first = std::min(size, (size_t)LOG_RING_BYTES - offset);
+    memcpy(ring.data + offset, from, first);
+    memcpy(ring.data, from + first, size - first);
+}
+
+static void CopyOut(const LogRing &ring, uint64_t at, uint8_t *to, size_t size) {
+    size_t offset = at % LOG_RING_BYTES;
+    size_t first = std::min(size, (size_t)LOG_RING_BYTES - offset);
+    memcpy(to, ring.data + offset, first);
+    memcpy(to + first, ring.data, size - first);
+}
+
+void logCommit(LogSite &site, const LogArgs &args) {
+    uint32_t id = SiteId(site);
+    LogRingHandle &handle = ThreadRing();
+    LogRing &ring = *handle.ring;
+
+    size_t size = LOG_RECORD_HEADER + args.size;
+    uint64_t head = ring.head.load(std::memory_order_relaxed);
+    if (head + size - ring.tail.load(std::memory_order_acquire) > LOG_RING_BYTES) {
+        ring.dropped.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+
+    uint8_t header[LOG_RECORD_HEADER];
+    putLe(header, size, 4);
+    putLe(header + 4, id, 4);
+    putLe(header + 8, handle.tid, 4);
+    putLe(header + 12, NowMicros(), 8);
+    CopyIn(ring, head, header, sizeof(header));
+    CopyIn(ring, head + sizeof(header), args.data, args.size);
+    ring.head.store(head + size, std::memory_order_release);
+}
+
+static void WriteString(const char *text, FILE *file) {
+    uint8_t length[2];
+    size_t size = std::min(strlen(text), (size_t)UINT16_MAX);
+    putLe(length, size, 2);
+    fwrite(length, 1, 2, file);
+    fwrite(text, 1, size, file);
+}
+
+/**
+ * Drain - Takes every ring's records and writes them out in time order. Only one thread drains at a time.
+ */
+static void Drain() {
+    static LogSite droppedSite = {LOG_LEVEL_WARN, __FILE__, __LINE__, "%lu log records dropped: a thread logged faster than they could be written"};
+
+    std::vector<LogRing *> snapshot;
+    std::vector<LogSite *> knownSites;
+    {
+        std::lock_guard<std::mutex> guard(registryLock);
+        for (auto &ring : rings) {
+            snapshot.push_back(ring.get());
+        }
+    }
+
+    // Copy the records out first, so the rings are free again before anything is formatted or written.
+    batch.clear();
+    std::vector<std::pair<uint64_t, size_t>> order; // timestamp, offset in batch
+    unsigned long dropped = 0;
+    for (LogRing *ring : snapshot) {
+        uint64_t tail = ring->tail.load(std::memory_order_relaxed);
+        uint64_t head = ring->head.load(std::memory_order_acquire);
+        while (tail < head) {
+            uint8_t header[LOG_RECORD_HEADER];
+            CopyOut(*ring, tail, header, sizeof(header));
+            size_t size = (size_t)getLe(header, 4);
+            size_t offset = batch.size();
+            batch.resize(offset + size);
+            CopyOut(*ring, tail, batch.data() + offset, size);
+            order.push_back({getLe(header + 12, 8), offset});
+            tail += size;
+        }
+        ring->tail.store(tail, std::memory_order_release);
+        dropped += ring->dropped.exchange(0, std::memory_order_relaxed);
+    }
+    std::stable_sort(order.begin(), order.end(),
+                     [](const std::pair<uint64_t, size_t> &a, const std::pair<uint64_t, size_t> &b) { return a.first < b.first; });
+
+    {
+        std::lock_guard<std::mutex> guard(registryLock); // after the copy: every site a record refers to is known
+        knownSites = sites;
+    }
+
+    if (logFile) {
+        uint8_t field[8];
+        for (; sitesWritten < knownSites.size(); sitesWritten++) {
+            const LogSite &site = *knownSites[sitesWritten];
+            fputc('S', logFile);
+            putLe(field, sitesWritten + 1, 4);
+            fwrite(field, 1, 4, logFile);
+            fputc(site.level, logFile);
+            putLe(field, site.line, 4);
+            fwrite(field, 1, 4, logFile);
+            WriteString(site.file, logFile);
+            WriteString(site.format, logFile);
+        }
+        for (const auto &entry : order) {
+            const uint8_t *record = batch.data() + entry.second;
+            size_t argsSize = (size_t)getLe(record, 4) - LOG_RECORD_HEADER;
+            fputc('R', logFile);
+            fwrite(record + 4, 1, 16, logFile); // site, thread, timestamp as in the ring
+            putLe(field, argsSize, 2);
+            fwrite(field, 1, 2, logFile);
+            fwrite(record + LOG_RECORD_HEADER, 1, argsSize, logFile);
+        }
+        fflush(logFile);
+
+    } else if (!order.empty()) {
+        for (const auto &entry : order) {
+            const uint8_t *record = batch.data() + entry.second;
+            const LogSite &site = *knownSites[getLe(record + 4, 4) - 1];
+            std::string text = logFormat(site.format, record + LOG_RECORD_HEADER, getLe(record, 4) - LOG_RECORD_HEADER);
+            text += '\n';
+            fputs(text.c_str(), site.level >= LOG_LEVEL_WARN ? stderr : stdout);
+        }
+        fflush(stdout);
+    }
+
+    if (dropped) {
+        logWrite(droppedSite, dropped); // written with the next batch
+    }
+}
+
+static void FlushLoop() {
+    std::unique_lock<std::mutex> guard(flusherLock);
+    while (running) {
+        flusherWake.wait_for(guard, std::chrono::milliseconds(LOG_FLUSH_MS));
+        guard.unlock();
+        Drain();
+        guard.lock();
+    }
+}
+
+bool logStart(const char *path) {
+    static bool stopAtExit = false;
+    if (!stopAtExit) {
+        stopAtExit = true;
+        atexit(logStop);
+    }
+
+    std::lock_guard<std::mutex> guard(flusherLock);
+    if (running) {
+        return true;
+    }
+
+    bool opened = true;
+    if (path) {
+        logFile = fopen(path, "wb");
+        if (logFile) {
+            uint8_t version[4];
+            putLe(version, LOG_FILE_VERSION, 4);
+            fwrite(LOG_FILE_MAGIC, 1, 4, logFile);
+            fwrite(version, 1, 4, logFile);
+            sitesWritten = 0;
+        } else {
+            perror(path);
+            opened = false;
+        }
+    }
+
+    running = true;
+    flusher = std::thread(FlushLoop);
+    return opened;
+}
+
+void logStop() {
+    {
+        std::lock_guard<std::mutex> guard(flusherLock);
+        if (!running) {
+            return;
+        }
+        running = false;
+    }
+    flusherWake.notify_one();
+    flusher.join();
+
+    Drain();
+    Drain(); // and the dropped count the first one may have logged
+    if (logFile) {
+        fclose(logFile);
+        logFile = nullptr;
+    }
+}
+
+std::string logFormat(const char *format, const uint8_t *args, size_t size) {
+    std::string text;
+    char spec[32];
+    char piece[LOG_MAX_ARG_BYTES + 64];
+    size_t at = 0;
+
+    for (const char *c = format; *c; ++c) {
+        if (*c != '%') {
+            text += *c;
+            continue;
+        }
+        if (c[1] == '%') {
+            text += '%';
+            ++c;
+            continue;
+        }
+
+        // %[flags][width][.precision][length]conversion. The length is dropped; the recorded type decides.
+        const char *start = c++;
+        while (*c && strchr("-+ #0", *c)) {
+            c++;
+        }
+        while (isdigit((unsigned char)*c)) {
+            c++;
+        }
+        if (*c == '.') {
+            c++;
+            while (isdigit((unsigned char)*c)) {
+                c++;
+            }
+        }
+        size_t specLength = c - start;
+        while (*c && strchr("hlLqjzt", *c)) {
+            c++;
+        }
+        char conversion = *c;
+        if (!conversion) {
+            break;
+        }
+        if (specLength > sizeof(spec) - 4 || at >= size) {
+            text += "<?>";
+            continue;
+        }
+        memcpy(spec, start, specLength);
+
+        uint8_t type = args[at++];
+        if (type == LOG_ARG_STRING) {
+            if (at + 2 > size) {
+                break;
+            }
+            size_t length = std::min((size_t)getLe(args + at, 2), size - at - 2);
+            std::string value((const char *)args + at + 2, length);
+            at += 2 + length;
+            strcpy(spec + specLength, "s");
+            snprintf(piece, sizeof(piece), spec, value.c_str());
+        } else {
+            if (at + 8 > size) {
+                break;
+            }
+            uint64_t bits = getLe(args + at, 8);
+            at += 8;
+            double real;
+            memcpy(&real, &bits, sizeof(real));
+            if (type != LOG_ARG_DOUBLE) {
+                real = (type == LOG_ARG_INT) ? (double)(int64_t)bits : (double)bits;
+            } else {
+                bits = (uint64_t)(int64_t)real;
+            }
+
+            if (strchr("fFeEgGaA", conversion)) {
+                spec[specLength] = conversion;
+                spec[specLength + 1] = '\0';
+                snprintf(piece, sizeof(piece), spec, real);
+            } else if (conversion == 's') { // a number where a string was expected: print it as one
+                if (type == LOG_ARG_DOUBLE) {
+                    snprintf(piece, sizeof(piece), "%g", real);
+                } else {
+                    snprintf(piece, sizeof(piece), type == LOG_ARG_INT ? "%lld" : "%llu", (long long)bits);
+                }
+            } else if (conversion == 'c') {
+                strcpy(spec + specLength, "c");
+                snprintf(piece, sizeof(piece), spec, (int)bits);
+            } else {
+                spec[specLength] = 'l';
+                spec[specLength + 1] = 'l';
+                spec[specLength + 2] = (conversion == 'p') ? 'x' : conversion;
+                spec[specLength + 3] = '\0';
+                snprintf(piece, sizeof(piece), spec, (long long)bits);
+            }
+        }
+        text += piece;
+    }
+    return text;
+}
+
+static bool ReadExact(FILE *in, uint8_t *to, size_t size) { return fread(to, 1, size, in) == size; }
+
+static bool ReadString(FILE *in, std::string &text) {
+    uint8_t length[2];
+    if (!ReadExact(in, length, 2)) {
+        return false;
+    }
+    text.resize((size_t)getLe(length, 2));
+    return ReadExact(in, (uint8_t *)&text[0], text.size());
+}
+
+struct DecodedSite {
+    int level = LOG_LEVEL_INFO;
+    int line = 0;
+    std::string file;
+    std::string format;
+};
+
+long logDecode(const std::string &path, int minLevel, FILE *out) {
+    FILE *in = fopen(path.c_str(), "rb");
+    if (!in) {
+        perror(path.c_str());
+        return -1;
+    }
+
+    uint8_t header[8];
+    if (!ReadExact(in, header, sizeof(header)) || memcmp(header, LOG_FILE_MAGIC, 4) != 0 ||
+        getLe(header + 4, 4) != LOG_FILE_VERSION) {
+        fprintf(stderr, "%s is not a version %d log file\n", path.c_str(), LOG_FILE_VERSION);
+        fclose(in);
+        return -1;
+    }
+
+    std::vector<DecodedSite> decodedSites;
+    std::vector<uint8_t> args;
+    long printed = 0;
+    int kind;
+    while ((kind = fgetc(in)) != EOF) {
+        uint8_t field[18];
+        if (kind == 'S') {
+            DecodedSite site;
+            if (!ReadExact(in, field, 9) || !ReadString(in, site.file) || !ReadString(in, site.format)) {
+                break;
+            }
+            uint32_t id = (uint32_t)getLe(field, 4);
+            if (id == 0) {
+                fprintf(stderr, "Site with id 0 in %s\n", path.c_str());
+                continue;
+            }
+            site.level = std::min<int>(field[4], LOG_LEVEL_ERROR);
+            site.line = (int)getLe(field + 5, 4);
+            size_t slash = site.file.rfind('/');
+            if (slash != std::string::npos) {
+                site.file.erase(0, slash + 1);
+            }
+            if (decodedSites.size() < id) {
+                decodedSites.resize(id);
+            }
+            decodedSites[id - 1] = site;
+
+        } else if (kind == 'R') {
+            if (!ReadExact(in, field, 18)) {
+                break;
+            }
+            args.resize((size_t)getLe(field + 16, 2));
+            if (!ReadExact(in, args.data(), args.size())) {
+                break;
+            }
+            uint32_t id = (uint32_t)getLe(field, 4);
+            if (id == 0 || id > decodedSites.size()) {
+                fprintf(stderr, "Record refers to unknown site %u\n", id);
+                continue;
+            }
+            const DecodedSite &site = decodedSites[id - 1];
+            if (site.level < minLevel) {
+                continue;
+            }
+            fprintf(out, "%.6f %-5s %6u %s:%d %s\n", getLe(field + 8, 8) / 1e6, LevelNames[site.level],
+                    (uint32_t)getLe(field + 4, 4), site.file.c_str(), site.line,
+                    logFormat(site.format.c_str(), args.data(), args.size()).c_str());
+            printed++;
+
+        } else {
+            fprintf(stderr, "Unknown entry '%c' in %s\n", kind, path.c_str());
+            break;
+        }
+    }
+    fclose(in);
+    return printed;
+}
@@ -0,0 +1,159 @@
+#ifndef LOG_H
+#define LOG_H
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <type_traits>
+
+/**
+ * Asynchronous logging for the threads that must not wait on a console or a file.
+ *
+ * LOG_INFO("PAN: %d TILT: %d", pan, tilt) does no formatting on the calling thread. It copies the arguments, tagged
+ * with their types, into the thread's own ring of LOG_RING_BYTES, which takes no lock. A flusher thread collects the
+ * rings every LOG_FLUSH_MS. It formats the records to stdout (warnings and errors to stderr), or writes them unformatted
+ * to a binary file that log_decode turns into text later. A record that does not fit in a full ring is dropped and
+ * counted, never waited for.
+ *
+ * Levels below LOG_MIN_LEVEL are compiled out: build with -DLOG_MIN_LEVEL=0 to get LOG_DEBUG.
+ * Formats are printf's; integers, floating point numbers and strings may be passed, and %s copies the string.
+ */
+#define LOG_RING_BYTES 65536
+#define LOG_FLUSH_MS 10
+#define LOG_MAX_ARG_BYTES 480 // per record; longer strings are cut short
+
+#define LOG_LEVEL_DEBUG 0
+#define LOG_LEVEL_INFO 1
+#define LOG_LEVEL_WARN 2
+#define LOG_LEVEL_ERROR 3
+
+#ifndef LOG_MIN_LEVEL
+#define LOG_MIN_LEVEL LOG_LEVEL_INFO
+#endif
+
+#define LOG_AT(level, format, ...)                                                                                       \
+    do {                                                                                                                 \
+        if constexpr ((level) >= LOG_MIN_LEVEL) {                                                                        \
+            static LogSite logSite = {(level), __FILE__, __LINE__, (format)};                                            \
+            logWrite(logSite, ##__VA_ARGS__);                                                                            \
+        }                                                                                                                \
+    } while (0)
+#define LOG_DEBUG(format, ...) LOG_AT(LOG_LEVEL_DEBUG, format, ##__VA_ARGS__)
+#define LOG_INFO(format, ...) LOG_AT(LOG_LEVEL_INFO, format, ##__VA_ARGS__)
+#define LOG_WARN(format, ...) LOG_AT(LOG_LEVEL_WARN, format, ##__VA_ARGS__)
+#define LOG_ERROR(format, ...) LOG_AT(LOG_LEVEL_ERROR, format, ##__VA_ARGS__)
+
+/**
+ * LogSite - One LOG_* statement. Its number is handed out on first use; the file records each site once.
+ */
+struct LogSite {
+    int level;
+    const char *file;
+    int line;
+    const char *format;
+    std::atomic<uint32_t> id{0};
+};
+
+// Argument type tags in a record.
+#define LOG_ARG_INT 'i'
+#define LOG_ARG_UINT 'u'
+#define LOG_ARG_DOUBLE 'd'
+#define LOG_ARG_STRING 's'
+
+/**
+ * LogArgs - A record's arguments: a type tag and a little-endian value each; strings as a 16-bit length and the bytes.
+ */
+struct LogArgs {
+    uint8_t data[LOG_MAX_ARG_BYTES];
+    size_t size = 0;
+
+    void putNumber(uint8_t type, uint64_t bits) {
+        if (size + 9 > sizeof(data)) {
+            return;
+        }
+        data[size++] = type;
+        for (int i = 0; i < 8; i++) {
+            data[size++] = (uint8_t)(bits >> (8 * i));
+        }
+    }
+
+    void putString(const char *text, size_t length) {
+        if (size + 3 > sizeof(data)) {
+            return;
+        }
+        length = std::min(length, sizeof(data) - size - 3);
+        data[size++] = LOG_ARG_STRING;
+        data[size++] = (uint8_t)length;
+        data[size++] = (uint8_t)(length >> 8);
+        memcpy(data + size, text, length);
+        size += length;
+    }
+};
+
+template <typename T>
+inline typename std::enable_if<std::is_integral<T>::value>::type logEncode(LogArgs &args, T value) {
+    if (std::is_signed<T>::value) {
+        args.putNumber(LOG_ARG_INT, (uint64_t)(int64_t)value);
+    } else {
+        args.putNumber(LOG_ARG_UINT, (uint64_t)value);
+    }
+}
+
+template <typename T>
+inline typename std::enable_if<std::is_enum<T>::value>::type logEncode(LogArgs &args, T value) {
+    args.putNumber(LOG_ARG_INT, (uint64_t)(int64_t)value);
+}
+
+inline void logEncode(LogArgs &args, double value) {
+    uint64_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    args.putNumber(LOG_ARG_DOUBLE, bits);
+}
+
+inline void logEncode(LogArgs &args, float value) { logEncode(args, (double)value); }
+inline void logEncode(LogArgs &args, const char *text) { text ? args.putString(text, strlen(text)) : args.putString("(null)", 6); }
+inline void logEncode(LogArgs &args, const std::string &text) { args.putString(text.data(), text.size()); }
+
+/**
+ * logCommit - Appends a record to the calling thread's ring, or counts it as dropped if the ring is full.
+ */
+void logCommit(LogSite &site, const LogArgs &args);
+
+template <typename... Args>
+inline void logWrite(LogSite &site, const Args &...values) {
+    LogArgs args;
+    (logEncode(args, values), ...);
+    logCommit(site, args);
+}
+
+/**
+ * logStart - Starts the flusher. Until then records wait in the rings (and are dropped once those are full).
+ *
+ * @param path Binary log file to write, or nullptr to format the records to stdout and stderr.
+ * @return false if the file could not be created; the records then go to the console.
+ */
+bool logStart(const char *path);
+
+/**
+ * logStop - Writes out everything logged so far and stops the flusher. Also run at exit.
+ */
+void logStop();
+
+/**
+ * logFormat - A record's text: format with the arguments substituted as printf would.
+ */
+std::string logFormat(const char *format, const uint8_t *args, size_t size);
+
+/**
+ * logDecode - Prints a binary log file as text, one line per record.
+ *
+ * @param minLevel Records below this level are skipped.
+ * @return Number of records printed, or -1 if path is not a log file. Stops at a truncated record.
+ */
+long logDecode(const std::string &path, int minLevel, FILE *out);
+
+#endif
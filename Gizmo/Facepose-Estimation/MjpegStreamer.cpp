@@ -0,0 +1,128 @@
+#include "MjpegStreamer.h"
+#include "Log.h"
+#include <opencv2/imgcodecs.hpp>
+#include <opencv2/imgproc.hpp>
+
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+static const char *STREAM_PAGE =
+    "<html><head><title>Gizmo</title></head>"
+    "<body style=\"margin:0;background:#000\"><img src=\"/stream\" style=\"width:100%\"></body></html>";
+
+MjpegStreamer::MjpegStreamer(int port, double maxFps, int maxWidth) : maxFps(maxFps), maxWidth(maxWidth) {
+    server.Get("/", [](const httplib::Request &, httplib::Response &res) {
+        res.set_content(STREAM_PAGE, "text/html");
+    });
+
+    server.Get("/stream", [this](const httplib::Request &, httplib::Response &res) {
+        clients++;
+        res.set_content_provider(
+            "multipart/x-mixed-replace; boundary=frame",
+            [this, lastSent = (uint64_t)0](size_t, httplib::DataSink &sink) mutable {
+                std::shared_ptr<const std::vector<uchar>> frame;
+                {
+                    std::unique_lock<std::mutex> guard(jpegLock);
+                    jpegReady.wait_for(guard, std::chrono::seconds(1),
+                                       [&] { return jpegSequence != lastSent || !running; });
+                    if (!running) {
+                        return false;
+                    }
+                    if (jpegSequence == lastSent) {
+                        return sink.is_writable(); // nothing new; keep the connection as long as the client is there
+                    }
+                    frame = jpeg;
+                    lastSent = jpegSequence;
+                }
+
+                char header[96];
+                int headerSize = snprintf(header, sizeof(header),
+                                          "--frame\r\nContent-Type: image/jpeg\r\nContent-Length: %zu\r\n\r\n", frame->size());
+                return sink.write(header, headerSize) &&
+                       sink.write((const char *)frame->data(), frame->size()) &&
+                       sink.write("\r\n", 2);
+            },
+            [this](bool) { clients--; });
+    });
+
+    if (!server.bind_to_port("0.0.0.0", port)) {
+        throw std::runtime_error("Could not start the MJPEG stream on port " + std::to_string(port));
+    }
+
+    serverThread = std::thread([this] { server.listen_after_bind(); });
+    encoderThread = std::thread(&MjpegStreamer::encodeLoop, this);
+}
+
+MjpegStreamer::~MjpegStreamer() {
+    running = false;
+    mailboxReady.notify_all();
+    jpegReady.notify_all();
+    server.stop();
+    serverThread.join();
+    encoderThread.join();
+}
+
+void MjpegStreamer::offer(const cv::Mat &frame) {
+    if (clients.load(std::memory_order_relaxed) == 0) {
+        return;
+    }
+
+    auto now = std::chrono::steady_clock::now();
+    if (now - lastAccepted < std::chrono::duration<double>(1.0 / maxFps)) {
+        return;
+    }
+
+    std::unique_lock<std::mutex> guard(mailboxLock, std::try_to_lock);
+    if (!guard.owns_lock() || mailboxFull) { // the encoder is still behind: drop this one
+        framesDropped++;
+        return;
+    }
+
+    frame.copyTo(mailbox); // reuses the mailbox's buffer once it has the right size
+    mailboxFull = true;
+    lastAccepted = now;
+    guard.unlock();
+    mailboxReady.notify_one();
+}
+
+void MjpegStreamer::encodeLoop() {
+    // Lowest priority: the stream is only for humans and must not take CPU from the vision loop.
+    setpriority(PRIO_PROCESS, syscall(SYS_gettid), 19);
+
+    cv::Mat frame, scaled;
+    std::vector<int> params = {cv::IMWRITE_JPEG_QUALITY, MJPEG_JPEG_QUALITY};
+
+    while (running) {
+        {
+            std::unique_lock<std::mutex> guard(mailboxLock);
+            mailboxReady.wait(guard, [this] { return mailboxFull || !running; });
+            if (!running) {
+                return;
+            }
+            cv::swap(frame, mailbox); // both buffers are kept, so steady state does not allocate
+            mailboxFull = false;
+        }
+
+        const cv::Mat *source = &frame;
+        if (frame.cols > maxWidth) {
+            double scale = (double)maxWidth / frame.cols;
+            cv::resize(frame, scaled, cv::Size(), scale, scale, cv::INTER_AREA);
+            source = &scaled;
+        }
+
+        auto encoded = std::make_shared<std::vector<uchar>>();
+        if (!cv::imencode(".jpg", *source, *encoded, params)) {
+            LOG_ERROR("MJPEG encode failed");
+            continue;
+        }
+        framesEncoded++;
+
+        {
+            std::lock_guard<std::mutex> guard(jpegLock);
+            jpeg = encoded;
+            jpegSequence++;
+        }
+        jpegReady.notify_all();
+    }
+}
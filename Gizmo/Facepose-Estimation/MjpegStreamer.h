@@ -0,0 +1,71 @@
+#ifndef MJPEGSTREAMER_H
+#define MJPEGSTREAMER_H
+
+#include <opencv2/core.hpp>
+#include "httplib.h"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#define MJPEG_DEFAULT_FPS 5
+#define MJPEG_DEFAULT_WIDTH 640
+#define MJPEG_JPEG_QUALITY 70
+
+/**
+ * MjpegStreamer - Serves annotated frames as a multipart MJPEG stream (http://<gizmo>:<port>/stream).
+ *
+ * The vision loop hands frames to offer(). With nobody watching that is a single atomic load. Otherwise at most
+ * maxFps frames per second are copied into a one-frame mailbox; a frame arriving while the previous one is still
+ * waiting to be encoded is dropped, never queued. A low-priority thread scales and JPEG-encodes the mailbox frame
+ * and every connected client is sent the newest JPEG.
+ */
+class MjpegStreamer {
+public:
+    MjpegStreamer(int port, double maxFps = MJPEG_DEFAULT_FPS, int maxWidth = MJPEG_DEFAULT_WIDTH);
+    ~MjpegStreamer();
+
+    /**
+     * offer - Proposes a frame for the stream. Cheap enough to call every frame.
+     *
+     * @param frame The annotated BGR frame. Copied only if it is going to be encoded.
+     */
+    void offer(const cv::Mat &frame);
+
+    int clientCount() const { return clients.load(std::memory_order_relaxed); }
+
+    unsigned long framesEncoded = 0;
+    std::atomic<unsigned long> framesDropped{0};
+
+private:
+    void encodeLoop();
+
+    httplib::Server server;
+    double maxFps;
+    int maxWidth;
+
+    std::atomic<int> clients{0};
+    std::atomic<bool> running{true};
+    std::chrono::steady_clock::time_point lastAccepted;
+
+    // Mailbox between the vision loop and the encoder.
+    std::mutex mailboxLock;
+    std::condition_variable mailboxReady;
+    cv::Mat mailbox;
+    bool mailboxFull = false;
+
+    // Newest encoded frame, shared by all clients.
+    std::mutex jpegLock;
+    std::condition_variable jpegReady;
+    std::shared_ptr<const std::vector<uchar>> jpeg;
+    uint64_t jpegSequence = 0;
+
+    std::thread serverThread;
+    std::thread encoderThread;
+};
+
+#endif
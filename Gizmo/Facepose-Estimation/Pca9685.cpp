@@ -0,0 +1,151 @@
+#include "Pca9685.h"
+#include "Log.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+
+using namespace std;
+
+#define PCA9685_MODE1 0x00
+#define PCA9685_LED0_ON_L 0x06
+#define PCA9685_PRESCALE 0xFE
+
+#define MODE1_RESTART 0x80
+#define MODE1_AUTO_INCREMENT 0x20
+#define MODE1_SLEEP 0x10
+
+Pca9685::Pca9685(I2cDevice &device) : device(device)
+{
+}
+
+int Pca9685::begin()
+{
+   // Datasheet 7.3.5: prescale = round(osc / (4096 * rate)) - 1, only writable while asleep.
+   uint8_t prescale = (uint8_t)(lround((double)PCA9685_OSCILLATOR_HZ / (4096.0 * PCA9685_SERVO_HZ)) - 1);
+   uint8_t sleep = MODE1_SLEEP;
+   uint8_t awake = MODE1_AUTO_INCREMENT;
+   uint8_t restart = MODE1_RESTART | MODE1_AUTO_INCREMENT;
+
+   if (device.writeRegisters(PCA9685_MODE1, &sleep, 1) < 0 ||
+       device.writeRegisters(PCA9685_PRESCALE, &prescale, 1) < 0 ||
+       device.writeRegisters(PCA9685_MODE1, &awake, 1) < 0)
+   {
+      return -1;
+   }
+
+   this_thread::sleep_for(chrono::milliseconds(5)); // oscillator start-up
+   return device.writeRegisters(PCA9685_MODE1, &restart, 1);
+}
+
+uint16_t Pca9685::angleToCounts(double angle)
+{
+   angle = clamp(angle, 0.0, (double)SERVO_ACTUATION_RANGE);
+   double pulseUs = SERVO_MIN_PULSE_US + (SERVO_MAX_PULSE_US - SERVO_MIN_PULSE_US) * angle / SERVO_ACTUATION_RANGE;
+   return (uint16_t)lround(pulseUs * PCA9685_SERVO_HZ * 4096.0 / 1000000.0);
+}
+
+double Pca9685::countsToAngle(uint16_t counts)
+{
+   double pulseUs = counts * 1000000.0 / (PCA9685_SERVO_HZ * 4096.0);
+   return (pulseUs - SERVO_MIN_PULSE_US) * SERVO_ACTUATION_RANGE / (SERVO_MAX_PULSE_US - SERVO_MIN_PULSE_US);
+}
+
+int Pca9685::setAngle(int channel, double angle)
+{
+   uint16_t off = angleToCounts(angle);
+
+   // ON at count 0, OFF at the pulse width; auto-increment lets all four registers go in one transfer.
+   uint8_t regs[4] = {0, 0, (uint8_t)(off & 0xFF), (uint8_t)(off >> 8)};
+   return device.writeRegisters(PCA9685_LED0_ON_L + 4 * channel, regs, sizeof(regs));
+}
+
+ServoController::ServoController(I2cDevice &device, int startPan, int startTilt, int panChannel, int tiltChannel)
+    : pca(device), panChannel(panChannel), tiltChannel(tiltChannel),
+      goalPan(startPan), goalTilt(startTilt), currentPan(startPan), currentTilt(startTilt)
+{
+   if (pca.begin() < 0)
+   {
+      LOG_ERROR("PCA9685 initialisation failed");
+   }
+   pca.setAngle(panChannel, startPan);
+   pca.setAngle(tiltChannel, startTilt);
+
+   worker = thread(&ServoController::run, this);
+}
+
+ServoController::~ServoController()
+{
+   {
+      lock_guard<mutex> guard(lock);
+      stopping = true;
+   }
+   wake.notify_one();
+   worker.join();
+}
+
+void ServoController::setGoals(int pan, int tilt)
+{
+   {
+      lock_guard<mutex> guard(lock);
+      goalPan = clamp(pan, 0, SERVO_ACTUATION_RANGE);
+      goalTilt = clamp(tilt, 0, SERVO_ACTUATION_RANGE);
+   }
+   wake.notify_one();
+}
+
+void ServoController::position(double &pan, double &tilt)
+{
+   lock_guard<mutex> guard(lock);
+   pan = currentPan;
+   tilt = currentTilt;
+}
+
+static double step(double current, int goal)
+{
+   if (fabs(goal - current) < ServoController::SNAP_ANGLE)
+   {
+      return goal;
+   }
+   return (goal - current) * ServoController::SPEED + current;
+}
+
+void ServoController::run()
+{
+   auto nextTick = chrono::steady_clock::now();
+   // A bus that is gone fails every tick; say so once a second rather than 50 times.
+   auto nextErrorReport = nextTick;
+   unsigned long failedTicks = 0;
+
+   unique_lock<mutex> guard(lock);
+   while (!stopping)
+   {
+      if (currentPan == goalPan && currentTilt == goalTilt)
+      {
+         wake.wait(guard); // idle until a new goal arrives, no spinning
+         nextTick = chrono::steady_clock::now();
+         continue;
+      }
+
+      currentPan = step(currentPan, goalPan);
+      currentTilt = step(currentTilt, goalTilt);
+      double pan = currentPan;
+      double tilt = currentTilt;
+
+      guard.unlock();
+      if (pca.setAngle(panChannel, pan) < 0 || pca.setAngle(tiltChannel, tilt) < 0)
+      {
+         failedTicks++;
+         auto now = chrono::steady_clock::now();
+         if (now >= nextErrorReport)
+         {
+            LOG_ERROR("SERVO WRITE ERROR (%lu failed ticks since the last report)", failedTicks);
+            failedTicks = 0;
+            nextErrorReport = now + chrono::seconds(1);
+         }
+      }
+      guard.lock();
+
+      nextTick += chrono::milliseconds(TICK_MS);
+      wake.wait_until(guard, nextTick, [this] { return stopping; });
+   }
+}
@@ -0,0 +1,87 @@
+#ifndef PCA9685_H
+#define PCA9685_H
+
+#include "I2cDevice.h"
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+#define PCA9685_ADDRESS 0x40
+#define PCA9685_OSCILLATOR_HZ 25000000
+#define PCA9685_SERVO_HZ 50
+
+// Same pulse range and travel as adafruit_servokit's defaults, so angles mean the same thing as in ServoServer.py.
+#define SERVO_MIN_PULSE_US 750
+#define SERVO_MAX_PULSE_US 2250
+#define SERVO_ACTUATION_RANGE 180
+
+/**
+ * Minimal PCA9685 PWM driver: 50 Hz output and per-channel servo angles.
+ */
+class Pca9685
+{
+public:
+   Pca9685(I2cDevice &device);
+
+   /**
+    * begin - Resets the chip and programs the 50 Hz prescaler.
+    * @return 0 on success, -1 if the bus rejected a write.
+    */
+   int begin();
+
+   /**
+    * setAngle - Points the servo on channel at angle degrees (0 to SERVO_ACTUATION_RANGE).
+    * @return 0 on success, -1 if the bus rejected the write.
+    */
+   int setAngle(int channel, double angle);
+
+   static uint16_t angleToCounts(double angle);
+   static double countsToAngle(uint16_t counts);
+
+private:
+   I2cDevice &device;
+};
+
+/**
+ * Drives the pan and tilt servos from its own thread.
+ *
+ * Uses ServoServer.py's ServoHandler motion: every tick the servo moves SPEED of the remaining distance and snaps
+ * once it is within SNAP_ANGLE. The thread sleeps on a condition variable while the servos are at their goals.
+ */
+class ServoController
+{
+public:
+   ServoController(I2cDevice &device, int startPan, int startTilt, int panChannel = 0, int tiltChannel = 1);
+   ~ServoController();
+
+   void setGoals(int pan, int tilt);
+
+   /**
+    * position - The angles most recently written to the servos.
+    */
+   void position(double &pan, double &tilt);
+
+   static constexpr double SNAP_ANGLE = 2;
+   static constexpr double SPEED = 3.0 / 4.0;
+   static constexpr int TICK_MS = 20; // one PWM period at 50 Hz; writing faster than that has no effect
+
+private:
+   void run();
+
+   Pca9685 pca;
+   int panChannel;
+   int tiltChannel;
+
+   std::mutex lock;
+   std::condition_variable wake;
+   bool stopping = false;
+   int goalPan;
+   int goalTilt;
+   double currentPan;
+   double currentTilt;
+
+   std::thread worker;
+};
+
+#endif
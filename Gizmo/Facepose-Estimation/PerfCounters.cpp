@@ -0,0 +1,176 @@
+#include "PerfCounters.h"
+
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <mutex>
+
+std::atomic<bool> perfEnabled{false};
+
+static const char *StageNames[PERF_STAGE_COUNT] = {"capture", "detect", "landmark", "pose"};
+static const char *CounterNames[PERF_COUNTER_COUNT] = {"cycles", "instructions", "cache-references", "cache-misses",
+                                                       "branches", "branch-misses"};
+static const uint64_t CounterConfigs[PERF_COUNTER_COUNT] = {
+    PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS, PERF_COUNT_HW_CACHE_REFERENCES,
+    PERF_COUNT_HW_CACHE_MISSES, PERF_COUNT_HW_BRANCH_INSTRUCTIONS, PERF_COUNT_HW_BRANCH_MISSES};
+
+/**
+ * StageTotals - What all threads measured in one stage since the last report.
+ */
+struct StageTotals {
+    uint64_t calls = 0;
+    uint64_t ns = 0;
+    uint64_t counts[PERF_COUNTER_COUNT] = {};
+};
+
+static std::mutex totalsLock;
+static StageTotals totals[PERF_STAGE_COUNT];
+static bool counterSeen[PERF_COUNTER_COUNT]; // opened on at least one thread
+
+/**
+ * ThreadCounters - The calling thread's counter fds, opened on first use and closed when the thread exits.
+ */
+struct ThreadCounters {
+    int fds[PERF_COUNTER_COUNT];
+    int errors[PERF_COUNTER_COUNT]; // errno of counters that did not open
+    bool opened = false;
+
+    void open() {
+        opened = true;
+        for (int i = 0; i < PERF_COUNTER_COUNT; i++) {
+            perf_event_attr attr;
+            memset(&attr, 0, sizeof(attr));
+            attr.size = sizeof(attr);
+            attr.type = PERF_TYPE_HARDWARE;
+            attr.config = CounterConfigs[i];
+            attr.exclude_kernel = 1;
+            attr.exclude_hv = 1;
+            attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+            // pid 0, cpu -1: this thread, on whichever CPU it runs.
+            fds[i] = (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, PERF_FLAG_FD_CLOEXEC);
+            errors[i] = (fds[i] < 0) ? errno : 0;
+            if (fds[i] >= 0) {
+                std::lock_guard<std::mutex> guard(totalsLock);
+                counterSeen[i] = true;
+            }
+        }
+    }
+
+    ~ThreadCounters() {
+        for (int i = 0; opened && i < PERF_COUNTER_COUNT; i++) {
+            if (fds[i] >= 0) {
+                close(fds[i]);
+            }
+        }
+    }
+
+    /**
+     * read - Current value of every counter, scaled up if the PMU was shared. 0 for counters that did not open.
+     */
+    void read(uint64_t values[PERF_COUNTER_COUNT]) {
+        if (!opened) {
+            open();
+        }
+        for (int i = 0; i < PERF_COUNTER_COUNT; i++) {
+            uint64_t data[3]; // value, time enabled, time running
+            if (fds[i] < 0 || ::read(fds[i], data, sizeof(data)) != sizeof(data)) {
+                values[i] = 0;
+                continue;
+            }
+            values[i] = (data[2] > 0 && data[2] < data[1]) ? (uint64_t)((double)data[0] * data[1] / data[2]) : data[0];
+        }
+    }
+};
+
+static thread_local ThreadCounters threadCounters;
+
+static uint64_t NowNs() {
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+int perfStart() {
+    perfEnabled = true;
+
+    uint64_t values[PERF_COUNTER_COUNT];
+    threadCounters.read(values); // opens this thread's counters, to find out what is there
+
+    int available = 0;
+    for (int i = 0; i < PERF_COUNTER_COUNT; i++) {
+        if (threadCounters.fds[i] >= 0) {
+            available++;
+        } else {
+            fprintf(stderr, "perf: no %s counter (%s)\n", CounterNames[i], strerror(threadCounters.errors[i]));
+        }
+    }
+    if (available == 0) {
+        fprintf(stderr, "perf: no hardware counters (check /proc/sys/kernel/perf_event_paranoid); reporting latency only\n");
+    }
+    return available;
+}
+
+PerfScope::PerfScope(PerfStage stage) : stage(stage), active(perfEnabled.load(std::memory_order_relaxed)) {
+    if (active) {
+        threadCounters.read(begin);
+        beginNs = NowNs();
+    }
+}
+
+PerfScope::~PerfScope() {
+    if (!active) {
+        return;
+    }
+
+    uint64_t endNs = NowNs();
+    uint64_t end[PERF_COUNTER_COUNT];
+    threadCounters.read(end);
+
+    std::lock_guard<std::mutex> guard(totalsLock);
+    StageTotals &stageTotals = totals[stage];
+    stageTotals.calls++;
+    stageTotals.ns += endNs - beginNs;
+    for (int i = 0; i < PERF_COUNTER_COUNT; i++) {
+        stageTotals.counts[i] += (end[i] > begin[i]) ? end[i] - begin[i] : 0;
+    }
+}
+
+/**
+ * Ratio - a / b as text, or "n/a" if either counter is missing.
+ */
+static std::string Ratio(const StageTotals &stageTotals, PerfCounter a, PerfCounter b, double scale, const char *format) {
+    if (!counterSeen[a] || !counterSeen[b] || stageTotals.counts[b] == 0) {
+        return "n/a";
+    }
+    char text[32];
+    snprintf(text, sizeof(text), format, scale * stageTotals.counts[a] / stageTotals.counts[b]);
+    return text;
+}
+
+std::string perfReport() {
+    std::lock_guard<std::mutex> guard(totalsLock);
+
+    std::string report = "stage        calls   mean us      IPC  cache miss%  branch miss%  cache miss/kinstr\n";
+    char line[160];
+    for (int s = 0; s < PERF_STAGE_COUNT; s++) {
+        StageTotals &stageTotals = totals[s];
+        if (stageTotals.calls == 0) {
+            continue;
+        }
+        snprintf(line, sizeof(line), "%-10s %7lu %9.1f %8s %12s %13s %18s\n", StageNames[s], (unsigned long)stageTotals.calls,
+                 stageTotals.ns / 1000.0 / stageTotals.calls,
+                 Ratio(stageTotals, PERF_INSTRUCTIONS, PERF_CYCLES, 1, "%.2f").c_str(),
+                 Ratio(stageTotals, PERF_CACHE_MISSES, PERF_CACHE_REFERENCES, 100, "%.1f").c_str(),
+                 Ratio(stageTotals, PERF_BRANCH_MISSES, PERF_BRANCHES, 100, "%.2f").c_str(),
+                 Ratio(stageTotals, PERF_CACHE_MISSES, PERF_INSTRUCTIONS, 1000, "%.2f").c_str());
+        report += line;
+        stageTotals = StageTotals();
+    }
+    return report;
+}
@@ -0,0 +1,69 @@
+#ifndef PERFCOUNTERS_H
+#define PERFCOUNTERS_H
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+/**
+ * Hardware performance counters per pipeline stage.
+ *
+ * Every thread that enters a PERF_STAGE opens its own perf_event_open counters (user space only, this thread only)
+ * the first time. A stage reads them on entry and exit and adds the difference, and its wall time, to that stage's
+ * totals. perfReport() turns the totals into IPC, cache and branch miss rates next to the latency.
+ *
+ * Counters the kernel or CPU will not give us (perf_event_paranoid, containers, no PMU in a VM) are left out of the
+ * report; if none open, only latency is reported. Counters the PMU has to time-share are scaled by the kernel's
+ * enabled/running times.
+ */
+enum PerfStage {
+    PERF_CAPTURE,
+    PERF_DETECT,
+    PERF_LANDMARK,
+    PERF_POSE,
+    PERF_STAGE_COUNT
+};
+
+enum PerfCounter {
+    PERF_CYCLES,
+    PERF_INSTRUCTIONS,
+    PERF_CACHE_REFERENCES,
+    PERF_CACHE_MISSES,
+    PERF_BRANCHES,
+    PERF_BRANCH_MISSES,
+    PERF_COUNTER_COUNT
+};
+
+#define PERF_CONCAT_INNER(a, b) a##b
+#define PERF_CONCAT(a, b) PERF_CONCAT_INNER(a, b)
+#define PERF_STAGE(stage) PerfScope PERF_CONCAT(perfScope, __LINE__)(stage)
+
+extern std::atomic<bool> perfEnabled;
+
+/**
+ * perfStart - Turns the counters on and says which ones this machine has.
+ * @return The number of counters that could be opened (0 means latency only).
+ */
+int perfStart();
+
+/**
+ * perfReport - One line per stage with what was measured since the last report, then starts over.
+ */
+std::string perfReport();
+
+class PerfScope {
+public:
+    PerfScope(PerfStage stage);
+    ~PerfScope();
+
+    PerfScope(const PerfScope &) = delete;
+    PerfScope &operator=(const PerfScope &) = delete;
+
+private:
+    PerfStage stage;
+    bool active;
+    uint64_t beginNs;
+    uint64_t begin[PERF_COUNTER_COUNT];
+};
+
+#endif
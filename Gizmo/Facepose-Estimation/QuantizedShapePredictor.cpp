@@ -0,0 +1,262 @@
+#include "QuantizedShapePredictor.h"
+
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+
+#define QSP_MAGIC 0x31505351 // "QSP1"
+
+uint16_t FloatToHalf(float f) {
+    uint32_t bits;
+    memcpy(&bits, &f, sizeof(bits));
+
+    uint16_t sign = (bits >> 16) & 0x8000;
+    int32_t exponent = (int32_t)((bits >> 23) & 0xFF) - 127 + 15;
+    uint32_t mantissa = bits & 0x7FFFFF;
+
+    if (exponent >= 0x1F) {
+        return sign | 0x7C00; // too large for half: infinity
+    }
+    if (exponent <= 0) {
+        if (exponent < -10) {
+            return sign; // underflows to zero
+        }
+        mantissa |= 0x800000;
+        uint32_t shift = 14 - exponent;
+        uint32_t half = mantissa >> shift;
+        uint32_t rest = mantissa & ((1u << shift) - 1);
+        uint32_t halfway = 1u << (shift - 1);
+        if (rest > halfway || (rest == halfway && (half & 1))) {
+            half++;
+        }
+        return sign | half;
+    }
+
+    uint16_t half = sign | (exponent << 10) | (mantissa >> 13);
+    uint32_t rest = mantissa & 0x1FFF;
+    if (rest > 0x1000 || (rest == 0x1000 && (half & 1))) {
+        half++; // round to nearest even; a carry into the exponent is still correct
+    }
+    return half;
+}
+
+/**
+ * FloatModel - The parameters of a serialized dlib::shape_predictor, read without going through the class,
+ * whose members are private. Mirrors shape_predictor's serialize().
+ */
+struct FloatModel {
+    dlib::matrix<float, 0, 1> initial_shape;
+    std::vector<std::vector<dlib::impl::regression_tree>> forests;
+    std::vector<std::vector<unsigned long>> anchor_idx;
+    std::vector<std::vector<dlib::vector<float, 2>>> deltas;
+};
+
+static FloatModel ReadFloatModel(const std::string &path) {
+    std::ifstream in(path, std::ios::binary);
+    if (!in) {
+        throw std::runtime_error("Could not open " + path);
+    }
+
+    FloatModel model;
+    int version = 0;
+    dlib::deserialize(version, in);
+    if (version != 1) {
+        throw std::runtime_error(path + " is not a version 1 dlib shape_predictor");
+    }
+    dlib::deserialize(model.initial_shape, in);
+    dlib::deserialize(model.forests, in);
+    dlib::deserialize(model.anchor_idx, in);
+    dlib::deserialize(model.deltas, in);
+    return model;
+}
+
+size_t QuantizedShapePredictor::floatModelBytes(const std::string &floatModelPath) {
+    FloatModel model = ReadFloatModel(floatModelPath);
+
+    size_t bytes = model.initial_shape.size() * sizeof(float);
+    for (size_t level = 0; level < model.forests.size(); ++level) {
+        bytes += model.anchor_idx[level].size() * sizeof(unsigned long);
+        bytes += model.deltas[level].size() * sizeof(dlib::vector<float, 2>);
+        for (const auto &tree : model.forests[level]) {
+            bytes += tree.splits.size() * sizeof(dlib::impl::split_feature);
+            for (const auto &leaf : tree.leaf_values) {
+                bytes += leaf.size() * sizeof(float);
+            }
+        }
+    }
+    return bytes;
+}
+
+QuantizedShapePredictor QuantizedShapePredictor::quantize(const std::string &floatModelPath, Precision precision) {
+    FloatModel model = ReadFloatModel(floatModelPath);
+    if (model.forests.empty() || model.forests[0].empty()) {
+        throw std::runtime_error(floatModelPath + " has no trees");
+    }
+
+    QuantizedShapePredictor q;
+    q.precision = precision;
+    q.levels = model.forests.size();
+    q.treesPerLevel = model.forests[0].size();
+    q.splitsPerTree = model.forests[0][0].splits.size();
+    q.leavesPerTree = model.forests[0][0].leaf_values.size();
+    q.shapeSize = model.initial_shape.size();
+    q.initial_shape = model.initial_shape;
+    q.anchor_idx = model.anchor_idx;
+    q.deltas = model.deltas;
+
+    size_t trees = (size_t)q.levels * q.treesPerLevel;
+    q.splits.reserve(trees * q.splitsPerTree);
+    if (precision == INT8) {
+        q.leaves8.reserve(trees * q.leavesPerTree * q.shapeSize);
+    } else {
+        q.leaves16.reserve(trees * q.leavesPerTree * q.shapeSize);
+    }
+
+    for (uint32_t level = 0; level < q.levels; ++level) {
+        const auto &forest = model.forests[level];
+        if (forest.size() != q.treesPerLevel) {
+            throw std::runtime_error("Cascade levels have different numbers of trees");
+        }
+
+        // One scale per cascade level: early levels make big corrections, late levels small ones.
+        float maxAbs = 0;
+        for (const auto &tree : forest) {
+            for (const auto &leaf : tree.leaf_values) {
+                maxAbs = std::max(maxAbs, (float)dlib::max(dlib::abs(leaf)));
+            }
+        }
+        float scale = (maxAbs > 0) ? maxAbs / 127.0f : 1.0f;
+        q.scales.push_back(scale);
+
+        for (const auto &tree : forest) {
+            if (tree.splits.size() != q.splitsPerTree || tree.leaf_values.size() != q.leavesPerTree) {
+                throw std::runtime_error("Trees of different depths are not supported");
+            }
+
+            for (const auto &split : tree.splits) {
+                if (split.idx1 > UINT16_MAX || split.idx2 > UINT16_MAX) {
+                    throw std::runtime_error("Too many feature pixels to pack split indices into 16 bits");
+                }
+                q.splits.push_back({(uint16_t)split.idx1, (uint16_t)split.idx2, split.thresh});
+            }
+
+            for (const auto &leaf : tree.leaf_values) {
+                for (long j = 0; j < leaf.size(); ++j) {
+                    if (precision == INT8) {
+                        q.leaves8.push_back((int8_t)std::lround(leaf(j) / scale));
+                    } else {
+                        q.leaves16.push_back(FloatToHalf(leaf(j)));
+                    }
+                }
+            }
+        }
+    }
+
+    return q;
+}
+
+size_t QuantizedShapePredictor::memoryBytes() const {
+    size_t bytes = initial_shape.size() * sizeof(float);
+    for (uint32_t level = 0; level < levels; ++level) {
+        bytes += anchor_idx[level].size() * sizeof(unsigned long);
+        bytes += deltas[level].size() * sizeof(dlib::vector<float, 2>);
+    }
+    bytes += scales.size() * sizeof(float);
+    bytes += splits.size() * sizeof(PackedSplit);
+    bytes += leaves8.size() * sizeof(int8_t);
+    bytes += leaves16.size() * sizeof(uint16_t);
+    return bytes;
+}
+
+template <typename T>
+static void WriteArray(std::ostream &out, const std::vector<T> &values) {
+    uint64_t count = values.size();
+    out.write((const char *)&count, sizeof(count));
+    out.write((const char *)values.data(), count * sizeof(T));
+}
+
+template <typename T>
+static void ReadArray(std::istream &in, std::vector<T> &values) {
+    uint64_t count = 0;
+    in.read((char *)&count, sizeof(count));
+    values.resize(count);
+    in.read((char *)values.data(), count * sizeof(T));
+}
+
+// Native byte order: the file is produced and consumed on the same (little endian) machines.
+void QuantizedShapePredictor::save(const std::string &path) const {
+    std::ofstream out(path, std::ios::binary);
+    if (!out) {
+        throw std::runtime_error("Could not write " + path);
+    }
+
+    uint32_t header[7] = {QSP_MAGIC, precision, levels, treesPerLevel, splitsPerTree, leavesPerTree, shapeSize};
+    out.write((const char *)header, sizeof(header));
+
+    WriteArray(out, std::vector<float>(initial_shape.begin(), initial_shape.end()));
+    for (uint32_t level = 0; level < levels; ++level) {
+        std::vector<uint32_t> anchors(anchor_idx[level].begin(), anchor_idx[level].end());
+        std::vector<float> offsets;
+        for (const auto &delta : deltas[level]) {
+            offsets.push_back(delta.x());
+            offsets.push_back(delta.y());
+        }
+        WriteArray(out, anchors);
+        WriteArray(out, offsets);
+    }
+    WriteArray(out, scales);
+    WriteArray(out, splits);
+    WriteArray(out, leaves8);
+    WriteArray(out, leaves16);
+
+    if (!out) {
+        throw std::runtime_error("Failed writing " + path);
+    }
+}
+
+void QuantizedShapePredictor::load(const std::string &path) {
+    std::ifstream in(path, std::ios::binary);
+    uint32_t header[7] = {};
+    in.read((char *)header, sizeof(header));
+    if (!in || header[0] != QSP_MAGIC) {
+        throw std::runtime_error(path + " is not a quantized shape predictor");
+    }
+
+    precision = (Precision)header[1];
+    levels = header[2];
+    treesPerLevel = header[3];
+    splitsPerTree = header[4];
+    leavesPerTree = header[5];
+    shapeSize = header[6];
+
+    std::vector<float> shape;
+    ReadArray(in, shape);
+    initial_shape.set_size(shape.size());
+    for (size_t i = 0; i < shape.size(); ++i) {
+        initial_shape(i) = shape[i];
+    }
+
+    anchor_idx.assign(levels, {});
+    deltas.assign(levels, {});
+    for (uint32_t level = 0; level < levels; ++level) {
+        std::vector<uint32_t> anchors;
+        std::vector<float> offsets;
+        ReadArray(in, anchors);
+        ReadArray(in, offsets);
+        anchor_idx[level].assign(anchors.begin(), anchors.end());
+        for (size_t i = 0; i + 1 < offsets.size(); i += 2) {
+            deltas[level].push_back(dlib::vector<float, 2>(offsets[i], offsets[i + 1]));
+        }
+    }
+    ReadArray(in, scales);
+    ReadArray(in, splits);
+    ReadArray(in, leaves8);
+    ReadArray(in, leaves16);
+
+    size_t leafValues = (size_t)levels * treesPerLevel * leavesPerTree * shapeSize;
+    size_t expected = (precision == INT8) ? leaves8.size() : leaves16.size();
+    if (!in || splits.size() != (size_t)levels * treesPerLevel * splitsPerTree || expected != leafValues) {
+        throw std::runtime_error(path + " is truncated or inconsistent");
+    }
+}
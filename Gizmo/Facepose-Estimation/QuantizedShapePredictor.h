@@ -0,0 +1,182 @@
+#ifndef QUANTIZEDSHAPEPREDICTOR_H
+#define QUANTIZEDSHAPEPREDICTOR_H
+
+#include <dlib/image_processing.h>
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#if defined(__F16C__)
+#include <immintrin.h>
+#endif
+
+/**
+ * QuantizedShapePredictor - dlib's shape_predictor with compact storage.
+ *
+ * dlib keeps every leaf displacement as a float and every split as two unsigned longs plus a float, so the 68 point
+ * model takes ~100 MB, nearly all of it leaves. Here leaves are stored either as int8 with one scale per cascade level
+ * (4x smaller) or as IEEE half floats (2x smaller), and splits are packed into 8 bytes (two u16 indices, float threshold).
+ *
+ * Evaluation follows dlib's shape_predictor::operator() step for step. For int8 the leaves of all trees of a level are
+ * summed as integers and scaled once.
+ *
+ * Built from a dlib .dat file by shape_quantizer (see shape_quantizer.cpp), which also measures the landmark error.
+ */
+class QuantizedShapePredictor {
+public:
+    enum Precision : uint8_t {
+        INT8 = 1,
+        FP16 = 2
+    };
+
+    /**
+     * quantize - Reads a dlib shape_predictor file and converts it.
+     *
+     * @param floatModelPath e.g. shape_predictor_68_face_landmarks.dat
+     * @param precision How the leaves are stored.
+     * @return The converted model. Throws if the file is not a shape_predictor with uniform trees.
+     */
+    static QuantizedShapePredictor quantize(const std::string &floatModelPath, Precision precision);
+
+    /**
+     * floatModelBytes - Memory taken by the parameters of a dlib shape_predictor file once loaded, for comparison.
+     */
+    static size_t floatModelBytes(const std::string &floatModelPath);
+
+    void save(const std::string &path) const;
+    void load(const std::string &path);
+
+    size_t memoryBytes() const;
+    Precision getPrecision() const { return precision; }
+    unsigned long num_parts() const { return initial_shape.size() / 2; }
+
+    template <typename image_type>
+    dlib::full_object_detection operator()(const image_type &img, const dlib::rectangle &rect) const;
+
+private:
+    struct PackedSplit {
+        uint16_t idx1;
+        uint16_t idx2;
+        float thresh;
+    };
+
+    unsigned long leafIndex(const PackedSplit *treeSplits, const std::vector<float> &feature_pixel_values) const;
+
+    Precision precision = INT8;
+    uint32_t levels = 0;
+    uint32_t treesPerLevel = 0;
+    uint32_t splitsPerTree = 0;
+    uint32_t leavesPerTree = 0;
+    uint32_t shapeSize = 0; // 2 * num_parts
+
+    dlib::matrix<float, 0, 1> initial_shape;
+    std::vector<std::vector<unsigned long>> anchor_idx;
+    std::vector<std::vector<dlib::vector<float, 2>>> deltas;
+
+    std::vector<float> scales;          // per level, INT8 only
+    std::vector<PackedSplit> splits;    // [level][tree][split]
+    std::vector<int8_t> leaves8;        // [level][tree][leaf][shapeSize]
+    std::vector<uint16_t> leaves16;     // same layout, FP16
+};
+
+uint16_t FloatToHalf(float f);
+
+// Inline: the FP16 path decodes every leaf delta in its innermost loop. One instruction with F16C (-mf16c or
+// -march=native on x86) and on AArch64, where __fp16 converts with fcvt; a bit-level decode otherwise.
+inline float HalfToFloat(uint16_t h) {
+#if defined(__F16C__)
+    return _cvtsh_ss(h);
+#elif defined(__aarch64__)
+    __fp16 half;
+    memcpy(&half, &h, sizeof(half));
+    return half;
+#else
+    uint32_t sign = (uint32_t)(h & 0x8000) << 16;
+    uint32_t exponent = (h >> 10) & 0x1F;
+    uint32_t mantissa = h & 0x3FF;
+    uint32_t bits;
+
+    if (exponent == 0) {
+        if (mantissa == 0) {
+            bits = sign;
+        } else { // subnormal: renormalise
+            exponent = 127 - 15 + 1;
+            while (!(mantissa & 0x400)) {
+                mantissa <<= 1;
+                exponent--;
+            }
+            bits = sign | (exponent << 23) | ((mantissa & 0x3FF) << 13);
+        }
+    } else if (exponent == 0x1F) {
+        bits = sign | 0x7F800000 | (mantissa << 13);
+    } else {
+        bits = sign | ((exponent + 127 - 15) << 23) | (mantissa << 13);
+    }
+
+    float f;
+    memcpy(&f, &bits, sizeof(f));
+    return f;
+#endif
+}
+
+inline unsigned long QuantizedShapePredictor::leafIndex(const PackedSplit *treeSplits, const std::vector<float> &feature_pixel_values) const {
+    // Same complete binary tree walk as dlib::impl::regression_tree.
+    unsigned long i = 0;
+    while (i < splitsPerTree) {
+        const PackedSplit &split = treeSplits[i];
+        if (feature_pixel_values[split.idx1] - feature_pixel_values[split.idx2] > split.thresh) {
+            i = 2 * i + 1;
+        } else {
+            i = 2 * i + 2;
+        }
+    }
+    return i - splitsPerTree;
+}
+
+template <typename image_type>
+dlib::full_object_detection QuantizedShapePredictor::operator()(const image_type &img, const dlib::rectangle &rect) const {
+    dlib::matrix<float, 0, 1> current_shape = initial_shape;
+    std::vector<float> feature_pixel_values;
+    std::vector<int32_t> sums(shapeSize);
+
+    for (uint32_t level = 0; level < levels; ++level) {
+        dlib::impl::extract_feature_pixel_values(img, rect, current_shape, initial_shape,
+                                                 anchor_idx[level], deltas[level], feature_pixel_values);
+
+        size_t treeBase = (size_t)level * treesPerLevel;
+
+        if (precision == INT8) {
+            std::fill(sums.begin(), sums.end(), 0);
+            for (uint32_t tree = 0; tree < treesPerLevel; ++tree) {
+                unsigned long leaf = leafIndex(&splits[(treeBase + tree) * splitsPerTree], feature_pixel_values);
+                const int8_t *delta = &leaves8[((treeBase + tree) * leavesPerTree + leaf) * shapeSize];
+                for (uint32_t j = 0; j < shapeSize; ++j) {
+                    sums[j] += delta[j];
+                }
+            }
+            for (uint32_t j = 0; j < shapeSize; ++j) {
+                current_shape(j) += scales[level] * sums[j];
+            }
+
+        } else {
+            for (uint32_t tree = 0; tree < treesPerLevel; ++tree) {
+                unsigned long leaf = leafIndex(&splits[(treeBase + tree) * splitsPerTree], feature_pixel_values);
+                const uint16_t *delta = &leaves16[((treeBase + tree) * leavesPerTree + leaf) * shapeSize];
+                for (uint32_t j = 0; j < shapeSize; ++j) {
+                    current_shape(j) += HalfToFloat(delta[j]);
+                }
+            }
+        }
+    }
+
+    const dlib::point_transform_affine tform_to_img = dlib::impl::unnormalizing_tform(rect);
+    std::vector<dlib::point> parts(current_shape.size() / 2);
+    for (unsigned long i = 0; i < parts.size(); ++i) {
+        parts[i] = tform_to_img(dlib::impl::location(current_shape, i));
+    }
+    return dlib::full_object_detection(rect, parts);
+}
+
+#endif
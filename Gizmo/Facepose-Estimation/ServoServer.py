@@ -3,6 +3,11 @@ from flask import Flask, json, request, Response
 from adafruit_servokit import ServoKit
 import threading
 import math
+import os
+import socket
+import struct
+import sys
+import time
 
 class ServoHandler(threading.Thread):
 	def __init__(self):
@@ -74,6 +79,58 @@ class ServoHandler(threading.Thread):
 		else:
 			self.kit.servo[1].angle = ((self.goal_tilt - current_tilt) * self.SPEED) + current_tilt 
 
+# Binary aim datagram sent by AimSocket in FaceposeEstimation, see AimSocket.h for the layout.
+AIM_PACKET = struct.Struct('<HBBIIQhh')
+AIM_PACKET_MAGIC = 0x4147
+AIM_PACKET_VERSION = 1
+AIM_MAX_AGE = 0.25 # seconds
+
+class AimDatagramListener(threading.Thread):
+	"""Feeds aim datagrams to the servo handler, dropping reordered and stale targets."""
+	def __init__(self, endpoint, handler):
+		threading.Thread.__init__(self, daemon=True)
+		self.handler = handler
+
+		if endpoint.startswith('unix:'):
+			path = endpoint[len('unix:'):]
+			if os.path.exists(path):
+				os.unlink(path)
+			self.sock = socket.socket(socket.AF_UNIX, socket.SOCK_DGRAM)
+			self.sock.bind(path)
+		elif endpoint.startswith('udp:'):
+			host, _, port = endpoint[len('udp:'):].rpartition(':')
+			self.sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+			self.sock.bind((host or '127.0.0.1', int(port)))
+		else:
+			raise ValueError(f'Unknown aim endpoint {endpoint}')
+
+		self.session = None
+		self.sequence = 0
+
+	def accept(self, session, sequence, timestamp_us):
+		# Both processes share CLOCK_MONOTONIC, which is what time.monotonic() reads on Linux.
+		if time.monotonic() - timestamp_us / 1e6 > AIM_MAX_AGE:
+			return False
+		# Serial number arithmetic so the sequence may wrap around.
+		if session == self.session:
+			delta = (sequence - self.sequence) & 0xFFFFFFFF
+			if delta == 0 or delta >= 0x80000000:
+				return False
+		self.session = session
+		self.sequence = sequence
+		return True
+
+	def run(self):
+		while True:
+			data = self.sock.recv(AIM_PACKET.size + 1)
+			if len(data) != AIM_PACKET.size:
+				continue
+			magic, version, _, session, sequence, timestamp_us, pan, tilt = AIM_PACKET.unpack(data)
+			if magic != AIM_PACKET_MAGIC or version != AIM_PACKET_VERSION:
+				continue
+			if self.accept(session, sequence, timestamp_us):
+				self.handler.set_goals(pan, tilt)
+
 api = Flask(__name__)
 
 @api.route('/aim_camera', methods=['GET'])
@@ -96,5 +153,9 @@ if __name__ == '__main__':
 	servo_handler = ServoHandler()
 	servo_handler.start()
 
+	# Optional: ./ServoServer.py --aim udp:127.0.0.1:5001 (or unix:/tmp/aim.sock), matching FaceposeEstimation's -aim
+	if '--aim' in sys.argv:
+		AimDatagramListener(sys.argv[sys.argv.index('--aim') + 1], servo_handler).start()
+
 	api.run()
 
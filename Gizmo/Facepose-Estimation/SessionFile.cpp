@@ -0,0 +1,319 @@
+#include "SessionFile.h"
+#include "WireFormat.h"
+#include <opencv2/imgcodecs.hpp>
+
+#include <cstring>
+#include <stdexcept>
+
+using namespace std;
+
+void encodeSessionFace(const SessionFace &face, vector<uint8_t> &payload)
+{
+   payload.resize(SESSION_FACE_SIZE);
+   uint8_t *p = payload.data();
+
+   *p++ = face.face;
+   for (int i = 0; i < 4; i++, p += 4)
+   {
+      putLe(p, (uint32_t)face.rect[i], 4);
+   }
+   for (int i = 0; i < 2 * SESSION_LANDMARKS; i++, p += 2)
+   {
+      putLe(p, (uint16_t)face.landmarks[i], 2);
+   }
+   for (int i = 0; i < 3; i++, p += 4)
+   {
+      putFloatLe(p, face.euler[i]);
+   }
+   for (int i = 0; i < 3; i++, p += 4)
+   {
+      putFloatLe(p, face.translation[i]);
+   }
+   putFloatLe(p, face.dist);
+   p += 4;
+   *p++ = face.facing;
+   *p++ = face.direction;
+}
+
+bool decodeSessionFace(const vector<uint8_t> &payload, SessionFace &face)
+{
+   if (payload.size() < SESSION_FACE_SIZE)
+   {
+      return false;
+   }
+   const uint8_t *p = payload.data();
+
+   face.face = *p++;
+   for (int i = 0; i < 4; i++, p += 4)
+   {
+      face.rect[i] = (int32_t)getLe(p, 4);
+   }
+   for (int i = 0; i < 2 * SESSION_LANDMARKS; i++, p += 2)
+   {
+      face.landmarks[i] = (int16_t)getLe(p, 2);
+   }
+   for (int i = 0; i < 3; i++, p += 4)
+   {
+      face.euler[i] = getFloatLe(p);
+   }
+   for (int i = 0; i < 3; i++, p += 4)
+   {
+      face.translation[i] = getFloatLe(p);
+   }
+   face.dist = getFloatLe(p);
+   p += 4;
+   face.facing = *p++;
+   face.direction = *p++;
+   return true;
+}
+
+SessionWriter::SessionWriter(const string &path, const SessionSettings &settings)
+{
+   file = fopen(path.c_str(), "wb");
+   if (!file)
+   {
+      throw runtime_error("Could not create session file " + path);
+   }
+
+   uint8_t header[SESSION_HEADER_SIZE + SESSION_SETTINGS_SIZE];
+   putLe(header, SESSION_MAGIC, 4);
+   putLe(header + 4, SESSION_VERSION, 2);
+   putLe(header + 6, SESSION_SETTINGS_SIZE, 2);
+   uint8_t *p = header + SESSION_HEADER_SIZE;
+   putFloatLe(p, settings.landmarkScale);
+   putLe(p + 4, (uint32_t)settings.landmarkCropWidth, 4);
+   p[8] = settings.fastDownsample;
+   p[9] = settings.quantizedLandmarks;
+   putLe(p + 10, settings.detectInterval, 2);
+   putFloatLe(p + 12, settings.detectScale);
+   fwrite(header, 1, sizeof(header), file);
+   written = sizeof(header);
+
+   writer = thread(&SessionWriter::writeLoop, this);
+}
+
+SessionWriter::~SessionWriter()
+{
+   {
+      lock_guard<mutex> guard(queueLock);
+      running = false;
+   }
+   queueChanged.notify_all();
+   writer.join(); // drains the queue first
+   fclose(file);
+}
+
+void SessionWriter::writeFrame(const cv::Mat &frame, uint64_t frameNumber, uint64_t timestampUs)
+{
+   Queued queued;
+   queued.record = {SESSION_FRAME, frameNumber, timestampUs, {}};
+   frame.copyTo(queued.image);
+   queueFrame(move(queued));
+}
+
+void SessionWriter::writeFrame(const FrameRef &frame, uint64_t frameNumber, uint64_t timestampUs)
+{
+   Queued queued;
+   queued.record = {SESSION_FRAME, frameNumber, timestampUs, {}};
+   queued.frame = frame;
+   queueFrame(move(queued));
+}
+
+void SessionWriter::queueFrame(Queued &&queued)
+{
+   unique_lock<mutex> guard(queueLock);
+   queueChanged.wait(guard, [this] { return queuedFrames < SESSION_MAX_QUEUED; });
+   queuedFrames++;
+   queue.push_back(move(queued));
+   guard.unlock();
+   queueChanged.notify_all();
+}
+
+void SessionWriter::write(SessionRecordType type, uint64_t frameNumber, uint64_t timestampUs, vector<uint8_t> &&payload)
+{
+   {
+      lock_guard<mutex> guard(queueLock);
+      queue.push_back({{type, frameNumber, timestampUs, move(payload)}, cv::Mat(), FrameRef()});
+   }
+   queueChanged.notify_all();
+}
+
+void SessionWriter::writeLoop()
+{
+   uint8_t header[SESSION_RECORD_HEADER_SIZE];
+   vector<uint8_t> encoded;
+   vector<int> params = {cv::IMWRITE_PNG_COMPRESSION, SESSION_PNG_COMPRESSION};
+
+   unique_lock<mutex> guard(queueLock);
+   while (true)
+   {
+      queueChanged.wait(guard, [this] { return !queue.empty() || !running; });
+      if (queue.empty())
+      {
+         return; // stopped and drained
+      }
+
+      Queued queued = move(queue.front());
+      queue.pop_front();
+      guard.unlock();
+
+      SessionRecord &record = queued.record;
+      if (record.type == SESSION_FRAME)
+      {
+         cv::imencode(".png", queued.frame ? queued.frame.mat() : queued.image, encoded, params);
+         queued.frame.reset(); // back to the pool as early as possible
+         record.payload.resize(1 + encoded.size());
+         record.payload[0] = SESSION_CODEC_PNG;
+         memcpy(record.payload.data() + 1, encoded.data(), encoded.size());
+      }
+
+      header[0] = record.type;
+      putLe(header + 1, record.payload.size(), 4);
+      putLe(header + 5, record.frameNumber, 8);
+      putLe(header + 13, record.timestampUs, 8);
+      if (fwrite(header, 1, sizeof(header), file) != sizeof(header) ||
+          fwrite(record.payload.data(), 1, record.payload.size(), file) != record.payload.size())
+      {
+         perror("Session file write");
+      }
+      written += sizeof(header) + record.payload.size();
+
+      guard.lock();
+      if (record.type == SESSION_FRAME)
+      {
+         queuedFrames--; // only now, so at most SESSION_MAX_QUEUED raw frames are held
+         queueChanged.notify_all();
+      }
+   }
+}
+
+SessionReader::SessionReader(const string &path)
+{
+   file = fopen(path.c_str(), "rb");
+   if (!file)
+   {
+      throw runtime_error("Could not open session file " + path);
+   }
+
+   fseek(file, 0, SEEK_END);
+   fileSize = ftell(file);
+   fseek(file, 0, SEEK_SET);
+
+   uint8_t header[SESSION_HEADER_SIZE];
+   uint64_t version = 0;
+   if (fread(header, 1, sizeof(header), file) != sizeof(header) || getLe(header, 4) != SESSION_MAGIC ||
+       (version = getLe(header + 4, 2)) < 1 || version > SESSION_VERSION)
+   {
+      fclose(file);
+      throw runtime_error(path + " is not a session file of a known version");
+   }
+
+   // Version 1 kept this field zero.
+   size_t settingsSize = getLe(header + 6, 2);
+   firstRecord = SESSION_HEADER_SIZE + settingsSize;
+   if (version >= 2)
+   {
+      uint8_t settings[SESSION_SETTINGS_SIZE];
+      if (settingsSize < sizeof(settings) || fread(settings, 1, sizeof(settings), file) != sizeof(settings))
+      {
+         fclose(file);
+         throw runtime_error(path + " has a damaged header");
+      }
+      recorded.landmarkScale = getFloatLe(settings);
+      recorded.landmarkCropWidth = (int32_t)getLe(settings + 4, 4);
+      recorded.fastDownsample = settings[8];
+      recorded.quantizedLandmarks = settings[9];
+      recorded.detectInterval = (uint16_t)getLe(settings + 10, 2);
+      recorded.detectScale = getFloatLe(settings + 12);
+      settingsStored = true;
+   }
+   fseek(file, firstRecord, SEEK_SET);
+}
+
+SessionReader::~SessionReader()
+{
+   fclose(file);
+}
+
+bool SessionReader::readRecord(SessionRecord &record)
+{
+   uint8_t header[SESSION_RECORD_HEADER_SIZE];
+   if (!damage.empty() || fread(header, 1, sizeof(header), file) != sizeof(header))
+   {
+      return false;
+   }
+
+   record.type = (SessionRecordType)header[0];
+   record.frameNumber = getLe(header + 5, 8);
+   record.timestampUs = getLe(header + 13, 8);
+   uint64_t length = getLe(header + 1, 4);
+   long offset = ftell(file) - (long)sizeof(header);
+   if (record.type < SESSION_FRAME || record.type > SESSION_DETECT || length > SESSION_MAX_PAYLOAD)
+   {
+      damage = "corrupt record at offset " + to_string(offset) + " (type " + to_string(header[0]) + ", " +
+               to_string(length) + " bytes)";
+      return false;
+   }
+   if ((long)length > fileSize - ftell(file))
+   {
+      return false; // the recording was stopped while this record was being written
+   }
+
+   record.payload.resize(length);
+   return fread(record.payload.data(), 1, record.payload.size(), file) == record.payload.size();
+}
+
+bool SessionReader::nextFrame(SessionRecord &frame, vector<SessionRecord> &results)
+{
+   results.clear();
+
+   // Find the frame record; anything before it belongs to no frame we can replay.
+   if (hasPending)
+   {
+      frame = move(pending);
+      hasPending = false;
+   }
+   else if (!readRecord(frame))
+   {
+      return false;
+   }
+   while (frame.type != SESSION_FRAME)
+   {
+      if (!readRecord(frame))
+      {
+         return false;
+      }
+   }
+
+   // Everything up to the next frame record was computed from this frame.
+   SessionRecord record;
+   while (readRecord(record))
+   {
+      if (record.type == SESSION_FRAME)
+      {
+         pending = move(record);
+         hasPending = true;
+         break;
+      }
+      results.push_back(move(record));
+   }
+   return true;
+}
+
+bool SessionReader::decodeFrame(const SessionRecord &frame, cv::Mat &image)
+{
+   if (frame.type != SESSION_FRAME || frame.payload.size() < 2 || frame.payload[0] != SESSION_CODEC_PNG)
+   {
+      return false;
+   }
+
+   cv::Mat encoded(1, (int)frame.payload.size() - 1, CV_8UC1, (void *)(frame.payload.data() + 1));
+   cv::imdecode(encoded, cv::IMREAD_COLOR, &image); // into image's buffer if it already has the right size
+   return !image.empty();
+}
+
+void SessionReader::rewind()
+{
+   fseek(file, firstRecord, SEEK_SET);
+   hasPending = false;
+}
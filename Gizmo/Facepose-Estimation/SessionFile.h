@@ -0,0 +1,209 @@
+#ifndef SESSIONFILE_H
+#define SESSIONFILE_H
+
+#include <opencv2/core.hpp>
+#include "FramePool.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+/**
+ * Session files: a recording of what FaceposeEstimation saw and decided, for replaying a session offline.
+ *
+ * The file starts with an 8 byte header ("GSES", u16 version, u16 settings length) and the SessionSettings the
+ * session was recorded with (none in version 1 files). After that it is a sequence of little-endian records:
+ *
+ *   u8 type | u32 payload length | u64 frameNumber | u64 timestampUs | payload
+ *
+ * Every frame is one SESSION_FRAME record (the losslessly compressed camera image) followed by the records of what
+ * was computed from it, so replay can feed the frame back in and compare. timestampUs is CLOCK_MONOTONIC: capture
+ * time for frames, the time the result was ready for everything else.
+ */
+#define SESSION_MAGIC 0x53455347 // "GSES"
+#define SESSION_VERSION 2
+#define SESSION_HEADER_SIZE 8
+#define SESSION_SETTINGS_SIZE 16
+#define SESSION_RECORD_HEADER_SIZE 21
+
+// Larger than any compressed frame a camera we support produces. A longer record is corrupt, not worth allocating.
+#define SESSION_MAX_PAYLOAD (64u << 20)
+
+// Frames waiting for the writer thread. Past this the vision loop waits: a recording must not have gaps.
+#define SESSION_MAX_QUEUED 32
+
+// Fastest zlib level: frames are big and the writer has to keep up with the camera.
+#define SESSION_PNG_COMPRESSION 1
+
+enum SessionRecordType : uint8_t
+{
+   SESSION_FRAME = 1,     // u8 codec | encoded image
+   SESSION_FACE = 2,      // SessionFace
+   SESSION_AIM = 3,       // i32 x | i32 y, the offset handed to the aiming code
+   SESSION_COMMANDER = 4, // the bytes sent to GizmoCommander: the ascii decision or an encoded CommanderMessage
+   SESSION_DETECT = 5     // u16 detectInterval | f32 detectScale, when the thermal policy changed them for this frame
+};
+
+/**
+ * The options that change what is computed from a frame. Replay runs with these rather than its own, or its results
+ * could not be compared with the recorded ones.
+ *
+ *   f32 landmarkScale | i32 landmarkCropWidth | u8 fastDownsample | u8 quantizedLandmarks |
+ *   u16 detectInterval | f32 detectScale
+ *
+ * detectInterval and detectScale are the schedule the session started with; SESSION_DETECT records follow it when
+ * it changes.
+ */
+struct SessionSettings
+{
+   float landmarkScale = 1;
+   int32_t landmarkCropWidth = 0;
+   uint8_t fastDownsample = 1;
+   uint8_t quantizedLandmarks = 0; // the landmark model is not stored, only which kind it was
+   uint16_t detectInterval = 1;
+   float detectScale = 1;
+};
+
+enum SessionCodec : uint8_t
+{
+   SESSION_CODEC_PNG = 1
+};
+
+struct SessionRecord
+{
+   SessionRecordType type;
+   uint64_t frameNumber;
+   uint64_t timestampUs;
+   std::vector<uint8_t> payload;
+};
+
+#define SESSION_LANDMARKS 68
+#define SESSION_FACE_SIZE (1 + 16 + 4 * SESSION_LANDMARKS + 7 * 4 + 2)
+
+/**
+ * One face of one frame: the detection, the landmarks, the pose and the facing decision.
+ */
+struct SessionFace
+{
+   uint8_t face;
+   int32_t rect[4]; // left, top, right, bottom, in detection image pixels
+   int16_t landmarks[2 * SESSION_LANDMARKS];
+   float euler[3];       // pitch, yaw, roll
+   float translation[3];
+   float dist;           // nose line length the decision was made on
+   uint8_t facing;
+   uint8_t direction;    // FaceDirection
+};
+
+void encodeSessionFace(const SessionFace &face, std::vector<uint8_t> &payload);
+bool decodeSessionFace(const std::vector<uint8_t> &payload, SessionFace &face);
+
+/**
+ * SessionWriter - Appends records to a session file. Records are queued and compressed and written by a background
+ * thread, so the vision loop only pays for copying the frame, or for nothing when the frame comes from a FramePool.
+ */
+class SessionWriter
+{
+public:
+   SessionWriter(const std::string &path, const SessionSettings &settings);
+   ~SessionWriter();
+
+   /**
+    * writeFrame - Queues a camera frame. Blocks only if the writer has fallen SESSION_MAX_QUEUED frames behind.
+    */
+   void writeFrame(const cv::Mat &frame, uint64_t frameNumber, uint64_t timestampUs);
+
+   /**
+    * writeFrame - Queues a pool frame without copying it. The writer holds the reference until the frame is encoded,
+    * so the caller must not draw on it (check FrameRef::unique() first).
+    */
+   void writeFrame(const FrameRef &frame, uint64_t frameNumber, uint64_t timestampUs);
+
+   void write(SessionRecordType type, uint64_t frameNumber, uint64_t timestampUs, std::vector<uint8_t> &&payload);
+
+   uint64_t bytesWritten() const { return written; }
+
+private:
+   struct Queued
+   {
+      SessionRecord record;
+      cv::Mat image; // frames are encoded by the writer thread
+      FrameRef frame; // or this one, if it came from a FramePool
+   };
+
+   void writeLoop();
+   void queueFrame(Queued &&queued);
+
+   FILE *file;
+   std::atomic<uint64_t> written{0};
+
+   std::mutex queueLock;
+   std::condition_variable queueChanged;
+   std::deque<Queued> queue;
+   unsigned queuedFrames = 0;
+   bool running = true;
+   std::thread writer;
+};
+
+/**
+ * SessionReader - Reads a session file back one frame at a time.
+ */
+class SessionReader
+{
+public:
+   SessionReader(const std::string &path);
+   ~SessionReader();
+
+   /**
+    * nextFrame - Reads the next SESSION_FRAME record and every record that belongs to it.
+    *
+    * @param frame Receives the frame record.
+    * @param results Receives the records recorded for that frame, in recording order.
+    * @return false at the end of the file. A truncated last frame (recording killed) counts as the end; a corrupt
+    *         record also ends the file, and sets error().
+    */
+   bool nextFrame(SessionRecord &frame, std::vector<SessionRecord> &results);
+
+   /**
+    * settings - What the session was recorded with. Only meaningful if hasSettings(): version 1 files did not store them.
+    */
+   const SessionSettings &settings() const { return recorded; }
+   bool hasSettings() const { return settingsStored; }
+
+   /**
+    * error - Why reading stopped before the end of the file, or empty if it did not.
+    */
+   const std::string &error() const { return damage; }
+
+   /**
+    * decodeFrame - The camera image of a SESSION_FRAME record.
+    * @return false if the record does not hold an image we can decode.
+    */
+   static bool decodeFrame(const SessionRecord &frame, cv::Mat &image);
+
+   /**
+    * rewind - Goes back to the first frame.
+    */
+   void rewind();
+
+private:
+   bool readRecord(SessionRecord &record);
+
+   FILE *file;
+   long fileSize = 0;
+   long firstRecord = SESSION_HEADER_SIZE;
+   SessionSettings recorded;
+   bool settingsStored = false;
+   std::string damage;
+   SessionRecord pending;
+   bool hasPending = false;
+};
+
+#endif
@@ -1,6 +1,12 @@
 #include "TcpSocket.h"
+#include "Trace.h"
+#include "Log.h"
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <netinet/tcp.h>
+#include <fcntl.h>
+#include <algorithm>
 #include <stdexcept>
-#include <iostream>
 #include <cstring>
 
 using namespace std;
@@ -16,7 +22,7 @@ TcpSocket::TcpSocket(const char *port, const char *address) : port(port), addres
    sd = createTcpSocket(port, address);
    if (sd < 0)
    {
-      throw runtime_error("Could not connect to TCP server at " + *address + ':' + *port);
+      throw runtime_error("Could not connect to TCP server at " + string(address) + ':' + port);
    }
 }
 
@@ -26,7 +32,35 @@ TcpSocket::TcpSocket(const char *port) : port(port), address(nullptr)
    sd = createTcpSocket(port, NULL);
    if (sd < 0)
    {
-      throw runtime_error("Could not start TCP server at port " + *port);
+      throw runtime_error("Could not start TCP server at port " + string(port));
+   }
+}
+
+TcpSocket::~TcpSocket()
+{
+   if (serving)
+   {
+      serving = false;
+      uint64_t one = 1;
+      write(wakeFd, &one, sizeof(one));
+      listenThread.join();
+   }
+
+   for (auto &client : clients)
+   {
+      close(client.first);
+   }
+   if (epollFd >= 0)
+   {
+      close(epollFd);
+   }
+   if (wakeFd >= 0)
+   {
+      close(wakeFd);
+   }
+   if (sd >= 0)
+   {
+      close(sd);
    }
 }
 
@@ -43,21 +77,23 @@ int TcpSocket::createTcpSocket(const char *port, const char *server)
    int error = getaddrinfo(server, port, &hints, &servInfo);
    if (error != 0)
    {
-      cerr << "getaddrinfo() Error! " << error << endl;
+      LOG_ERROR("getaddrinfo() Error! %s", gai_strerror(error));
       exit(1);
    }
 
-   return createNewSocket(servInfo);
+   int sd = createNewSocket(servInfo, server == NULL);
+   freeaddrinfo(servInfo);
+   return sd;
 }
 
-int TcpSocket::createNewSocket(addrinfo *servInfo)
+int TcpSocket::createNewSocket(addrinfo *servInfo, bool isServer)
 {
    // make a socket, bind it, listen to it
    int sd = socket(servInfo->ai_family, servInfo->ai_socktype,
                    servInfo->ai_protocol);
    if (sd < 0)
    {
-      cerr << "Socket creation error!" << errno << endl;
+      LOG_ERROR("Socket creation error! %s", strerror(errno));
 
       return -1;
    }
@@ -65,21 +101,21 @@ int TcpSocket::createNewSocket(addrinfo *servInfo)
    const int yes = 1;
    if (setsockopt(sd, SOL_SOCKET, SO_REUSEADDR, (char *)&yes, sizeof(yes)) < 0)
    {
-      cerr << "Set Socket Option Error!" << endl;
+      LOG_WARN("Set Socket Option Error!");
    }
 
    // if no server given, this is a server, bind port, listen to it
-   if (servInfo->ai_addrlen < 1)
+   if (isServer)
    {
       if (bind(sd, servInfo->ai_addr, servInfo->ai_addrlen) < 0)
       {
+         LOG_ERROR("server: bind %s", strerror(errno));
          close(sd);
-         cerr << "server: bind " << errno << endl;
          return -1;
       }
       if (listen(sd, MAX_REQUESTS) < 0)
       {
-         cerr << "listen error" << errno << endl;
+         LOG_ERROR("listen error %s", strerror(errno));
          close(sd);
          return -1;
       }
@@ -89,7 +125,8 @@ int TcpSocket::createNewSocket(addrinfo *servInfo)
       int status = connect(sd, servInfo->ai_addr, servInfo->ai_addrlen);
       if (status < 0)
       {
-         cerr << "Failed to connect to the server" << errno << endl;
+         LOG_ERROR("Failed to connect to the server: %s", strerror(errno));
+         close(sd);
 
          return -1;
       }
@@ -100,13 +137,32 @@ int TcpSocket::createNewSocket(addrinfo *servInfo)
 
 int TcpSocket::send(char *msg, int msgSize)
 {
+   TRACE_SPAN_ARG("tcp send", msgSize);
+   if (sd < 0 && !connectAgain())
+   {
+      return -1;
+   }
+
    int totalBytesSent = 0;
    while (totalBytesSent < msgSize)
    {
-      int bytesSent = write(sd, (char *)msg, msgSize);
+      // MSG_NOSIGNAL: a connection reset by the other end is an error to report, not a SIGPIPE that ends the process
+      int bytesSent = ::send(sd, msg + totalBytesSent, msgSize - totalBytesSent, MSG_NOSIGNAL);
+      if (bytesSent < 0 && errno == EINTR)
+      {
+         continue;
+      }
       if (bytesSent < 0)
       {
-         cerr << "SEND ERROR" << errno << endl;
+         LOG_ERROR("SEND ERROR %s", strerror(errno));
+         if (reconnect)
+         {
+            // a partly sent message cannot be finished on another connection; start over with a clean one
+            close(sd);
+            sd = -1;
+            backoffMs = RECONNECT_MIN_MS;
+            nextAttempt = chrono::steady_clock::now() + chrono::milliseconds(backoffMs);
+         }
          return -1;
       }
       else
@@ -117,3 +173,231 @@ int TcpSocket::send(char *msg, int msgSize)
 
    return 0;
 }
+
+void TcpSocket::setReconnect(bool enabled)
+{
+   reconnect = enabled;
+}
+
+bool TcpSocket::connectAgain()
+{
+   if (!reconnect || chrono::steady_clock::now() < nextAttempt)
+   {
+      return false;
+   }
+
+   sd = createTcpSocket(port, address);
+   if (sd < 0)
+   {
+      backoffMs = min(2 * backoffMs, RECONNECT_MAX_MS);
+      nextAttempt = chrono::steady_clock::now() + chrono::milliseconds(backoffMs);
+      return false;
+   }
+
+   LOG_INFO("Reconnected to %s:%s", address, port);
+   if (sendBufferBytes > 0)
+   {
+      setSendBufferSize(sendBufferBytes);
+   }
+   reconnects++;
+   return true;
+}
+
+int TcpSocket::setSendBufferSize(int bytes)
+{
+   sendBufferBytes = bytes;
+   if (setsockopt(sd, SOL_SOCKET, SO_SNDBUF, (char *)&bytes, sizeof(bytes)) < 0)
+   {
+      LOG_ERROR("SO_SNDBUF error %s", strerror(errno));
+      return -1;
+   }
+   return 0;
+}
+
+int TcpSocket::startServer()
+{
+   epollFd = epoll_create1(EPOLL_CLOEXEC);
+   wakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+   if (epollFd < 0 || wakeFd < 0)
+   {
+      LOG_ERROR("epoll setup error %s", strerror(errno));
+      return -1;
+   }
+
+   fcntl(sd, F_SETFL, fcntl(sd, F_GETFL) | O_NONBLOCK);
+
+   struct epoll_event ev;
+   memset(&ev, 0, sizeof(ev));
+   ev.events = EPOLLIN;
+   ev.data.fd = sd;
+   epoll_ctl(epollFd, EPOLL_CTL_ADD, sd, &ev);
+   ev.data.fd = wakeFd;
+   epoll_ctl(epollFd, EPOLL_CTL_ADD, wakeFd, &ev);
+
+   serving = true;
+   listenThread = thread(&TcpSocket::serverListenThread, this);
+
+   return 0;
+}
+
+int TcpSocket::broadcast(const char *msg, int msgSize)
+{
+   TRACE_SPAN_ARG("tcp broadcast", msgSize);
+   {
+      lock_guard<mutex> guard(clientsLock);
+      if (clients.empty())
+      {
+         return 0;
+      }
+
+      // one copy of the message, shared by every client queue
+      auto payload = make_shared<const string>(msg, msgSize);
+      for (auto &entry : clients)
+      {
+         Client &client = entry.second;
+         if (client.dropped)
+         {
+            continue;
+         }
+         if (client.queuedBytes + msgSize > MAX_CLIENT_QUEUE_BYTES)
+         {
+            // slow consumer: cut it loose rather than buffer without bound or wait for it
+            client.dropped = true;
+            droppedClients++;
+            continue;
+         }
+         client.queue.push_back(payload);
+         client.queuedBytes += msgSize;
+      }
+   }
+
+   uint64_t one = 1;
+   write(wakeFd, &one, sizeof(one));
+
+   return 0;
+}
+
+int TcpSocket::clientCount()
+{
+   lock_guard<mutex> guard(clientsLock);
+   return clients.size();
+}
+
+void TcpSocket::acceptClients()
+{
+   while (true)
+   {
+      int clientSd = accept4(sd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+      if (clientSd < 0)
+      {
+         return; // EAGAIN: backlog drained
+      }
+
+      const int yes = 1;
+      setsockopt(clientSd, IPPROTO_TCP, TCP_NODELAY, (char *)&yes, sizeof(yes));
+
+      struct epoll_event ev;
+      memset(&ev, 0, sizeof(ev));
+      ev.events = EPOLLIN | EPOLLRDHUP;
+      ev.data.fd = clientSd;
+      epoll_ctl(epollFd, EPOLL_CTL_ADD, clientSd, &ev);
+
+      lock_guard<mutex> guard(clientsLock);
+      clients[clientSd] = Client();
+   }
+}
+
+// Write as much of the client's backlog as the socket takes without blocking. Called with clientsLock held.
+void TcpSocket::flushClient(int clientSd, Client &client)
+{
+   TRACE_SPAN_ARG("tcp flush", clientSd);
+   while (!client.queue.empty())
+   {
+      const string &front = *client.queue.front();
+      ssize_t bytesSent = ::send(clientSd, front.data() + client.offset, front.size() - client.offset, MSG_DONTWAIT | MSG_NOSIGNAL);
+      if (bytesSent < 0)
+      {
+         if (errno != EAGAIN && errno != EWOULDBLOCK)
+         {
+            client.dropped = true;
+            return;
+         }
+         break;
+      }
+
+      client.offset += bytesSent;
+      if (client.offset == front.size())
+      {
+         client.queuedBytes -= front.size();
+         client.queue.pop_front();
+         client.offset = 0;
+      }
+   }
+
+   // only ask for EPOLLOUT while there is a backlog, otherwise the loop would spin on a writable socket
+   struct epoll_event ev;
+   memset(&ev, 0, sizeof(ev));
+   ev.events = EPOLLIN | EPOLLRDHUP | (client.queue.empty() ? 0 : (uint32_t)EPOLLOUT);
+   ev.data.fd = clientSd;
+   epoll_ctl(epollFd, EPOLL_CTL_MOD, clientSd, &ev);
+}
+
+void TcpSocket::serverListenThread()
+{
+   traceSetThreadName("tcp server");
+   struct epoll_event events[32];
+
+   while (serving)
+   {
+      int ready = epoll_wait(epollFd, events, 32, 500);
+
+      for (int i = 0; i < ready; i++)
+      {
+         int fd = events[i].data.fd;
+         if (fd == sd)
+         {
+            acceptClients();
+         }
+         else if (fd == wakeFd)
+         {
+            uint64_t count;
+            read(wakeFd, &count, sizeof(count));
+         }
+         else if (events[i].events & (EPOLLIN | EPOLLRDHUP | EPOLLERR | EPOLLHUP))
+         {
+            // subscribers have nothing to say; anything read is discarded and EOF means they left
+            char discard[256];
+            ssize_t bytesRead = recv(fd, discard, sizeof(discard), MSG_DONTWAIT);
+            if (bytesRead == 0 || (bytesRead < 0 && errno != EAGAIN) || (events[i].events & (EPOLLERR | EPOLLHUP)))
+            {
+               lock_guard<mutex> guard(clientsLock);
+               auto client = clients.find(fd);
+               if (client != clients.end())
+               {
+                  client->second.dropped = true;
+               }
+            }
+         }
+      }
+
+      lock_guard<mutex> guard(clientsLock);
+      for (auto client = clients.begin(); client != clients.end();)
+      {
+         if (!client->second.dropped && !client->second.queue.empty())
+         {
+            flushClient(client->first, client->second);
+         }
+
+         if (client->second.dropped)
+         {
+            epoll_ctl(epollFd, EPOLL_CTL_DEL, client->first, NULL);
+            close(client->first);
+            client = clients.erase(client);
+         }
+         else
+         {
+            ++client;
+         }
+      }
+   }
+}
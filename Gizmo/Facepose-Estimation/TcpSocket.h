@@ -7,7 +7,15 @@
 #include <sys/socket.h>
 #include <sys/types.h> // for sockets
 #include <unistd.h>
+#include <atomic>
+#include <chrono>
+#include <deque>
 #include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
 
 using namespace std;
 
@@ -17,27 +25,78 @@ public:
    TcpSocket();
    TcpSocket(const char *port);
    TcpSocket(const char *port, const char *address);
+   ~TcpSocket();
 
    int send(char *msg, int msgSize);
 
-   // /**
-   //  * start multithreaded server. This requires a struct that defines the data to be passed to each thread, and a function that defines what the thread will do
-   //  */
-   // int startServer(void *threadData, function<void *(void *)> threadFunction);
+   /**
+    * make a client connection come back by itself. After a send fails the connection is closed and later sends try to
+    * connect again, waiting RECONNECT_MIN_MS after the first failure and twice as long after each failed attempt, up to
+    * RECONNECT_MAX_MS. Until then send() fails at once. Attempts are made on the sending thread.
+    */
+   void setReconnect(bool enabled);
 
-   struct
-   {
-   } ThreadData;
+   /**
+    * connections made again since the first one. A change tells the sender the other end has lost what it was told.
+    */
+   atomic<unsigned long> reconnects{0};
+
+   /**
+    * set SO_SNDBUF of a client connection, which also stops the kernel from growing it. send() blocks once this many
+    * bytes (as the kernel counts them) are waiting for the other end.
+    */
+   int setSendBufferSize(int bytes);
+
+   /**
+    * start the server thread. It accepts any number of clients and writes everything passed to broadcast() to each of them.
+    */
+   int startServer();
+
+   /**
+    * queue msg for every connected client and return immediately. Never blocks on the network:
+    * a client whose backlog exceeds MAX_CLIENT_QUEUE_BYTES is disconnected instead.
+    */
+   int broadcast(const char *msg, int msgSize);
+
+   int clientCount();
+
+   atomic<unsigned long> droppedClients{0};
 
 private:
    const int MAX_REQUESTS = 20;
+   const size_t MAX_CLIENT_QUEUE_BYTES = 64 * 1024;
+   const int RECONNECT_MIN_MS = 100;
+   const int RECONNECT_MAX_MS = 5000;
    const char *port;
    const char *address;
    int sd;
 
+   bool reconnect = false;
+   int sendBufferBytes = 0; // reapplied to a new connection, 0 for the kernel's own
+   int backoffMs = 0;
+   chrono::steady_clock::time_point nextAttempt;
+
+   struct Client
+   {
+      deque<shared_ptr<const string>> queue;
+      size_t queuedBytes = 0;
+      size_t offset = 0; // bytes of queue.front() already written
+      bool dropped = false;
+   };
+
+   mutex clientsLock;
+   map<int, Client> clients;
+   int epollFd = -1;
+   int wakeFd = -1;
+   atomic<bool> serving{false};
+   thread listenThread;
+
    int createTcpSocket(const char *port, const char *server);
-   int createNewSocket(addrinfo *servInfo);
-   int serverListenThread(void *threadData, function<void *(void *)> threadFunction);
+   int createNewSocket(addrinfo *servInfo, bool isServer);
+   bool connectAgain();
+   void serverListenThread();
+   void acceptClients();
+   void flushClient(int clientSd, Client &client);
 };
 
 #endif
@@ -0,0 +1,261 @@
+#include "ThermalMonitor.h"
+#include "ThreadPolicy.h"
+#include "Trace.h"
+#include "Log.h"
+
+#include <dirent.h>
+#include <algorithm>
+#include <chrono>
+#include <climits>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+
+static const char *LevelNames[] = {"normal", "warm", "hot", "critical"};
+
+/**
+ * ReadInt - First integer in a sysfs attribute.
+ * @return false if the file is missing or does not start with a number.
+ */
+static bool ReadInt(const std::string &path, long &value) {
+    std::ifstream file(path);
+    return (bool)(file >> value);
+}
+
+static std::string ReadLine(const std::string &path) {
+    std::ifstream file(path);
+    std::string line;
+    std::getline(file, line);
+    return line;
+}
+
+/**
+ * ListEntries - Names in dir starting with prefix followed by a number, in numeric order.
+ */
+static std::vector<std::string> ListEntries(const std::string &dir, const char *prefix) {
+    std::vector<std::pair<long, std::string>> found;
+    DIR *d = opendir(dir.c_str());
+    if (!d) {
+        return {};
+    }
+    size_t prefixLength = strlen(prefix);
+    while (struct dirent *entry = readdir(d)) {
+        const char *name = entry->d_name;
+        if (strncmp(name, prefix, prefixLength) == 0 && name[prefixLength] >= '0' && name[prefixLength] <= '9') {
+            char *end;
+            long number = strtol(name + prefixLength, &end, 10);
+            if (*end == '\0') {
+                found.emplace_back(number, name);
+            }
+        }
+    }
+    closedir(d);
+
+    std::sort(found.begin(), found.end());
+    std::vector<std::string> names;
+    for (auto &item : found) {
+        names.push_back(item.second);
+    }
+    return names;
+}
+
+ThermalMonitor::ThermalMonitor(const std::string &sysfsRoot, int baseInterval, int baseWorkers)
+    : root(sysfsRoot), baseInterval(std::max(1, baseInterval)), baseWorkers(std::max(1, baseWorkers)) {
+    findZones();
+    if (zones.empty()) {
+        LOG_WARN("Thermal monitor: no thermal zones under %s/class/thermal, the policy stays normal", root.c_str());
+    } else {
+        for (const Zone &zone : zones) {
+            LOG_INFO("Thermal monitor: %s trips at %.1fC", zone.type.c_str(), zone.tripMilliC / 1000.0);
+        }
+    }
+
+    lastReading = read();
+    startMaxFreqKHz = lastReading.maxFreqKHz;
+    level = decide(lastReading);
+
+    monitorThread = std::thread(&ThermalMonitor::monitorLoop, this);
+}
+
+ThermalMonitor::~ThermalMonitor() {
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        stopping = true;
+    }
+    wake.notify_all();
+    monitorThread.join();
+}
+
+const char *ThermalMonitor::levelName(ThermalLevel level) { return LevelNames[level]; }
+
+ThermalPolicy ThermalMonitor::policyFor(ThermalLevel level) const {
+    switch (level) {
+    case THERMAL_NORMAL:
+        return {level, baseInterval, 1.0, baseWorkers};
+    case THERMAL_WARM: // detect a little less often, nothing visible changes yet
+        return {level, baseInterval + 1, 1.0, baseWorkers};
+    case THERMAL_HOT:
+        return {level, baseInterval * 2, 0.75, std::max(1, baseWorkers / 2)};
+    default:
+        return {level, baseInterval * 3, 0.5, 1};
+    }
+}
+
+void ThermalMonitor::findZones() {
+    std::string thermalDir = root + "/class/thermal";
+    for (const std::string &name : ListEntries(thermalDir, "thermal_zone")) {
+        Zone zone;
+        zone.path = thermalDir + "/" + name;
+        zone.type = ReadLine(zone.path + "/type");
+        if (zone.type.find("PMIC") != std::string::npos || zone.type.find("fan") != std::string::npos) {
+            continue;
+        }
+        long temp;
+        if (!ReadInt(zone.path + "/temp", temp)) {
+            continue;
+        }
+
+        // The lowest passive trip point is where the kernel starts throttling.
+        zone.tripMilliC = INT_MAX;
+        for (int trip = 0;; trip++) {
+            std::string prefix = zone.path + "/trip_point_" + std::to_string(trip);
+            long tripTemp;
+            if (!ReadInt(prefix + "_temp", tripTemp)) {
+                break;
+            }
+            if (ReadLine(prefix + "_type") == "passive" && tripTemp > 0) {
+                zone.tripMilliC = std::min(zone.tripMilliC, (int)tripTemp);
+            }
+        }
+        if (zone.tripMilliC == INT_MAX) {
+            zone.tripMilliC = THERMAL_DEFAULT_TRIP_MC;
+        }
+        if (zone.type.empty()) {
+            zone.type = name;
+        }
+        zones.push_back(zone);
+    }
+}
+
+ThermalReading ThermalMonitor::read() {
+    ThermalReading reading;
+    auto now = std::chrono::steady_clock::now();
+    double dt = std::chrono::duration<double>(now - lastPoll).count();
+    lastPoll = now;
+
+    reading.headroomMilliC = INT_MAX;
+    for (Zone &zone : zones) {
+        long temp;
+        if (!ReadInt(zone.path + "/temp", temp)) {
+            continue;
+        }
+        if (zone.seen && dt > 0) {
+            // Smoothed, since the sensors step in 0.5C increments.
+            double slope = (temp - zone.lastMilliC) / 1000.0 / dt;
+            zone.slopeCPerS = 0.7 * zone.slopeCPerS + 0.3 * slope;
+        }
+        zone.lastMilliC = (int)temp;
+        zone.seen = true;
+
+        int predicted = (int)temp + (int)(std::max(0.0, zone.slopeCPerS) * THERMAL_LOOKAHEAD_S * 1000);
+        int headroom = zone.tripMilliC - predicted;
+        if (headroom < reading.headroomMilliC) {
+            reading.valid = true;
+            reading.zone = zone.type;
+            reading.tempMilliC = (int)temp;
+            reading.tripMilliC = zone.tripMilliC;
+            reading.headroomMilliC = headroom;
+            reading.slopeCPerS = zone.slopeCPerS;
+        }
+    }
+
+    std::string cpuDir = root + "/devices/system/cpu";
+    for (const std::string &name : ListEntries(cpuDir, "cpu")) {
+        std::string freqDir = cpuDir + "/" + name + "/cpufreq";
+        long cur, max;
+        if (ReadInt(freqDir + "/scaling_cur_freq", cur)) {
+            reading.curFreqKHz = std::max(reading.curFreqKHz, (int)cur);
+        }
+        if (ReadInt(freqDir + "/scaling_max_freq", max) && max > 0) {
+            reading.maxFreqKHz = reading.maxFreqKHz ? std::min(reading.maxFreqKHz, (int)max) : (int)max;
+        }
+    }
+    return reading;
+}
+
+ThermalLevel ThermalMonitor::decide(const ThermalReading &reading) const {
+    ThermalLevel current = level.load(std::memory_order_relaxed);
+    ThermalLevel next = THERMAL_NORMAL;
+
+    if (reading.valid) {
+        static const int margins[] = {0, THERMAL_WARM_MARGIN_MC, THERMAL_HOT_MARGIN_MC, THERMAL_CRITICAL_MARGIN_MC};
+        for (int l = THERMAL_CRITICAL; l > THERMAL_NORMAL; l--) {
+            // Entering a level takes headroom below its margin, staying in it only headroom below margin + hysteresis.
+            int margin = margins[l] + (l <= current ? THERMAL_HYSTERESIS_MC : 0);
+            if (reading.headroomMilliC < margin) {
+                next = (ThermalLevel)l;
+                break;
+            }
+        }
+    }
+
+    if (startMaxFreqKHz > 0 && reading.maxFreqKHz > 0 &&
+        reading.maxFreqKHz < startMaxFreqKHz * THERMAL_FREQ_CAPPED) {
+        next = std::max(next, THERMAL_HOT);
+    }
+    return next;
+}
+
+void ThermalMonitor::monitorLoop() {
+    traceSetThreadName("thermal");
+    applyThreadPolicy("thermal");
+
+    std::unique_lock<std::mutex> guard(lock);
+    while (!wake.wait_for(guard, std::chrono::milliseconds(THERMAL_POLL_MS), [this] { return stopping; })) {
+        guard.unlock(); // sysfs reads can take a while, describe() should not wait for them
+        ThermalReading reading;
+        {
+            TRACE_SPAN("thermal poll");
+            reading = read();
+        }
+        guard.lock();
+        lastReading = reading;
+
+        ThermalLevel current = level.load(std::memory_order_relaxed);
+        ThermalLevel next = decide(reading);
+        if (next == current) {
+            continue;
+        }
+        level.store(next, std::memory_order_relaxed);
+        changes++;
+
+        ThermalPolicy policy = policyFor(next);
+        LOG_INFO("Thermal: %s -> %s (%s %.1fC, %+.2fC/s, %.1fC to trip, cpu max %d MHz): "
+                 "detect every %d frames at %.2f scale, %d workers",
+                 LevelNames[current], LevelNames[next], reading.zone.c_str(), reading.tempMilliC / 1000.0,
+                 reading.slopeCPerS, reading.headroomMilliC / 1000.0, reading.maxFreqKHz / 1000,
+                 policy.detectInterval, policy.detectScale, policy.workers);
+    }
+}
+
+std::string ThermalMonitor::describe() {
+    std::lock_guard<std::mutex> guard(lock);
+    ThermalPolicy policy = policyFor(level.load(std::memory_order_relaxed));
+
+    char line[256];
+    if (lastReading.valid) {
+        snprintf(line, sizeof(line), "thermal %s: %s %.1fC (%+.2fC/s, trip %.0fC), cpu %d/%d MHz",
+                 LevelNames[policy.level], lastReading.zone.c_str(), lastReading.tempMilliC / 1000.0,
+                 lastReading.slopeCPerS, lastReading.tripMilliC / 1000.0, lastReading.curFreqKHz / 1000,
+                 lastReading.maxFreqKHz / 1000);
+    } else {
+        snprintf(line, sizeof(line), "thermal %s: no zones", LevelNames[policy.level]);
+    }
+
+    std::stringstream ss;
+    ss << line << " | detect every " << policy.detectInterval << " at " << policy.detectScale << " scale, "
+       << policy.workers << " workers | " << changes - reportedChanges << " policy changes";
+    reportedChanges = changes;
+    return ss.str();
+}
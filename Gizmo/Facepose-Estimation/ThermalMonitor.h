@@ -0,0 +1,118 @@
+#ifndef THERMALMONITOR_H
+#define THERMALMONITOR_H
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#define THERMAL_POLL_MS 1000
+#define THERMAL_DEFAULT_TRIP_MC 95000   // used for a zone without a passive trip point
+#define THERMAL_WARM_MARGIN_MC 20000    // levels start this far below the trip point
+#define THERMAL_HOT_MARGIN_MC 12000
+#define THERMAL_CRITICAL_MARGIN_MC 6000
+#define THERMAL_HYSTERESIS_MC 3000      // a level is left only once the headroom is this much above its margin
+#define THERMAL_LOOKAHEAD_S 10          // a rising temperature is judged by where it will be this much later
+#define THERMAL_FREQ_CAPPED 0.85        // CPU max frequency below this fraction of the start value: already throttled
+
+enum ThermalLevel {
+    THERMAL_NORMAL,
+    THERMAL_WARM,
+    THERMAL_HOT,
+    THERMAL_CRITICAL
+};
+
+/**
+ * ThermalPolicy - How much work the vision loop should do at a thermal level.
+ */
+struct ThermalPolicy {
+    ThermalLevel level;
+    int detectInterval; // run the face detector every this many frames
+    double detectScale; // detection image scale relative to the normal 1/4 image
+    int workers;        // WorkerPool parallelism
+};
+
+/**
+ * ThermalReading - One pass over the sysfs thermal zones and CPU frequencies.
+ */
+struct ThermalReading {
+    bool valid = false;        // false: no usable thermal zone
+    std::string zone;          // the zone closest to its trip point
+    int tempMilliC = 0;
+    int tripMilliC = 0;
+    int headroomMilliC = 0;    // trip minus the extrapolated temperature, smallest over all zones
+    double slopeCPerS = 0;     // of that zone
+    int curFreqKHz = 0;        // highest current frequency over the CPUs, 0 if unknown
+    int maxFreqKHz = 0;        // lowest scaling_max_freq over the CPUs, 0 if unknown
+};
+
+/**
+ * ThermalMonitor - Watches the Jetson's temperatures and backs off the vision loop before the kernel throttles it.
+ *
+ * A thread reads <sysfs>/class/thermal/thermal_zone* (temp, type, passive trip points) and
+ * <sysfs>/devices/system/cpu/cpuN/cpufreq every THERMAL_POLL_MS. The level comes from the smallest headroom between a
+ * zone's temperature, extrapolated THERMAL_LOOKAHEAD_S ahead while it rises, and its first passive trip point. A CPU max
+ * frequency cap that appeared after start means throttling has already begun and forces at least THERMAL_HOT.
+ * The PMIC-Die zone (a fixed 100C on the Nano) and fan estimate zones are ignored.
+ *
+ * The vision loop reads policy() every frame; it is a single atomic load. Every change of level is printed with the
+ * reading that caused it.
+ */
+class ThermalMonitor {
+public:
+    /**
+     * @param sysfsRoot Normally "/sys"; a directory with the same layout for testing.
+     * @param baseInterval Detection interval at THERMAL_NORMAL.
+     * @param baseWorkers Worker count at THERMAL_NORMAL.
+     */
+    ThermalMonitor(const std::string &sysfsRoot, int baseInterval, int baseWorkers);
+    ~ThermalMonitor();
+
+    ThermalPolicy policy() const { return policyFor(level.load(std::memory_order_relaxed)); }
+    ThermalPolicy policyFor(ThermalLevel level) const;
+
+    /**
+     * describe - The current reading and policy, plus the level changes since the last call, for the stats output.
+     */
+    std::string describe();
+
+    static const char *levelName(ThermalLevel level);
+
+private:
+    struct Zone {
+        std::string path;
+        std::string type;
+        int tripMilliC;
+        int lastMilliC = 0;
+        double slopeCPerS = 0;
+        bool seen = false;
+    };
+
+    void findZones();
+    ThermalReading read();
+    ThermalLevel decide(const ThermalReading &reading) const;
+    void monitorLoop();
+
+    std::string root;
+    int baseInterval;
+    int baseWorkers;
+    std::vector<Zone> zones;
+    int startMaxFreqKHz = 0;
+    std::chrono::steady_clock::time_point lastPoll;
+
+    std::atomic<ThermalLevel> level{THERMAL_NORMAL};
+
+    std::mutex lock; // guards everything below
+    std::condition_variable wake;
+    bool stopping = false;
+    ThermalReading lastReading;
+    unsigned long changes = 0;
+    unsigned long reportedChanges = 0;
+
+    std::thread monitorThread;
+};
+
+#endif
@@ -0,0 +1,148 @@
+#include "ThreadPolicy.h"
+
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <mutex>
+#include <set>
+#include <sstream>
+
+static std::mutex policiesLock;
+static std::map<std::string, ThreadPolicy> policies;
+static std::set<std::string> reportedRoles;
+
+/**
+ * ParseCpuList - "0,2-3" into {0, 2, 3}.
+ */
+static bool ParseCpuList(const std::string &list, std::vector<int> &cpus) {
+    std::stringstream ss(list);
+    std::string item;
+    while (std::getline(ss, item, ',')) {
+        int first, last;
+        char dash;
+        std::stringstream range(item);
+        if (!(range >> first)) {
+            return false;
+        }
+        last = first;
+        if (range >> dash && (dash != '-' || !(range >> last))) {
+            return false;
+        }
+        if (first < 0 || last < first || last >= CPU_SETSIZE) {
+            return false;
+        }
+        for (int cpu = first; cpu <= last; cpu++) {
+            cpus.push_back(cpu);
+        }
+    }
+    return !cpus.empty();
+}
+
+bool parseThreadPolicy(const char *spec) {
+    std::string text(spec);
+    size_t equals = text.find('=');
+    if (equals == std::string::npos || equals == 0) {
+        return false;
+    }
+
+    std::string role = text.substr(0, equals);
+    std::string rest = text.substr(equals + 1);
+    std::string cpuList = rest.substr(0, rest.find(':'));
+    ThreadPolicy policy;
+
+    if (!cpuList.empty() && cpuList != "any" && !ParseCpuList(cpuList, policy.cpus)) {
+        return false;
+    }
+
+    if (rest.find(':') != std::string::npos) {
+        std::string scheduling = rest.substr(rest.find(':') + 1);
+        if (scheduling.compare(0, 4, "fifo") == 0) {
+            policy.fifoPriority = atoi(scheduling.c_str() + 4);
+            if (policy.fifoPriority < sched_get_priority_min(SCHED_FIFO) || policy.fifoPriority > sched_get_priority_max(SCHED_FIFO)) {
+                return false;
+            }
+        } else if (scheduling.compare(0, 4, "nice") == 0) {
+            policy.setNice = true;
+            policy.nice = atoi(scheduling.c_str() + 4);
+        } else {
+            return false;
+        }
+    }
+
+    std::lock_guard<std::mutex> guard(policiesLock);
+    policies[role] = policy;
+    return true;
+}
+
+void applyThreadPolicy(const char *role) {
+    ThreadPolicy policy;
+    bool report;
+    {
+        std::lock_guard<std::mutex> guard(policiesLock);
+        auto found = policies.find(role);
+        if (found == policies.end()) {
+            // Threads started from a SCHED_FIFO thread inherit it; without a policy of their own they go back to normal.
+            int current = sched_getscheduler(0);
+            if (current == SCHED_FIFO || current == SCHED_RR) {
+                sched_param param = {};
+                pthread_setschedparam(pthread_self(), SCHED_OTHER, &param);
+            }
+            return;
+        }
+        policy = found->second;
+        report = reportedRoles.insert(role).second;
+    }
+
+    std::string outcome;
+    char text[160];
+
+    if (!policy.cpus.empty()) {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        for (int cpu : policy.cpus) {
+            CPU_SET(cpu, &set);
+        }
+        int result = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+        outcome += " cpus";
+        for (size_t i = 0; i < policy.cpus.size(); i++) {
+            outcome += (i == 0 ? " " : ",") + std::to_string(policy.cpus[i]);
+        }
+        outcome += result == 0 ? " granted;" : std::string(" ") + strerror(result) + ";";
+    }
+
+    if (policy.fifoPriority > 0) {
+        sched_param param;
+        param.sched_priority = policy.fifoPriority;
+        int result = pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+        snprintf(text, sizeof(text), " SCHED_FIFO %d %s;", policy.fifoPriority, result == 0 ? "granted" : strerror(result));
+        outcome += text;
+    }
+
+    if (policy.setNice) {
+        // On Linux nice is per thread when given a thread id.
+        int result = setpriority(PRIO_PROCESS, syscall(SYS_gettid), policy.nice);
+        snprintf(text, sizeof(text), " nice %d %s;", policy.nice, result == 0 ? "granted" : strerror(errno));
+        outcome += text;
+    }
+
+    if (report) {
+        printf("Thread policy %s:%s\n", role, outcome.c_str());
+    }
+}
+
+bool lockAllMemory() {
+    if (mlockall(MCL_CURRENT | MCL_FUTURE) != 0) {
+        printf("mlockall: %s (raise the memlock limit or run with CAP_IPC_LOCK)\n", strerror(errno));
+        return false;
+    }
+    printf("mlockall: granted, pages will not be swapped or faulted out\n");
+    return true;
+}
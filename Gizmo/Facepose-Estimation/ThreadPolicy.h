@@ -0,0 +1,45 @@
+#ifndef THREADPOLICY_H
+#define THREADPOLICY_H
+
+#include <string>
+#include <vector>
+
+/**
+ * CPU pinning and scheduling for FaceposeEstimation's threads.
+ *
+ * Threads are grouped into roles ("vision" for the capture/detect loop, "workers" for the landmark/pose pool,
+ * "http" for the servo sink that makes the ServoServer requests, "thermal" for the -thermal monitor, "sinks" for the
+ * other event bus sinks, "cameras" for the -camera threads). A policy is set per role from the command line:
+ *
+ *   -sched <role>=<cpus>[:fifo<priority> | :nice<n>]     e.g. -sched vision=1:fifo50 -sched http=0:nice10
+ *
+ * where cpus is a list like "1", "2-3" or "0,2". Each thread applies its role's policy to itself when it starts.
+ * What the kernel refused (SCHED_FIFO needs CAP_SYS_NICE or an rtprio limit, negative nice likewise) is reported and
+ * the thread carries on without it.
+ */
+struct ThreadPolicy {
+    std::vector<int> cpus; // empty: any CPU
+    int fifoPriority = 0;  // > 0: SCHED_FIFO at this priority
+    bool setNice = false;
+    int nice = 0;
+};
+
+/**
+ * parseThreadPolicy - Parses "<role>=<cpus>[:fifo<n>|:nice<n>]" and registers the policy for role.
+ * @return false if spec is malformed.
+ */
+bool parseThreadPolicy(const char *spec);
+
+/**
+ * applyThreadPolicy - Applies role's policy, if one was given, to the calling thread.
+ * The outcome is printed the first time each role is applied. A thread of a role without a policy drops a real-time
+ * class inherited from its creator.
+ */
+void applyThreadPolicy(const char *role);
+
+/**
+ * lockAllMemory - mlockall() of current and future pages, so page faults cannot stall the loop. Prints the outcome.
+ */
+bool lockAllMemory();
+
+#endif
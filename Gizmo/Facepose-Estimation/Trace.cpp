@@ -0,0 +1,202 @@
+#include "Trace.h"
+
+#include <algorithm>
+#include <csignal>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <memory>
+#include <mutex>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <vector>
+
+std::atomic<bool> traceEnabled{false};
+
+struct TraceEvent {
+    const char *name;
+    uint64_t beginNs;
+    uint64_t endNs;
+    int64_t arg;
+    int32_t tid;
+};
+
+/**
+ * TraceRing - One thread's spans. Owned by one thread at a time; handed to a new thread once its owner exits.
+ */
+struct TraceRing {
+    TraceEvent events[TRACE_RING_EVENTS];
+    std::atomic<uint64_t> written{0};
+    std::atomic<bool> inUse{true};
+};
+
+static std::mutex registryLock;
+static std::vector<std::unique_ptr<TraceRing>> rings; // rings are never freed, so a dump can use them after the lock
+static std::vector<std::pair<int32_t, std::string>> threadNames;
+
+static volatile sig_atomic_t dumpRequested = 0;
+static std::string signalDumpPath;
+
+/**
+ * TraceRingHandle - The calling thread's ring, released for reuse when the thread exits.
+ */
+struct TraceRingHandle {
+    TraceRing *ring = nullptr;
+    int32_t tid = 0;
+
+    ~TraceRingHandle() {
+        if (ring) {
+            ring->inUse.store(false, std::memory_order_release);
+        }
+    }
+};
+
+static thread_local TraceRingHandle currentRing;
+
+static TraceRingHandle &ThreadRing() {
+    if (currentRing.ring) {
+        return currentRing;
+    }
+
+    currentRing.tid = (int32_t)syscall(SYS_gettid);
+
+    std::lock_guard<std::mutex> guard(registryLock);
+    for (auto &ring : rings) {
+        bool expected = false;
+        if (ring->inUse.compare_exchange_strong(expected, true)) {
+            currentRing.ring = ring.get();
+            return currentRing;
+        }
+    }
+    rings.push_back(std::unique_ptr<TraceRing>(new TraceRing()));
+    currentRing.ring = rings.back().get();
+    return currentRing;
+}
+
+uint64_t traceNowNs() {
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+void traceRecord(const char *name, uint64_t beginNs, uint64_t endNs, int64_t arg) {
+    TraceRingHandle &handle = ThreadRing();
+    TraceRing *ring = handle.ring;
+
+    uint64_t index = ring->written.load(std::memory_order_relaxed);
+    ring->events[index % TRACE_RING_EVENTS] = {name, beginNs, endNs, arg, handle.tid};
+    ring->written.store(index + 1, std::memory_order_release);
+}
+
+void traceSetThreadName(const char *name) {
+    if (!traceEnabled.load(std::memory_order_relaxed)) {
+        return; // a ring per thread is only worth its memory when tracing
+    }
+    int32_t tid = ThreadRing().tid;
+    std::lock_guard<std::mutex> guard(registryLock);
+    threadNames.push_back({tid, name});
+}
+
+/**
+ * CopyRing - The spans of one ring that are certainly intact.
+ */
+static void CopyRing(const TraceRing &ring, std::vector<TraceEvent> &out) {
+    uint64_t before = ring.written.load(std::memory_order_acquire);
+    uint64_t first = (before > TRACE_RING_EVENTS) ? before - TRACE_RING_EVENTS : 0;
+
+    size_t start = out.size();
+    for (uint64_t i = first; i < before; ++i) {
+        out.push_back(ring.events[i % TRACE_RING_EVENTS]);
+    }
+
+    // The owner may have lapped us meanwhile. Everything at or below after - TRACE_RING_EVENTS may be torn.
+    std::atomic_thread_fence(std::memory_order_acquire);
+    uint64_t after = ring.written.load(std::memory_order_relaxed);
+    if (after >= first + TRACE_RING_EVENTS) {
+        size_t torn = std::min<uint64_t>(after - TRACE_RING_EVENTS + 1 - first, before - first);
+        out.erase(out.begin() + start, out.begin() + start + torn);
+    }
+}
+
+static void WriteJsonString(FILE *file, const char *text) {
+    fputc('"', file);
+    for (const char *c = text; *c; ++c) {
+        if (*c == '"' || *c == '\\') {
+            fputc('\\', file);
+        }
+        fputc(*c, file);
+    }
+    fputc('"', file);
+}
+
+long traceDump(const std::string &path) {
+    std::vector<const TraceRing *> snapshot;
+    std::vector<std::pair<int32_t, std::string>> names;
+    {
+        std::lock_guard<std::mutex> guard(registryLock);
+        for (const auto &ring : rings) {
+            snapshot.push_back(ring.get());
+        }
+        names = threadNames;
+    }
+
+    std::vector<TraceEvent> events;
+    for (const TraceRing *ring : snapshot) {
+        CopyRing(*ring, events);
+    }
+
+    std::string tmpPath = path + ".tmp";
+    FILE *file = fopen(tmpPath.c_str(), "w");
+    if (!file) {
+        perror("Trace dump");
+        return -1;
+    }
+
+    int pid = getpid();
+    fprintf(file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+    bool first = true;
+    for (const auto &name : names) {
+        fprintf(file, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":%d,\"args\":{\"name\":", first ? "" : ",\n",
+                pid, name.first);
+        WriteJsonString(file, name.second.c_str());
+        fprintf(file, "}}");
+        first = false;
+    }
+    for (const TraceEvent &event : events) {
+        fprintf(file, "%s{\"name\":", first ? "" : ",\n");
+        WriteJsonString(file, event.name);
+        fprintf(file, ",\"ph\":\"X\",\"pid\":%d,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f", pid, event.tid, event.beginNs / 1000.0,
+                (event.endNs - event.beginNs) / 1000.0);
+        if (event.arg != TRACE_NO_ARG) {
+            fprintf(file, ",\"args\":{\"arg\":%lld}", (long long)event.arg);
+        }
+        fputc('}', file);
+        first = false;
+    }
+    fprintf(file, "\n]}\n");
+
+    if (fclose(file) != 0 || rename(tmpPath.c_str(), path.c_str()) != 0) {
+        perror("Trace dump");
+        return -1;
+    }
+    return (long)events.size();
+}
+
+static void RequestDump(int) { dumpRequested = 1; }
+
+void traceDumpOnSignal(int signum, const std::string &path) {
+    signalDumpPath = path;
+    signal(signum, RequestDump);
+}
+
+void traceDumpIfRequested() {
+    if (!dumpRequested) {
+        return;
+    }
+    dumpRequested = 0;
+
+    long spans = traceDump(signalDumpPath);
+    if (spans >= 0) {
+        fprintf(stderr, "Wrote %ld spans to %s\n", spans, signalDumpPath.c_str());
+    }
+}
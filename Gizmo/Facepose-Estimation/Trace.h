@@ -0,0 +1,80 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+/**
+ * Span tracing for the vision loop, exported as Chrome trace-event JSON (open it in https://ui.perfetto.dev).
+ *
+ * TRACE_SPAN("detect") times the rest of the enclosing scope. Each thread appends its finished spans to its own
+ * ring of TRACE_RING_EVENTS, so recording is two clock reads and a store with no locks; once a ring is full the
+ * oldest spans are overwritten. With tracing off a span is one relaxed load.
+ *
+ * traceDump() writes what the rings hold. It may run while other threads keep tracing; spans that were being
+ * overwritten during the copy are left out.
+ */
+#define TRACE_RING_EVENTS 16384
+
+#define TRACE_CONCAT_INNER(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_INNER(a, b)
+#define TRACE_SPAN(name) TraceSpan TRACE_CONCAT(traceSpan, __LINE__)(name)
+#define TRACE_SPAN_ARG(name, arg) TraceSpan TRACE_CONCAT(traceSpan, __LINE__)(name, arg)
+
+extern std::atomic<bool> traceEnabled;
+
+uint64_t traceNowNs();
+
+/**
+ * traceRecord - Appends a finished span to the calling thread's ring.
+ *
+ * @param name A string literal; only the pointer is kept.
+ * @param arg Shown as the span's "arg" in the viewer (e.g. the frame number), or TRACE_NO_ARG.
+ */
+void traceRecord(const char *name, uint64_t beginNs, uint64_t endNs, int64_t arg);
+
+#define TRACE_NO_ARG INT64_MIN
+
+class TraceSpan {
+public:
+    TraceSpan(const char *name, int64_t arg = TRACE_NO_ARG) : name(name), arg(arg) {
+        if (traceEnabled.load(std::memory_order_relaxed)) {
+            beginNs = traceNowNs();
+        }
+    }
+
+    ~TraceSpan() {
+        if (beginNs) {
+            traceRecord(name, beginNs, traceNowNs(), arg);
+        }
+    }
+
+    TraceSpan(const TraceSpan &) = delete;
+    TraceSpan &operator=(const TraceSpan &) = delete;
+
+private:
+    const char *name;
+    int64_t arg;
+    uint64_t beginNs = 0;
+};
+
+/**
+ * traceSetThreadName - Names the calling thread's track in the viewer.
+ */
+void traceSetThreadName(const char *name);
+
+/**
+ * traceDump - Writes every span still in the rings to path as Chrome trace-event JSON.
+ * @return The number of spans written, or -1 if the file could not be written.
+ */
+long traceDump(const std::string &path);
+
+/**
+ * traceDumpOnSignal - Makes signum (e.g. SIGUSR1) request a dump to path. The dump itself happens in
+ * traceDumpIfRequested(), which the main loop calls once per frame, since a signal handler cannot do file I/O.
+ */
+void traceDumpOnSignal(int signum, const std::string &path);
+void traceDumpIfRequested();
+
+#endif
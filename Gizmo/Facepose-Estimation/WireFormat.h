@@ -0,0 +1,42 @@
+#ifndef WIREFORMAT_H
+#define WIREFORMAT_H
+
+#include <cstdint>
+#include <cstring>
+
+// Little-endian field helpers shared by the binary protocols (aim datagrams, commander messages).
+
+inline void putLe(uint8_t *buf, uint64_t value, int bytes)
+{
+   for (int i = 0; i < bytes; i++)
+   {
+      buf[i] = (uint8_t)(value >> (8 * i));
+   }
+}
+
+inline uint64_t getLe(const uint8_t *buf, int bytes)
+{
+   uint64_t value = 0;
+   for (int i = 0; i < bytes; i++)
+   {
+      value |= (uint64_t)buf[i] << (8 * i);
+   }
+   return value;
+}
+
+inline void putFloatLe(uint8_t *buf, float value)
+{
+   uint32_t bits;
+   memcpy(&bits, &value, sizeof(bits));
+   putLe(buf, bits, 4);
+}
+
+inline float getFloatLe(const uint8_t *buf)
+{
+   uint32_t bits = (uint32_t)getLe(buf, 4);
+   float value;
+   memcpy(&value, &bits, sizeof(value));
+   return value;
+}
+
+#endif
@@ -0,0 +1,131 @@
+#include "WorkerPool.h"
+#include "ThreadPolicy.h"
+
+#include <algorithm>
+
+WorkerPool::WorkerPool(int threads, const char *role) : limit(std::max(1, threads)) {
+    for (int i = 1; i < threads; i++) {
+        workers.emplace_back(&WorkerPool::workerLoop, this, i, role);
+    }
+}
+
+WorkerPool::~WorkerPool() {
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        stopping = true;
+    }
+    start.notify_all();
+    for (auto &worker : workers) {
+        worker.join();
+    }
+}
+
+void WorkerPool::parallelFor(size_t count, const std::function<void(size_t)> &job) {
+    if (count == 0) {
+        return;
+    }
+    if (count == 1 || limit.load() <= 1) { // nothing to share, skip the hand-off
+        for (size_t i = 0; i < count; i++) {
+            job(i);
+        }
+        return;
+    }
+
+    {
+        std::unique_lock<std::mutex> turn(turnLock);
+        unsigned long ticket = nextTurn++;
+        turnOver.wait(turn, [&] { return currentTurn == ticket; });
+    }
+    // The turn passes on however this call ends, or every other caller would wait for it forever.
+    struct TurnGuard {
+        WorkerPool *pool;
+        ~TurnGuard() { pool->endTurn(); }
+    } turnGuard{this};
+
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        this->job = &job;
+        this->count = count;
+        next = 0;
+        done = 0;
+        failure = nullptr;
+        generation++;
+    }
+    start.notify_all();
+
+    size_t ran = runJobs(job, count);
+
+    std::unique_lock<std::mutex> guard(lock);
+    done += ran;
+    // Wait for stragglers as well, so no worker can still be claiming indices when the next batch is set up.
+    finished.wait(guard, [this] { return done == this->count && active == 0; });
+    this->job = nullptr;
+    std::exception_ptr thrown = failure;
+    failure = nullptr;
+    guard.unlock();
+
+    if (thrown) {
+        std::rethrow_exception(thrown);
+    }
+}
+
+void WorkerPool::endTurn() {
+    {
+        std::lock_guard<std::mutex> turn(turnLock);
+        currentTurn++;
+    }
+    turnOver.notify_all();
+}
+
+size_t WorkerPool::runJobs(const std::function<void(size_t)> &job, size_t count) {
+    size_t ran = 0;
+    for (size_t i = next++; i < count; i = next++) {
+        try {
+            job(i);
+        } catch (...) {
+            std::lock_guard<std::mutex> guard(lock);
+            if (!failure) {
+                failure = std::current_exception();
+            }
+        }
+        ran++; // counted either way, so the batch still drains
+    }
+    return ran;
+}
+
+void WorkerPool::setParallelism(int threads) {
+    limit.store(std::max(1, std::min(threads, size())));
+}
+
+void WorkerPool::workerLoop(int index, const char *role) {
+    if (role) {
+        applyThreadPolicy(role);
+    }
+
+    unsigned long seen = 0;
+    while (true) {
+        const std::function<void(size_t)> *job;
+        size_t count;
+        {
+            std::unique_lock<std::mutex> guard(lock);
+            start.wait(guard, [&] { return stopping || (generation != seen && this->job != nullptr); });
+            if (stopping) {
+                return;
+            }
+            seen = generation;
+            if (index >= limit.load()) {
+                continue; // not needed for this batch
+            }
+            job = this->job;
+            count = this->count;
+            active++;
+        }
+
+        size_t ran = runJobs(*job, count);
+
+        std::lock_guard<std::mutex> guard(lock);
+        done += ran;
+        active--;
+        finished.notify_one();
+    }
+}
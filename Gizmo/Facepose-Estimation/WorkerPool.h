@@ -0,0 +1,74 @@
+#ifndef WORKERPOOL_H
+#define WORKERPOOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+ * WorkerPool - A fixed set of threads, started once, that run indexed jobs for the vision loop.
+ *
+ * parallelFor() hands out indices 0..count-1 to the workers and to the calling thread, and returns once every
+ * job has finished. Jobs write their results by index, so the caller sees them in index order no matter which
+ * thread ran what.
+ *
+ * Several threads (one per camera) may call parallelFor(). Their batches take turns in the order they were asked for,
+ * so a camera with many faces cannot keep the workers from another one for more than a batch.
+ *
+ * A job that throws does not stop the others: the batch still runs to the end, and then the first exception is
+ * rethrown from parallelFor() on the calling thread.
+ */
+class WorkerPool {
+public:
+    /**
+     * @param threads Total parallelism including the calling thread; threads - 1 workers are started.
+     * @param role Thread policy role the workers apply when they start (see ThreadPolicy.h), or nullptr.
+     */
+    WorkerPool(int threads, const char *role = nullptr);
+    ~WorkerPool();
+
+    void parallelFor(size_t count, const std::function<void(size_t)> &job);
+
+    int size() const { return (int)workers.size() + 1; }
+
+    /**
+     * setParallelism - Limits later parallelFor() calls to threads threads (including the caller), between 1 and size().
+     * Idle workers stay parked, so this is cheap to change between batches.
+     */
+    void setParallelism(int threads);
+    int parallelism() const { return limit.load(); }
+
+private:
+    void workerLoop(int index, const char *role);
+    size_t runJobs(const std::function<void(size_t)> &job, size_t count);
+    void endTurn();
+
+    std::vector<std::thread> workers;
+
+    std::mutex lock;
+    std::condition_variable start;
+    std::condition_variable finished;
+    bool stopping = false;
+    unsigned long generation = 0;
+
+    const std::function<void(size_t)> *job = nullptr;
+    size_t count = 0;
+    std::atomic<size_t> next{0};
+    size_t done = 0;
+    int active = 0; // workers inside the current batch
+    std::exception_ptr failure; // the first exception a job of the current batch threw
+    std::atomic<int> limit; // workers with an index at or above this sit batches out
+
+    // Turns of the callers, first come first served.
+    std::mutex turnLock;
+    std::condition_variable turnOver;
+    unsigned long nextTurn = 0;
+    unsigned long currentTurn = 0;
+};
+
+#endif
@@ -1 +1,9 @@
-clang++ -std=c++17 webcam_head_pose.cpp TcpSocket.cpp -g3 -ggdb -O3 -I/usr/local/lib/JetsonGPIO/include/ -I/usr/local/include/opencv4/ -I/usr/local/include/ -L/usr/local/lib/ -lpthread -lopencv_video -lopencv_core -lopencv_videoio -lopencv_highgui -lopencv_imgproc -lopencv_calib3d -ldlib -llapack -lblas -lgif -o FaceposeEstimation.exe
+clang++ -std=c++17 webcam_head_pose.cpp TcpSocket.cpp AimSocket.cpp CommanderMessage.cpp FrameBus.cpp MjpegStreamer.cpp WorkerPool.cpp I2cDevice.cpp Pca9685.cpp QuantizedShapePredictor.cpp FastDownsample.cpp SessionFile.cpp Trace.cpp PerfCounters.cpp ThreadPolicy.cpp ThermalMonitor.cpp DualCapture.cpp LandmarkView.cpp FramePool.cpp EventBus.cpp Log.cpp Latency.cpp -g3 -ggdb -O3 -I/usr/local/lib/JetsonGPIO/include/ -I/usr/local/include/opencv4/ -I/usr/local/include/ -L/usr/local/lib/ -lpthread -lrt -lopencv_video -lopencv_core -lopencv_videoio -lopencv_highgui -lopencv_imgproc -lopencv_imgcodecs -lopencv_calib3d $(pkg-config --cflags --libs gstreamer-app-1.0 gstreamer-video-1.0) -ldlib -llapack -lblas -lgif -o FaceposeEstimation.exe
+clang++ -std=c++17 shape_quantizer.cpp QuantizedShapePredictor.cpp -O3 -I/usr/local/include/opencv4/ -I/usr/local/include/ -L/usr/local/lib/ -lpthread -lopencv_core -lopencv_imgproc -lopencv_imgcodecs -lopencv_videoio -ldlib -llapack -lblas -lgif -o shape_quantizer
+clang++ -std=c++17 downsample_bench.cpp FastDownsample.cpp -O3 -I/usr/local/include/opencv4/ -L/usr/local/lib/ -lopencv_core -lopencv_imgproc -lopencv_imgcodecs -o downsample_bench
+clang++ -std=c++17 landmark_bench.cpp LandmarkView.cpp QuantizedShapePredictor.cpp -O3 -I/usr/local/include/opencv4/ -I/usr/local/include/ -L/usr/local/lib/ -lpthread -lopencv_core -lopencv_imgproc -lopencv_imgcodecs -lopencv_videoio -ldlib -llapack -lblas -lgif -o landmark_bench
+clang++ -std=c++17 log_decode.cpp Log.cpp -O3 -lpthread -o log_decode
+clang++ -std=c++17 servo_standin.cpp AimSocket.cpp I2cDevice.cpp Pca9685.cpp Log.cpp -O3 -lpthread -o servo_standin
+clang++ -std=c++17 servo_check.cpp I2cDevice.cpp Pca9685.cpp Log.cpp -O3 -lpthread -o servo_check
+clang++ -std=c++17 commander_standin.cpp CommanderStandIn.cpp CommanderMessage.cpp AimSocket.cpp -O3 -lpthread -o commander_standin
+clang++ -std=c++17 commander_bench.cpp CommanderStandIn.cpp CommanderMessage.cpp AimSocket.cpp TcpSocket.cpp EventBus.cpp ThreadPolicy.cpp Trace.cpp Log.cpp -O3 -lpthread -o commander_bench
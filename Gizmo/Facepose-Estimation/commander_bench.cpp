@@ -0,0 +1,250 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "AimSocket.h"
+#include "CommanderMessage.h"
+#include "CommanderStandIn.h"
+#include "EventBus.h"
+#include "Latency.h"
+#include "TcpSocket.h"
+
+/**
+ * commander_bench - How much a misbehaving GizmoCommander costs the vision loop.
+ *
+ *   commander_bench [-port <port>] [-fps <fps>] [-framems <ms>] [-faces <n>] [-seconds <s>] [-sndbuf <bytes>] [-ascii]
+ *
+ * Runs a CommanderStandIn on -port with each of a fixed set of faults in turn and connects to it with TcpSocket, as
+ * FaceposeEstimation does, with its send buffer fixed at -sndbuf (default 4096, 0 for the kernel's own) so that a
+ * reader that falls behind fills it within a run; on loopback the kernel otherwise grows it to megabytes, which take
+ * minutes of decisions to fill. A stand-in vision loop then works -framems of every frame at up to -fps and reports -faces
+ * decisions per frame for -seconds, twice: sending them from the loop itself (how the loop worked before the event bus)
+ * and publishing them to an EventBus whose commander sink sends them (how it works now).
+ *
+ * Every face is sent every frame, a CommanderMessage each (or one byte with -ascii), which is the most -commander binary
+ * can ever send. The link reconnects after a failed send, as FaceposeEstimation's does. For each fault and way of
+ * sending, the frame rate the loop kept up, its frame times, the sends that failed, the reconnections, the messages
+ * that arrived, and the events the sink lost because it fell behind are printed.
+ */
+
+struct Scenario
+{
+    const char *name;
+    CommanderFaults faults;
+};
+
+struct BenchConfig
+{
+    const char *port = "26785";
+    double fps = 30;
+    double frameMs = 10;
+    int faces = 4;
+    double seconds = 5;
+    int sendBufferBytes = 4096;
+    bool binary = true;
+};
+
+static std::vector<Scenario> Scenarios()
+{
+    std::vector<Scenario> scenarios;
+    scenarios.push_back({"healthy", CommanderFaults()});
+
+    CommanderFaults slow;
+    slow.readDelayMs = 50;
+    slow.readBytes = 64; // about 1.3 KB/s
+    slow.receiveBufferBytes = 4096;
+    scenarios.push_back({"slow reader", slow});
+
+    CommanderFaults stalled;
+    stalled.receiveBufferBytes = 4096;
+    stalled.stallAfterS = 1;
+    stalled.stallForS = 3; // then reads again, so a loop stuck in send() gets going before the run ends
+    scenarios.push_back({"stalled reader", stalled});
+
+    CommanderFaults resets;
+    resets.resetEveryS = 1;
+    scenarios.push_back({"reset every 1 s", resets});
+
+    CommanderFaults restart;
+    restart.restartEveryS = 1;
+    restart.restartDownS = 1; // up again while the link's backoff is still short, so a run sees it reconnect
+    scenarios.push_back({"restart, 1 s down", restart});
+    return scenarios;
+}
+
+static void SpinFor(double ms)
+{
+    auto until = std::chrono::steady_clock::now() + std::chrono::duration<double, std::milli>(ms);
+    while (std::chrono::steady_clock::now() < until)
+    {
+    }
+}
+
+/**
+ * SendDecision - What SendFacingDecision puts on the link for one face, without the binary mode's change filter.
+ */
+static bool SendDecision(TcpSocket &link, bool binary, const BusEvent &event, uint32_t sequence)
+{
+    if (!binary)
+    {
+        return link.send((char*)(event.facing ? "1" : "0"), 1) == 0;
+    }
+
+    CommanderMessage msg = {};
+    msg.face = (uint8_t)event.face;
+    msg.direction = event.direction;
+    msg.flags = event.facing ? COMMANDER_FLAG_FACING : 0;
+    msg.sequence = sequence;
+    msg.timestampUs = event.captureUs;
+    msg.confidence = 1;
+
+    uint8_t buf[COMMANDER_MESSAGE_SIZE];
+    size_t size = encodeCommanderMessage(msg, buf, sizeof(buf));
+    return link.send((char*)buf, size) == 0;
+}
+
+static void RunScenario(const BenchConfig &config, const Scenario &scenario, bool throughBus)
+{
+    CommanderStandIn standIn(config.port, config.binary, scenario.faults);
+    if (standIn.start() < 0)
+    {
+        std::cerr << "Cannot listen on port " << config.port << std::endl;
+        exit(1);
+    }
+    TcpSocket link(config.port, "127.0.0.1");
+    link.setReconnect(true);
+    if (config.sendBufferBytes > 0)
+    {
+        link.setSendBufferSize(config.sendBufferBytes);
+    }
+
+    std::atomic<unsigned long> sent{0}, failed{0};
+    std::unique_ptr<EventBus> bus;
+    if (throughBus)
+    {
+        bus.reset(new EventBus());
+        uint32_t sequence = 0;
+        bus->addSink("commander", "sinks", [&, sequence](const BusEvent &event, bool) mutable {
+            SendDecision(link, config.binary, event, ++sequence) ? sent++ : failed++;
+        });
+    }
+
+    std::vector<double> frameMs;
+    uint32_t sequence = 0;
+    auto period = std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(1 / config.fps));
+    auto start = std::chrono::steady_clock::now();
+    auto end = start + std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(config.seconds));
+    auto next = start;
+    for (uint64_t frame = 0; std::chrono::steady_clock::now() < end; frame++)
+    {
+        auto frameStart = std::chrono::steady_clock::now();
+        uint64_t captureUs = monotonicMicros();
+        SpinFor(config.frameMs);
+
+        for (int face = 0; face < config.faces; face++)
+        {
+            BusEvent event = {};
+            event.type = BUS_FACE;
+            event.facing = (frame / 30 + face) % 2;
+            event.face = face;
+            event.frameNumber = frame;
+            event.timestampUs = monotonicMicros();
+            event.captureUs = captureUs;
+            if (throughBus)
+            {
+                bus->publish(event);
+            }
+            else
+            {
+                SendDecision(link, config.binary, event, ++sequence) ? sent++ : failed++;
+            }
+        }
+
+        frameMs.push_back(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - frameStart).count());
+        // a frame that overran is not made up for with a burst of frames
+        next = std::max(next + period, std::chrono::steady_clock::now());
+        std::this_thread::sleep_until(next);
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    // Stopping the stand-in resets the connection, which frees a send stuck on a full socket.
+    standIn.stop();
+    std::string lost = "-";
+    if (bus)
+    {
+        bus->stop();
+        lost = std::to_string(bus->lost());
+    }
+
+    size_t frames = frameMs.size();
+    printf("%-20s %-6s %7.1f %8.2f %8.2f %9.1f %8lu %7lu %10lu %9lu %8s\n", scenario.name, throughBus ? "bus" : "inline",
+           frames / seconds, Percentile(frameMs, 0.5), Percentile(frameMs, 0.99), Percentile(frameMs, 1.0), sent.load(),
+           failed.load(), link.reconnects.load(), standIn.messages.load(), lost.c_str());
+}
+
+static void Usage(const char *program)
+{
+    std::cerr << "Usage: " << program << " [-port <port>] [-fps <fps>] [-framems <ms>] [-faces <n>] [-seconds <s>]"
+              << " [-sndbuf <bytes>] [-ascii]"
+              << std::endl;
+}
+
+int main(int argc, char** argv)
+{
+    BenchConfig config;
+    for (int i = 1; i < argc; ++i)
+    {
+        if (strcmp("-port", argv[i]) == 0 && i + 1 < argc)
+        {
+            config.port = argv[++i];
+        }
+        else if (strcmp("-fps", argv[i]) == 0 && i + 1 < argc)
+        {
+            config.fps = std::max(1.0, atof(argv[++i]));
+        }
+        else if (strcmp("-framems", argv[i]) == 0 && i + 1 < argc)
+        {
+            config.frameMs = std::max(0.0, atof(argv[++i]));
+        }
+        else if (strcmp("-faces", argv[i]) == 0 && i + 1 < argc)
+        {
+            config.faces = std::max(1, atoi(argv[++i]));
+        }
+        else if (strcmp("-seconds", argv[i]) == 0 && i + 1 < argc)
+        {
+            config.seconds = std::max(1.0, atof(argv[++i]));
+        }
+        else if (strcmp("-sndbuf", argv[i]) == 0 && i + 1 < argc)
+        {
+            config.sendBufferBytes = std::max(0, atoi(argv[++i]));
+        }
+        else if (strcmp("-ascii", argv[i]) == 0)
+        {
+            config.binary = false;
+        }
+        else
+        {
+            Usage(argv[0]);
+            return 1;
+        }
+    }
+
+    printf("%d faces per frame at up to %.0f fps, %.1f ms of work per frame, %s messages, %.0f s per run\n\n",
+           config.faces, config.fps, config.frameMs, config.binary ? "binary" : "ascii", config.seconds);
+    printf("%-20s %-6s %7s %8s %8s %9s %8s %7s %10s %9s %8s\n", "fault", "sends", "fps", "p50 ms", "p99 ms", "max ms", "sent",
+           "failed", "reconnects", "received", "lost");
+    for (const Scenario &scenario : Scenarios())
+    {
+        RunScenario(config, scenario, false);
+        RunScenario(config, scenario, true);
+    }
+    return 0;
+}
@@ -0,0 +1,180 @@
+#include <signal.h>
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "AimSocket.h"
+#include "CommanderMessage.h"
+#include "CommanderStandIn.h"
+#include "Latency.h"
+
+/**
+ * commander_standin - A GizmoCommander to point FaceposeEstimation's commander link at on a development machine.
+ *
+ *   commander_standin [-port <port>] [-binary] [-readdelay <ms>] [-readbytes <n>] [-rcvbuf <bytes>]
+ *                     [-stall <after s>[:<for s>]] [-reset <every s>] [-restart <every s>[:<down s>]] [-record <file.csv>]
+ *
+ * Listens on -port (default 26784, GIZMO_COMMANDER_PORT) for the connection FaceposeEstimation -commanderaddr makes,
+ * and reads the ascii "0"/"1" bytes, or with -binary the CommanderMessage frames of -commander binary. Messages and bytes
+ * per second are printed every second. Ctrl-C prints totals and, for binary messages, their age on arrival (from the
+ * capture of the frame they were decided on, when sent from this host) and the sequence numbers that never arrived,
+ * and writes every message to -record as CSV.
+ *
+ * Faults: -readdelay and -readbytes make a slow reader; -stall stops reading after a while and, with a small -rcvbuf,
+ * lets the sender's socket fill up; -reset aborts the connection periodically; -restart closes everything and refuses
+ * connections for a while, like a base station program being restarted.
+ */
+
+static void PrintSummary(CommanderStandIn &standIn, const std::vector<CommanderReceipt> &receipts, double seconds)
+{
+    printf("\n%lu messages (%lu bytes) in %.1f s, %lu connections, %lu resets, %lu restarts, %lu corrupt streams\n",
+           standIn.messages.load(), standIn.bytes.load(), seconds, standIn.connections.load(), standIn.resets.load(),
+           standIn.restarts.load(), standIn.corrupt.load());
+
+    std::vector<double> ageUs;
+    unsigned long missing = 0;
+    uint32_t lastSequence = 0;
+    for (const CommanderReceipt &receipt : receipts)
+    {
+        if (!receipt.sentUs)
+        {
+            continue;
+        }
+        ageUs.push_back((double)receipt.receivedUs - (double)receipt.sentUs);
+        if (lastSequence && receipt.sequence > lastSequence + 1)
+        {
+            missing += receipt.sequence - lastSequence - 1;
+        }
+        lastSequence = receipt.sequence;
+    }
+    if (!ageUs.empty())
+    {
+        printf("%lu sequence numbers missing\n", missing);
+        printf("%-28s p50 %8.0f  p99 %8.0f  max %8.0f us\n", "stamp to received", Percentile(ageUs, 0.5),
+               Percentile(ageUs, 0.99), Percentile(ageUs, 1.0));
+    }
+}
+
+static bool WriteRecord(const std::string &path, const std::vector<CommanderReceipt> &receipts)
+{
+    FILE *file = fopen(path.c_str(), "w");
+    if (!file)
+    {
+        return false;
+    }
+    fprintf(file, "received_s,stamp_s,sequence,face,facing,heartbeat,lost\n");
+    for (const CommanderReceipt &receipt : receipts)
+    {
+        fprintf(file, "%.6f,%.6f,%u,%u,%d,%d,%d\n", receipt.receivedUs / 1e6, receipt.sentUs / 1e6, receipt.sequence,
+                receipt.face, (receipt.flags & COMMANDER_FLAG_FACING) ? 1 : 0,
+                (receipt.flags & COMMANDER_FLAG_HEARTBEAT) ? 1 : 0, (receipt.flags & COMMANDER_FLAG_LOST) ? 1 : 0);
+    }
+    return fclose(file) == 0;
+}
+
+static void Usage(const char *program)
+{
+    std::cerr << "Usage: " << program << " [-port <port>] [-binary] [-readdelay <ms>] [-readbytes <n>] [-rcvbuf <bytes>]"
+              << " [-stall <after s>[:<for s>]] [-reset <every s>] [-restart <every s>[:<down s>]] [-record <file.csv>]"
+              << std::endl;
+}
+
+int main(int argc, char** argv)
+{
+    const char *port = "26784";
+    bool binary = false;
+    std::string record;
+    CommanderFaults faults;
+    for (int i = 1; i < argc; ++i)
+    {
+        if (strcmp("-port", argv[i]) == 0 && i + 1 < argc)
+        {
+            port = argv[++i];
+        }
+        else if (strcmp("-binary", argv[i]) == 0)
+        {
+            binary = true;
+        }
+        else if (strcmp("-readdelay", argv[i]) == 0 && i + 1 < argc)
+        {
+            faults.readDelayMs = std::max(0, atoi(argv[++i]));
+        }
+        else if (strcmp("-readbytes", argv[i]) == 0 && i + 1 < argc)
+        {
+            faults.readBytes = atoi(argv[++i]);
+        }
+        else if (strcmp("-rcvbuf", argv[i]) == 0 && i + 1 < argc)
+        {
+            faults.receiveBufferBytes = std::max(0, atoi(argv[++i]));
+        }
+        else if (strcmp("-stall", argv[i]) == 0 && i + 1 < argc)
+        {
+            sscanf(argv[++i], "%lf:%lf", &faults.stallAfterS, &faults.stallForS);
+        }
+        else if (strcmp("-reset", argv[i]) == 0 && i + 1 < argc)
+        {
+            faults.resetEveryS = std::max(0.0, atof(argv[++i]));
+        }
+        else if (strcmp("-restart", argv[i]) == 0 && i + 1 < argc)
+        {
+            sscanf(argv[++i], "%lf:%lf", &faults.restartEveryS, &faults.restartDownS);
+        }
+        else if (strcmp("-record", argv[i]) == 0 && i + 1 < argc)
+        {
+            record = argv[++i];
+        }
+        else
+        {
+            Usage(argv[0]);
+            return 1;
+        }
+    }
+
+    // Ctrl-C is taken by sigtimedwait below, so the serving thread leaves it alone.
+    sigset_t quitSignals;
+    sigemptyset(&quitSignals);
+    sigaddset(&quitSignals, SIGINT);
+    sigaddset(&quitSignals, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &quitSignals, nullptr);
+
+    CommanderStandIn standIn(port, binary, faults);
+    if (standIn.start() < 0)
+    {
+        std::cerr << "Cannot listen on port " << port << std::endl;
+        return 1;
+    }
+    printf("Commander stand-in on port %s, %s messages\n", port, binary ? "binary" : "ascii");
+
+    uint64_t startUs = monotonicMicros();
+    unsigned long reportedMessages = 0, reportedBytes = 0;
+    for (int second = 1;; ++second)
+    {
+        struct timespec timeout = {1, 0};
+        if (sigtimedwait(&quitSignals, nullptr, &timeout) > 0)
+        {
+            break;
+        }
+        unsigned long messages = standIn.messages.load(), bytes = standIn.bytes.load();
+        printf("%4d s %8lu messages/s %10lu bytes/s\n", second, messages - reportedMessages, bytes - reportedBytes);
+        reportedMessages = messages;
+        reportedBytes = bytes;
+    }
+
+    standIn.stop();
+    std::vector<CommanderReceipt> receipts = standIn.receipts();
+    PrintSummary(standIn, receipts, (monotonicMicros() - startUs) / 1e6);
+    if (!record.empty())
+    {
+        if (!WriteRecord(record, receipts))
+        {
+            std::cerr << "Cannot write " << record << std::endl;
+            return 1;
+        }
+        printf("%zu messages written to %s\n", receipts.size(), record.c_str());
+    }
+    return 0;
+}
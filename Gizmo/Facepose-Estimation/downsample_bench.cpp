@@ -0,0 +1,82 @@
+#include <opencv2/core.hpp>
+#include <opencv2/imgproc.hpp>
+#include <opencv2/imgcodecs.hpp>
+#include "FastDownsample.h"
+
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+
+#define BENCH_ITERATIONS 500
+
+/**
+ * Downsample benchmark - Times what the vision loop did per frame before FastDownsample against FastDownsample.
+ *
+ *   downsample_bench [frame.png] [iterations]
+ *
+ * Without a frame a random 1280x720 one is used. The reference is the old loop: cv::resize to 1/4 for detection,
+ * the BGR to gray conversion dlib does on it for HOG, and cv::resize to 1/2 for the window.
+ */
+
+static double MicrosPerFrame(std::chrono::steady_clock::time_point start, int iterations) {
+    return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count() / iterations;
+}
+
+int main(int argc, char **argv) {
+    cv::Mat frame;
+    if (argc > 1) {
+        frame = cv::imread(argv[1]);
+    }
+    if (frame.empty()) {
+        frame.create(720, 1280, CV_8UC3);
+        cv::randu(frame, cv::Scalar::all(0), cv::Scalar::all(255));
+    }
+    int iterations = (argc > 2) ? atoi(argv[2]) : BENCH_ITERATIONS;
+
+    cv::Mat small, smallGray, display, fastGray, fastDisplay;
+
+    // Warm up caches and let both paths allocate their outputs.
+    cv::resize(frame, small, cv::Size(), 1.0 / FAST_DOWNSAMPLE_RATIO, 1.0 / FAST_DOWNSAMPLE_RATIO);
+    cv::cvtColor(small, smallGray, cv::COLOR_BGR2GRAY);
+    cv::resize(frame, display, cv::Size(), 0.5, 0.5);
+    FastDownsample(frame, fastGray, &fastDisplay);
+
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < iterations; ++i) {
+        cv::resize(frame, small, cv::Size(), 1.0 / FAST_DOWNSAMPLE_RATIO, 1.0 / FAST_DOWNSAMPLE_RATIO);
+        cv::cvtColor(small, smallGray, cv::COLOR_BGR2GRAY);
+    }
+    double cvDetect = MicrosPerFrame(start, iterations);
+
+    start = std::chrono::steady_clock::now();
+    for (int i = 0; i < iterations; ++i) {
+        cv::resize(frame, display, cv::Size(), 0.5, 0.5);
+    }
+    double cvDisplay = MicrosPerFrame(start, iterations);
+
+    start = std::chrono::steady_clock::now();
+    for (int i = 0; i < iterations; ++i) {
+        FastDownsample(frame, fastGray);
+    }
+    double fastDetect = MicrosPerFrame(start, iterations);
+
+    start = std::chrono::steady_clock::now();
+    for (int i = 0; i < iterations; ++i) {
+        FastDownsample(frame, fastGray, &fastDisplay);
+    }
+    double fastBoth = MicrosPerFrame(start, iterations);
+
+    // The 1/2 image is a 2x2 box filter, which is exactly what cv::resize does at 0.5.
+    double displayDiff = cv::norm(display, fastDisplay, cv::NORM_INF);
+    cv::Mat areaSmall, areaGray;
+    cv::resize(frame, areaSmall, cv::Size(), 1.0 / FAST_DOWNSAMPLE_RATIO, 1.0 / FAST_DOWNSAMPLE_RATIO, cv::INTER_AREA);
+    cv::cvtColor(areaSmall, areaGray, cv::COLOR_BGR2GRAY);
+    double grayDiff = cv::norm(areaGray, fastGray, cv::NORM_INF);
+
+    printf("%dx%d, %d iterations, %s kernel\n", frame.cols, frame.rows, iterations, FastDownsampleIsa());
+    printf("detection only:  OpenCV %8.1f us   fused %8.1f us   %.2fx\n", cvDetect, fastDetect, cvDetect / fastDetect);
+    printf("with display:    OpenCV %8.1f us   fused %8.1f us   %.2fx\n", cvDetect + cvDisplay, fastBoth,
+           (cvDetect + cvDisplay) / fastBoth);
+    printf("max difference:  display %.0f, gray vs INTER_AREA %.0f (levels)\n", displayDiff, grayDiff);
+    return 0;
+}
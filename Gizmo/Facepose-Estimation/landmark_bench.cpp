@@ -0,0 +1,198 @@
+#include <dlib/opencv.h>
+#include <opencv2/opencv.hpp>
+#include <dlib/image_processing/frontal_face_detector.h>
+#include <dlib/image_processing.h>
+#include "LandmarkView.h"
+#include "QuantizedShapePredictor.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// Only every Nth frame of a video is evaluated; neighbouring frames hardly differ.
+#define VIDEO_FRAME_STRIDE 10
+// Faces are detected at 1/4 scale, as in the vision loop.
+#define BENCH_DETECT_RATIO 4
+
+/**
+ * Landmark benchmark - Speed and accuracy of landmarking at reduced scales and on normalised face crops.
+ *
+ *   landmark_bench <model.dat | model.qsp> <image or video>...
+ *
+ * Every detected face is landmarked on the full frame (the reference), on the whole frame resized to 3/4, 1/2 and 3/8
+ * (-landmarkscale) and on crops with the face scaled to 160, 128, 96 and 64 pixels wide (-landmarkcrop). For each the
+ * time per face (including the resize, spread over the frame's faces) and the error against the reference is printed:
+ * of the six PnP points in frame pixels, and of all 68 points relative to the outer eye corner distance.
+ */
+
+struct Config {
+    std::string name;
+    double scale;  // ScaledView scale
+    int cropWidth; // 0: no crop
+    unsigned long faces = 0;
+    double seconds = 0;
+    double sumPnpPixels = 0; // over faces, mean of the six points
+    double maxPnpPixels = 0;
+    double sumNormalised = 0;
+    double maxNormalised = 0;
+};
+
+// The points EstimateFacePose hands to solvePnP: nose tip, chin, outer eye corners, mouth corners.
+static const unsigned long PnpParts[] = {30, 8, 36, 45, 48, 54};
+
+static double Seconds(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+/**
+ * Landmark - The landmarks of one face found through view, in frame pixels, with the PnP points unrounded.
+ */
+template <typename Model>
+static dlib::full_object_detection Landmark(const Model &model, const LandmarkView &frameView, const dlib::rectangle &face,
+                                            int cropWidth, std::vector<cv::Point2d> &pnpPoints) {
+    double ratio = BENCH_DETECT_RATIO / frameView.scale;
+    dlib::rectangle r((long)(face.left() * ratio), (long)(face.top() * ratio), (long)(face.right() * ratio), (long)(face.bottom() * ratio));
+
+    LandmarkView crop;
+    const LandmarkView *view = &frameView;
+    if (cropWidth) {
+        r = CropView(frameView, r, cropWidth, crop);
+        view = &crop;
+    }
+    dlib::full_object_detection shape = model(dlib::cv_image<dlib::bgr_pixel>(view->image), r);
+
+    pnpPoints.clear();
+    for (unsigned long part : PnpParts) {
+        pnpPoints.push_back(view->toFrame(cv::Point2d(shape.part(part).x(), shape.part(part).y())));
+    }
+    MapShape(*view, shape);
+    return shape;
+}
+
+template <typename Model>
+static void BenchImage(const Model &model, const cv::Mat &image, dlib::frontal_face_detector &detector, std::vector<Config> &configs) {
+    cv::Mat small;
+    cv::resize(image, small, cv::Size(), 1.0 / BENCH_DETECT_RATIO, 1.0 / BENCH_DETECT_RATIO);
+    std::vector<dlib::rectangle> faces = detector(dlib::cv_image<dlib::bgr_pixel>(small));
+    if (faces.empty()) {
+        return;
+    }
+
+    std::vector<std::vector<cv::Point2d>> referencePnp(faces.size());
+    std::vector<dlib::full_object_detection> reference(faces.size());
+    std::vector<cv::Point2d> pnp;
+
+    for (Config &config : configs) {
+        auto start = std::chrono::steady_clock::now();
+        LandmarkView frameView;
+        ScaledView(image, 1.0, config.scale, frameView);
+
+        std::vector<dlib::full_object_detection> shapes(faces.size());
+        std::vector<std::vector<cv::Point2d>> pnps(faces.size());
+        for (size_t i = 0; i < faces.size(); ++i) {
+            shapes[i] = Landmark(model, frameView, faces[i], config.cropWidth, pnps[i]);
+        }
+        config.seconds += Seconds(start);
+        config.faces += faces.size();
+
+        if (&config == &configs.front()) { // the full frame, which the others are measured against
+            reference = shapes;
+            referencePnp = pnps;
+        }
+
+        for (size_t i = 0; i < faces.size(); ++i) {
+            double pnpSum = 0;
+            for (size_t p = 0; p < pnps[i].size(); ++p) {
+                double error = cv::norm(pnps[i][p] - referencePnp[i][p]);
+                pnpSum += error;
+                config.maxPnpPixels = std::max(config.maxPnpPixels, error);
+            }
+            config.sumPnpPixels += pnpSum / pnps[i].size();
+
+            double faceSum = 0;
+            for (unsigned long p = 0; p < reference[i].num_parts(); ++p) {
+                faceSum += dlib::length(reference[i].part(p) - shapes[i].part(p));
+            }
+            double interOcular = std::max(1.0, dlib::length(reference[i].part(36) - reference[i].part(45)));
+            double normalised = faceSum / reference[i].num_parts() / interOcular;
+            config.sumNormalised += normalised;
+            config.maxNormalised = std::max(config.maxNormalised, normalised);
+        }
+    }
+}
+
+template <typename Model>
+static int Bench(const Model &model, int inputCount, char **inputs) {
+    std::vector<Config> configs = {
+        {"full frame", 1.0, 0},
+        {"scale 0.75", 0.75, 0},
+        {"scale 0.5", 0.5, 0},
+        {"scale 0.375", 0.375, 0},
+        {"crop 160", 1.0, 160},
+        {"crop 128", 1.0, 128},
+        {"crop 96", 1.0, 96},
+        {"crop 64", 1.0, 64},
+    };
+    dlib::frontal_face_detector detector = dlib::get_frontal_face_detector();
+
+    for (int i = 0; i < inputCount; ++i) {
+        cv::Mat image = cv::imread(inputs[i]);
+        if (!image.empty()) {
+            BenchImage(model, image, detector, configs);
+            continue;
+        }
+
+        cv::VideoCapture video(inputs[i]);
+        if (!video.isOpened()) {
+            std::cerr << "Skipping " << inputs[i] << ": not an image or video" << std::endl;
+            continue;
+        }
+        for (unsigned long frame = 0; video.read(image); ++frame) {
+            if (frame % VIDEO_FRAME_STRIDE == 0) {
+                BenchImage(model, image, detector, configs);
+            }
+        }
+    }
+
+    if (configs.front().faces == 0) {
+        std::cerr << "No faces found, nothing to compare" << std::endl;
+        return 1;
+    }
+
+    printf("%lu faces\n", configs.front().faces);
+    printf("%-12s %12s %10s %16s %16s\n", "", "us per face", "speedup", "PnP px mean/max", "68 pt IOD mean/max");
+    double referenceUs = 1e6 * configs.front().seconds / configs.front().faces;
+    for (const Config &config : configs) {
+        double us = 1e6 * config.seconds / config.faces;
+        printf("%-12s %12.1f %9.2fx %7.2f / %6.2f %7.4f / %7.4f\n", config.name.c_str(), us, referenceUs / us,
+               config.sumPnpPixels / config.faces, config.maxPnpPixels,
+               config.sumNormalised / config.faces, config.maxNormalised);
+    }
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    if (argc < 3) {
+        std::cerr << "Usage: " << argv[0] << " <model.dat | model.qsp> <image or video>..." << std::endl;
+        return 1;
+    }
+
+    try {
+        std::string modelPath = argv[1];
+        if (modelPath.size() > 4 && modelPath.compare(modelPath.size() - 4, 4, ".qsp") == 0) {
+            QuantizedShapePredictor model;
+            model.load(modelPath);
+            return Bench(model, argc - 2, argv + 2);
+        }
+        dlib::shape_predictor model;
+        dlib::deserialize(modelPath) >> model;
+        return Bench(model, argc - 2, argv + 2);
+
+    } catch (std::exception &e) {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+}
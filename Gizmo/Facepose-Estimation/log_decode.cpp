@@ -0,0 +1,38 @@
+#include "Log.h"
+
+#include <cstring>
+#include <iostream>
+
+/**
+ * Log decoder - Prints a binary log written with -logfile as text.
+ *
+ *   log_decode <file> [-level debug | info | warn | error]
+ *
+ * One line per record, in the order written: CLOCK_MONOTONIC seconds (the time base of session files and traces),
+ * level, thread id, source file and line, message.
+ */
+
+static const char *LevelFlags[] = {"debug", "info", "warn", "error"};
+
+int main(int argc, char **argv) {
+    if (argc != 2 && !(argc == 4 && strcmp(argv[2], "-level") == 0)) {
+        std::cerr << "Usage: " << argv[0] << " <file> [-level debug | info | warn | error]" << std::endl;
+        return 1;
+    }
+
+    int minLevel = LOG_LEVEL_DEBUG;
+    if (argc == 4) {
+        minLevel = -1;
+        for (int level = LOG_LEVEL_DEBUG; level <= LOG_LEVEL_ERROR; level++) {
+            if (strcmp(argv[3], LevelFlags[level]) == 0) {
+                minLevel = level;
+            }
+        }
+        if (minLevel < 0) {
+            std::cerr << "Unknown level " << argv[3] << std::endl;
+            return 1;
+        }
+    }
+
+    return logDecode(argv[1], minLevel, stdout) < 0 ? 1 : 0;
+}
@@ -1,43 +1,297 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
 #include <iostream>
+#include <map>
+#include <memory>
 #include <sstream>
+#include <string>
 #include <thread>
-#include <unistd.h>
+#include <vector>
 
 #include "httplib.h"
+#include "AimSocket.h"
+#include "Latency.h"
 
-void do_http_get(std::string host, int port, int pan, int tilt)
+/**
+ * Maia - Load generator for the servo endpoint.
+ *
+ *   Maia [-target <http://host:port | udp:host:port | unix:/path>] [-concurrency <n>] [-rate <requests/s>]
+ *        [-duration <s>] [-noreuse] [-pan <degrees>] [-tilt <degrees>] [-sweep]
+ *
+ * Each of the -concurrency workers sends aims to the target until -duration (default 10 s) is over: GET /aim_camera
+ * for ServoServer's HTTP API, or an aim datagram for the udp: and unix: transports FaceposeEstimation's -aim uses.
+ * Without -rate every worker sends again as soon as it has its answer (a closed loop, which finds the maximum
+ * throughput). With -rate the requests are spread evenly over the workers at that total rate, and their latency is also
+ * measured from when they were due, so a server that falls behind shows in the numbers instead of slowing the test.
+ * Connections (HTTP keep-alive, or the datagram socket) are kept per worker unless -noreuse is given. -sweep moves the pan
+ * back and forth around -pan so the servos actually travel.
+ *
+ * Requests per second are printed every second, then totals, errors by kind and latency percentiles. Datagrams get no
+ * reply, so their latency is the cost of the send and an error is a datagram the kernel would not queue.
+ */
+
+typedef std::chrono::steady_clock Clock;
+
+struct LoadConfig
+{
+    std::string target = "http://localhost:5000";
+    int concurrency = 1;
+    double rate = 0; // total requests per second, 0 for as fast as the target answers
+    double duration = 10;
+    bool reuse = true;
+    int pan = 90;
+    int tilt = 90;
+    bool sweep = false;
+};
+
+struct WorkerResult
 {
-    std::cout << "GET " << host << ":" << port << std::endl;
+    std::vector<double> serviceUs;  // from sending to the answer
+    std::vector<double> responseUs; // from when the request was due to the answer (with -rate)
+    unsigned long ok = 0;
+    std::map<std::string, unsigned long> errors;
+};
 
-    httplib::Client cli(host, port);
+static std::atomic<unsigned long> completed{0};
 
-    std::stringstream uri;
-    uri << "/aim_camera?pan=" << pan << "&tilt=" << tilt;
+static double Micros(Clock::duration duration)
+{
+    return std::chrono::duration<double, std::micro>(duration).count();
+}
 
-    if (auto res = cli.Get(uri.str()))
+static void PrintLatency(const char *what, std::vector<double> &us)
+{
+    printf("%-28s p50 %8.0f  p90 %8.0f  p99 %8.0f  p99.9 %8.0f  max %8.0f us\n", what, Percentile(us, 0.5),
+           Percentile(us, 0.9), Percentile(us, 0.99), Percentile(us, 0.999), Percentile(us, 1.0));
+}
+
+static void RunWorker(const LoadConfig &config, int index, Clock::time_point start, Clock::time_point end, WorkerResult &result)
+{
+    bool http = config.target.compare(0, 7, "http://") == 0;
+    std::string host;
+    int port = 80;
+    if (http)
     {
-        if (res->status == 200)
+        host = config.target.substr(7);
+        size_t colon = host.rfind(':');
+        if (colon != std::string::npos)
         {
-            std::cout << res->body << std::endl;
+            port = atoi(host.c_str() + colon + 1);
+            host.erase(colon);
         }
     }
-    else
+
+    std::unique_ptr<httplib::Client> client;
+    std::unique_ptr<AimSocket> aimSocket;
+
+    // With -rate, worker i of n sends the requests due at start + (k * n + i) / rate.
+    double intervalS = config.rate > 0 ? config.concurrency / config.rate : 0;
+    double offsetS = config.rate > 0 ? index / config.rate : 0;
+
+    for (unsigned long k = 0;; k++)
     {
-        auto err = res.error();
-        
-        std::cout << "HTTP error: " << httplib::to_string(err) << std::endl;
+        Clock::time_point due = Clock::now();
+        if (intervalS > 0)
+        {
+            due = start + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(offsetS + k * intervalS));
+            if (due >= end)
+            {
+                break;
+            }
+            std::this_thread::sleep_until(due);
+        }
+        Clock::time_point sent = Clock::now();
+        if (sent >= end)
+        {
+            break;
+        }
+
+        int pan = config.pan;
+        if (config.sweep)
+        {
+            pan += (int)std::lround(45 * std::sin((k * config.concurrency + index) * 0.05));
+        }
+
+        std::string error;
+        if (http)
+        {
+            if (!config.reuse || !client)
+            {
+                client.reset(new httplib::Client(host, port));
+                client->set_keep_alive(config.reuse);
+            }
+
+            std::stringstream uri;
+            uri << "/aim_camera?pan=" << pan << "&tilt=" << config.tilt;
+
+            if (auto res = client->Get(uri.str()))
+            {
+                if (res->status != 200)
+                {
+                    error = "HTTP " + std::to_string(res->status);
+                }
+            }
+            else
+            {
+                error = httplib::to_string(res.error());
+                client.reset(); // start over with a fresh connection
+            }
+        }
+        else
+        {
+            if (!config.reuse || !aimSocket)
+            {
+                aimSocket.reset(new AimSocket(config.target));
+            }
+            if (aimSocket->send(pan, config.tilt) < 0)
+            {
+                error = "datagram not queued";
+            }
+        }
+
+        Clock::time_point answered = Clock::now();
+        result.serviceUs.push_back(Micros(answered - sent));
+        if (intervalS > 0)
+        {
+            result.responseUs.push_back(Micros(answered - due));
+        }
+        if (error.empty())
+        {
+            result.ok++;
+        }
+        else
+        {
+            result.errors[error]++;
+        }
+        completed++;
     }
 }
 
+static void Usage(const char *program)
+{
+    std::cerr << "Usage: " << program << " [-target <http://host:port | udp:host:port | unix:/path>] [-concurrency <n>]"
+              << " [-rate <requests/s>] [-duration <s>] [-noreuse] [-pan <degrees>] [-tilt <degrees>] [-sweep]" << std::endl;
+}
 
-int main(int agc, char** argv)
+int main(int argc, char** argv)
 {
-    std::thread http_thread(do_http_get, "localhost", 5000, 180, 25);
+    LoadConfig config;
+    for (int i = 1; i < argc; ++i)
+    {
+        if (strcmp("-target", argv[i]) == 0 && i + 1 < argc)
+        {
+            config.target = argv[++i];
+        }
+        else if (strcmp("-concurrency", argv[i]) == 0 && i + 1 < argc)
+        {
+            config.concurrency = std::max(1, atoi(argv[++i]));
+        }
+        else if (strcmp("-rate", argv[i]) == 0 && i + 1 < argc)
+        {
+            config.rate = std::max(0.0, atof(argv[++i]));
+        }
+        else if (strcmp("-duration", argv[i]) == 0 && i + 1 < argc)
+        {
+            config.duration = std::max(0.1, atof(argv[++i]));
+        }
+        else if (strcmp("-noreuse", argv[i]) == 0)
+        {
+            config.reuse = false;
+        }
+        else if (strcmp("-pan", argv[i]) == 0 && i + 1 < argc)
+        {
+            config.pan = atoi(argv[++i]);
+        }
+        else if (strcmp("-tilt", argv[i]) == 0 && i + 1 < argc)
+        {
+            config.tilt = atoi(argv[++i]);
+        }
+        else if (strcmp("-sweep", argv[i]) == 0)
+        {
+            config.sweep = true;
+        }
+        else
+        {
+            Usage(argv[0]);
+            return 1;
+        }
+    }
 
-    http_thread.detach();
+    if (config.target.compare(0, 7, "http://") != 0 && config.target.compare(0, 4, "udp:") != 0 &&
+        config.target.compare(0, 5, "unix:") != 0)
+    {
+        Usage(argv[0]);
+        return 1;
+    }
 
-    sleep(5);
+    printf("%s: %d workers, %s, %s, %.1f s\n", config.target.c_str(), config.concurrency,
+           config.rate > 0 ? (std::to_string(config.rate) + " requests/s").c_str() : "as fast as answered",
+           config.reuse ? "connections reused" : "a new connection per request", config.duration);
 
-    return 0;
-}
+    if (config.target.compare(0, 7, "http://") != 0)
+    {
+        try
+        {
+            AimSocket check(config.target); // a bad endpoint fails here rather than in every worker
+        }
+        catch (std::exception &e)
+        {
+            std::cerr << e.what() << std::endl;
+            return 1;
+        }
+    }
+
+    std::vector<WorkerResult> results(config.concurrency);
+    std::vector<std::thread> workers;
+    Clock::time_point start = Clock::now();
+    Clock::time_point end = start + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(config.duration));
+    for (int i = 0; i < config.concurrency; ++i)
+    {
+        workers.emplace_back(RunWorker, std::cref(config), i, start, end, std::ref(results[i]));
+    }
 
+    unsigned long reported = 0;
+    for (int second = 1; Clock::now() < end; ++second)
+    {
+        std::this_thread::sleep_until(std::min(end, start + std::chrono::seconds(second)));
+        unsigned long now = completed.load();
+        printf("%4d s %8lu requests/s\n", second, now - reported);
+        reported = now;
+    }
+    for (auto &worker : workers)
+    {
+        worker.join();
+    }
+    double seconds = Micros(Clock::now() - start) / 1e6;
+
+    WorkerResult total;
+    for (WorkerResult &result : results)
+    {
+        total.serviceUs.insert(total.serviceUs.end(), result.serviceUs.begin(), result.serviceUs.end());
+        total.responseUs.insert(total.responseUs.end(), result.responseUs.begin(), result.responseUs.end());
+        total.ok += result.ok;
+        for (const auto &error : result.errors)
+        {
+            total.errors[error.first] += error.second;
+        }
+    }
+
+    unsigned long requests = total.serviceUs.size();
+    printf("\n%lu requests, %lu ok, %lu failed, %.1f requests/s\n", requests, total.ok, requests - total.ok, requests / seconds);
+    for (const auto &error : total.errors)
+    {
+        printf("  %8lu  %s\n", error.second, error.first.c_str());
+    }
+    PrintLatency("send to answer", total.serviceUs);
+    if (config.rate > 0)
+    {
+        PrintLatency("due to answer", total.responseUs);
+    }
+
+    return total.ok == requests ? 0 : 2;
+}
@@ -0,0 +1,69 @@
+#!/bin/bash
+# Profile-guided + link-time optimised build of Pinocchio (FaceposeEstimation), trained on a recorded session.
+#
+#   ./pgo_build.sh [clip.gses]
+#
+# 1. plain -O3 build                     -> build-plain/
+# 2. instrumented build, replays the clip -> build-pgo-gen/, profile in build-pgo-gen/pgo-profile/
+# 3. -O3 + LTO + profile build           -> build-pgo/
+# 4. times both over the clip and, if the optimised build replays it identically and faster, installs it as
+#    FaceposeEstimation.exe
+#
+# The clip is a session recorded on the Gizmo: ./FaceposeEstimation.exe -record pgo/clip.gses, stopped with Ctrl+C
+# after a minute or so with someone in front of the camera (turning away, moving around), so every stage is exercised.
+
+set -e -o pipefail
+cd "$(dirname "$0")"
+
+CLIP=${1:-pgo/clip.gses}
+RUNS=3
+JOBS=$(nproc)
+
+if [ ! -f "$CLIP" ]; then
+    echo "No recorded clip at $CLIP. Record one with: ./FaceposeEstimation.exe -record $CLIP" >&2
+    exit 1
+fi
+
+# replay_fps <binary>: median replay fps over $RUNS runs. Fails if the replay does not reproduce the recording.
+replay_fps() {
+    for run in $(seq $RUNS); do
+        "$1" -headless -replay "$CLIP" | sed -n 's/^Replayed .* s (\([0-9.]*\) fps.*/\1/p'
+        if [ "${PIPESTATUS[0]}" -ne 0 ]; then
+            echo "$1 did not reproduce $CLIP" >&2
+            return 1
+        fi
+    done | sort -n | sed -n "$(( (RUNS + 1) / 2 ))p"
+}
+
+echo "== plain build"
+cmake -S . -B build-plain -DGIZMO_LTO=OFF -DGIZMO_PGO= > /dev/null
+cmake --build build-plain --target Pinocchio -j"$JOBS"
+
+echo "== instrumented build"
+rm -rf build-pgo-gen/pgo-profile
+cmake -S . -B build-pgo-gen -DGIZMO_LTO=OFF -DGIZMO_PGO=GENERATE > /dev/null
+cmake --build build-pgo-gen --target Pinocchio -j"$JOBS"
+./build-pgo-gen/Pinocchio -headless -replay "$CLIP" > /dev/null
+
+PROFILE_DIR=$(pwd)/build-pgo-gen/pgo-profile
+if ls "$PROFILE_DIR"/*.profraw > /dev/null 2>&1; then
+    llvm-profdata merge -output="$PROFILE_DIR/default.profdata" "$PROFILE_DIR"/*.profraw
+fi
+
+echo "== optimised build"
+cmake -S . -B build-pgo -DGIZMO_LTO=ON -DGIZMO_PGO=USE -DGIZMO_PGO_DIR="$PROFILE_DIR" > /dev/null
+cmake --build build-pgo --target Pinocchio -j"$JOBS"
+
+echo "== timing over $CLIP"
+PLAIN_FPS=$(replay_fps ./build-plain/Pinocchio)
+PGO_FPS=$(replay_fps ./build-pgo/Pinocchio)
+echo "plain:    $PLAIN_FPS fps"
+echo "PGO+LTO:  $PGO_FPS fps"
+awk -v a="$PLAIN_FPS" -v b="$PGO_FPS" 'BEGIN { printf "change:   %+.1f%%\n", 100 * (b - a) / a }'
+
+if awk -v a="$PLAIN_FPS" -v b="$PGO_FPS" 'BEGIN { exit !(b > a) }'; then
+    cp build-pgo/Pinocchio FaceposeEstimation.exe
+    echo "Installed the PGO+LTO build as FaceposeEstimation.exe"
+else
+    echo "PGO+LTO was not faster; FaceposeEstimation.exe left alone"
+fi
@@ -0,0 +1,168 @@
+#include <chrono>
+#include <cstdio>
+#include <thread>
+#include <vector>
+
+#include "I2cDevice.h"
+#include "Log.h"
+#include "Pca9685.h"
+
+/**
+ * servo_check - Drives ServoController through an EmulatedI2cDevice and checks what would have reached the PCA9685.
+ *
+ *   servo_check
+ *
+ * Covers the init sequence, the channel 0/1 pulse writes of a move that snaps and of one that is speed limited, and a
+ * bus whose writes fail. Prints each failed check and exits with 1 if there was one; ctest runs it as servo_check.
+ */
+
+#define PCA9685_MODE1 0x00
+#define PCA9685_LED0_ON_L 0x06
+#define PCA9685_PRESCALE 0xFE
+
+static int failures = 0;
+
+#define CHECK(condition) \
+    do { if (!(condition)) { fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #condition); failures++; } } while (0)
+
+/**
+ * WaitForWrites - Waits until the device has logged count writes, or a second has passed.
+ */
+static std::vector<EmulatedI2cDevice::Write> WaitForWrites(EmulatedI2cDevice &device, size_t count)
+{
+    auto until = std::chrono::steady_clock::now() + std::chrono::seconds(1);
+    std::vector<EmulatedI2cDevice::Write> writes = device.writes();
+    while (writes.size() < count && std::chrono::steady_clock::now() < until)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+        writes = device.writes();
+    }
+    return writes;
+}
+
+/**
+ * IsPulse - Whether write sets channel's output to the pulse for angle: ON at 0, OFF at the pulse width.
+ */
+static bool IsPulse(const EmulatedI2cDevice::Write &write, int channel, double angle)
+{
+    uint16_t off = Pca9685::angleToCounts(angle);
+    std::vector<uint8_t> regs = {0, 0, (uint8_t)(off & 0xFF), (uint8_t)(off >> 8)};
+    return write.reg == PCA9685_LED0_ON_L + 4 * channel && write.data == regs;
+}
+
+static void CheckInit()
+{
+    EmulatedI2cDevice device;
+    ServoController servos(device, 90, 45);
+
+    std::vector<EmulatedI2cDevice::Write> writes = WaitForWrites(device, 6);
+    CHECK(writes.size() == 6);
+    if (writes.size() < 6)
+    {
+        return;
+    }
+    // Asleep, the 50 Hz prescaler (25 MHz / (4096 * 50) - 1), awake with auto-increment, restart.
+    CHECK(writes[0].reg == PCA9685_MODE1 && writes[0].data == std::vector<uint8_t>{0x10});
+    CHECK(writes[1].reg == PCA9685_PRESCALE && writes[1].data == std::vector<uint8_t>{121});
+    CHECK(writes[2].reg == PCA9685_MODE1 && writes[2].data == std::vector<uint8_t>{0x20});
+    CHECK(writes[3].reg == PCA9685_MODE1 && writes[3].data == std::vector<uint8_t>{0xA0});
+    CHECK(IsPulse(writes[4], 0, 90));
+    CHECK(IsPulse(writes[5], 1, 45));
+    CHECK(device.peek(PCA9685_PRESCALE) == 121);
+
+    // At its goals, the controller writes nothing more.
+    std::this_thread::sleep_for(std::chrono::milliseconds(5 * ServoController::TICK_MS));
+    CHECK(device.writes().size() == 6);
+}
+
+static void CheckSnap()
+{
+    EmulatedI2cDevice device;
+    ServoController servos(device, 90, 45);
+    WaitForWrites(device, 6);
+
+    // Within SNAP_ANGLE of where they are: one tick puts both servos on their goals.
+    servos.setGoals(91, 46);
+    WaitForWrites(device, 8);
+    std::this_thread::sleep_for(std::chrono::milliseconds(5 * ServoController::TICK_MS)); // and no more than that
+    std::vector<EmulatedI2cDevice::Write> writes = device.writes();
+    CHECK(writes.size() == 8);
+    if (writes.size() >= 8)
+    {
+        CHECK(IsPulse(writes[6], 0, 91));
+        CHECK(IsPulse(writes[7], 1, 46));
+    }
+
+    double pan, tilt;
+    servos.position(pan, tilt);
+    CHECK(pan == 91 && tilt == 46);
+}
+
+static void CheckSpeedLimitedMove()
+{
+    EmulatedI2cDevice device;
+    ServoController servos(device, 91, 46);
+    WaitForWrites(device, 6);
+
+    // Each tick covers SPEED (3/4) of what is left, until within SNAP_ANGLE: 91 -> 151 -> 166 -> 169.75 -> 171.
+    // Tilt is already there and is rewritten every tick.
+    const double pans[] = {151, 166, 169.75, 171};
+    servos.setGoals(171, 46);
+    WaitForWrites(device, 6 + 2 * 4);
+    std::this_thread::sleep_for(std::chrono::milliseconds(5 * ServoController::TICK_MS)); // and no more than that
+    std::vector<EmulatedI2cDevice::Write> writes = device.writes();
+    CHECK(writes.size() == 6 + 2 * 4);
+    for (size_t tick = 0; tick < 4 && 6 + 2 * tick + 1 < writes.size(); tick++)
+    {
+        CHECK(IsPulse(writes[6 + 2 * tick], 0, pans[tick]));
+        CHECK(IsPulse(writes[6 + 2 * tick + 1], 1, 46));
+    }
+
+    double pan, tilt;
+    servos.position(pan, tilt);
+    CHECK(pan == 171 && tilt == 46);
+}
+
+static void CheckFailingBus()
+{
+    EmulatedI2cDevice device;
+    device.failWrites = true;
+    ServoController servos(device, 90, 45);
+
+    // Nothing reaches the device, but the controller keeps running and still follows its goals.
+    servos.setGoals(100, 45);
+    std::this_thread::sleep_for(std::chrono::milliseconds(10 * ServoController::TICK_MS));
+    CHECK(device.writes().empty());
+    CHECK(device.peek(PCA9685_PRESCALE) == 0);
+    double pan, tilt;
+    servos.position(pan, tilt);
+    CHECK(pan == 100 && tilt == 45);
+
+    // Once the bus is back, the next move is written.
+    device.failWrites = false;
+    servos.setGoals(101, 45);
+    std::vector<EmulatedI2cDevice::Write> writes = WaitForWrites(device, 2);
+    CHECK(writes.size() == 2);
+    if (writes.size() >= 2)
+    {
+        CHECK(IsPulse(writes[0], 0, 101));
+        CHECK(IsPulse(writes[1], 1, 45));
+    }
+}
+
+int main()
+{
+    logStart(nullptr); // the servo thread reports write errors through Log
+    CheckInit();
+    CheckSnap();
+    CheckSpeedLimitedMove();
+    CheckFailingBus();
+
+    if (failures > 0)
+    {
+        fprintf(stderr, "%d checks failed\n", failures);
+        return 1;
+    }
+    printf("All servo checks passed\n");
+    return 0;
+}
@@ -0,0 +1,414 @@
+#include <dirent.h>
+#include <netdb.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "httplib.h"
+#include "AimSocket.h"
+#include "I2cDevice.h"
+#include "Latency.h"
+#include "Log.h"
+#include "Pca9685.h"
+
+/**
+ * servo_standin - ServoServer.py's API without the servos, for testing FaceposeEstimation and Maia on any machine.
+ *
+ *   servo_standin [-host <address>] [-port <port>] [-aim <udp:host:port | unix:/path>] [-record <file.csv>]
+ *                 [-latency <ms>] [-jitter <ms>] [-errors <fraction>] [-drops <fraction>]
+ *
+ * Serves GET /aim_camera?pan=&tilt= and GET /clench on -host:-port (default 127.0.0.1:5000, where Flask listens), and
+ * with -aim also takes aim datagrams the way ServoServer.py --aim does. Targets drive a ServoController on an emulated
+ * PCA9685, so the simulated servos move with the same kinematics as the real ones.
+ *
+ * Faults are injected per request: every request waits -latency plus up to -jitter milliseconds before it is handled;
+ * then a -errors fraction are answered with HTTP 500 and a -drops fraction get their connection shut without an answer.
+ * Neither moves the servos. Datagrams have no answer, so for them -errors does nothing and a drop discards the target.
+ *
+ * Every target received is kept with its times (CLOCK_MONOTONIC, like session files, traces and -logfile) and
+ * the servo position when it was applied. FaceposeEstimation stamps its aims with the capture time of the frame they
+ * came from (capture_us on HTTP, the timestamp of a datagram), so on the same host the time from camera to servo shows.
+ * Ctrl-C prints a summary and writes them to -record as CSV.
+ */
+
+#define STANDIN_START_PAN 90 // ServoServer.py's ServoHandler starts here
+#define STANDIN_START_TILT 25
+
+struct StandInConfig
+{
+    std::string host = "127.0.0.1";
+    int port = 5000;
+    std::string aim;
+    std::string record;
+    double latencyMs = 0;
+    double jitterMs = 0;
+    double errorRate = 0;
+    double dropRate = 0;
+};
+
+enum Fault { FAULT_NONE, FAULT_ERROR, FAULT_DROP };
+
+struct ReceivedTarget
+{
+    uint64_t receivedUs;
+    uint64_t handledUs;    // after the injected latency
+    uint64_t stampUs;      // the sender's: a datagram's timestamp or an HTTP aim's capture_us, 0 if it gave none
+    const char *transport; // "http" or "datagram"
+    const char *outcome;   // "ok", "error", "dropped" or "malformed"
+    int pan;
+    int tilt;
+    double servoPan; // where the servos were when the target was handled
+    double servoTilt;
+};
+
+static std::mutex targetsLock;
+static std::vector<ReceivedTarget> targets;
+static std::atomic<unsigned long> clenches{0};
+
+static void Record(const ReceivedTarget &target)
+{
+    std::lock_guard<std::mutex> guard(targetsLock);
+    targets.push_back(target);
+}
+
+/**
+ * InjectFault - Waits out the configured latency and jitter, then picks what happens to the request.
+ */
+static Fault InjectFault(const StandInConfig &config)
+{
+    thread_local std::mt19937 random(std::random_device{}());
+    std::uniform_real_distribution<double> uniform(0, 1);
+
+    double delayMs = config.latencyMs + config.jitterMs * uniform(random);
+    if (delayMs > 0)
+    {
+        std::this_thread::sleep_for(std::chrono::duration<double, std::milli>(delayMs));
+    }
+
+    double roll = uniform(random);
+    if (roll < config.dropRate)
+    {
+        return FAULT_DROP;
+    }
+    if (roll < config.dropRate + config.errorRate)
+    {
+        return FAULT_ERROR;
+    }
+    return FAULT_NONE;
+}
+
+/**
+ * DropConnection - Shuts the socket a request came in on, so the client sees the connection close with no answer.
+ *
+ * httplib does not hand its handlers the socket, so this looks for the open socket whose peer is the request's remote
+ * address. httplib's own write of the response then fails and it closes the socket as usual.
+ */
+static bool DropConnection(const httplib::Request &req)
+{
+    DIR *fds = opendir("/proc/self/fd");
+    if (!fds)
+    {
+        return false;
+    }
+
+    bool dropped = false;
+    while (struct dirent *entry = readdir(fds))
+    {
+        int fd = atoi(entry->d_name);
+        if (fd <= 2 || fd == dirfd(fds))
+        {
+            continue;
+        }
+
+        struct sockaddr_storage peer;
+        socklen_t length = sizeof(peer);
+        char host[NI_MAXHOST];
+        char service[NI_MAXSERV];
+        if (getpeername(fd, (struct sockaddr *)&peer, &length) == 0 &&
+            getnameinfo((struct sockaddr *)&peer, length, host, sizeof(host), service, sizeof(service),
+                        NI_NUMERICHOST | NI_NUMERICSERV) == 0 &&
+            req.remote_addr == host && req.remote_port == atoi(service))
+        {
+            dropped = shutdown(fd, SHUT_RDWR) == 0;
+            break;
+        }
+    }
+    closedir(fds);
+    return dropped;
+}
+
+static void ReceiveDatagrams(const StandInConfig &config, AimReceiver &receiver, ServoController &servos,
+                             const std::atomic<bool> &stopping)
+{
+    while (!stopping)
+    {
+        AimPacket packet;
+        int got = receiver.receive(packet, 100);
+        if (got < 0)
+        {
+            std::cerr << "Aim receive failed: " << strerror(errno) << std::endl;
+            return;
+        }
+        if (got == 0)
+        {
+            continue;
+        }
+
+        ReceivedTarget target = {monotonicMicros(), 0, packet.timestampUs, "datagram", "ok", packet.pan, packet.tilt, 0, 0};
+        if (InjectFault(config) == FAULT_DROP)
+        {
+            target.outcome = "dropped";
+        }
+        else
+        {
+            servos.setGoals(packet.pan, packet.tilt);
+        }
+        target.handledUs = monotonicMicros();
+        servos.position(target.servoPan, target.servoTilt);
+        Record(target);
+    }
+}
+
+static bool WriteRecord(const std::string &path)
+{
+    FILE *file = fopen(path.c_str(), "w");
+    if (!file)
+    {
+        return false;
+    }
+    fprintf(file, "received_s,handled_s,stamp_s,transport,outcome,pan,tilt,servo_pan,servo_tilt\n");
+    for (const ReceivedTarget &target : targets)
+    {
+        fprintf(file, "%.6f,%.6f,%.6f,%s,%s,%d,%d,%.2f,%.2f\n", target.receivedUs / 1e6, target.handledUs / 1e6,
+                target.stampUs / 1e6, target.transport, target.outcome, target.pan, target.tilt, target.servoPan,
+                target.servoTilt);
+    }
+    return fclose(file) == 0;
+}
+
+static void PrintSummary(double seconds, const AimReceiver *receiver, ServoController &servos)
+{
+    std::map<std::string, unsigned long> outcomes;
+    std::vector<double> handlingUs;
+    std::vector<double> stampedUs; // from the sender's stamp to the target being handled
+    for (const ReceivedTarget &target : targets)
+    {
+        outcomes[std::string(target.transport) + " " + target.outcome]++;
+        handlingUs.push_back(target.handledUs - target.receivedUs);
+        if (target.stampUs)
+        {
+            stampedUs.push_back((double)target.handledUs - (double)target.stampUs);
+        }
+    }
+
+    printf("\n%zu targets in %.1f s (%.1f/s), %lu clenches\n", targets.size(), seconds, targets.size() / seconds,
+           clenches.load());
+    for (const auto &outcome : outcomes)
+    {
+        printf("  %8lu  %s\n", outcome.second, outcome.first.c_str());
+    }
+    if (receiver)
+    {
+        printf("  %8lu  datagrams discarded stale, %lu out of order, %lu malformed\n", receiver->discardedStale,
+               receiver->discardedOutOfOrder, receiver->discardedMalformed);
+    }
+    if (!handlingUs.empty())
+    {
+        printf("%-28s p50 %8.0f  p99 %8.0f  max %8.0f us\n", "received to handled", Percentile(handlingUs, 0.5),
+               Percentile(handlingUs, 0.99), Percentile(handlingUs, 1.0));
+    }
+    if (!stampedUs.empty())
+    {
+        printf("%-28s p50 %8.0f  p99 %8.0f  max %8.0f us\n", "stamped to handled", Percentile(stampedUs, 0.5),
+               Percentile(stampedUs, 0.99), Percentile(stampedUs, 1.0));
+    }
+
+    double pan, tilt;
+    servos.position(pan, tilt);
+    printf("servos at pan %.1f tilt %.1f\n", pan, tilt);
+}
+
+static void Usage(const char *program)
+{
+    std::cerr << "Usage: " << program << " [-host <address>] [-port <port>] [-aim <udp:host:port | unix:/path>]"
+              << " [-record <file.csv>] [-latency <ms>] [-jitter <ms>] [-errors <fraction>] [-drops <fraction>]"
+              << std::endl;
+}
+
+int main(int argc, char** argv)
+{
+    StandInConfig config;
+    for (int i = 1; i < argc; ++i)
+    {
+        if (strcmp("-host", argv[i]) == 0 && i + 1 < argc)
+        {
+            config.host = argv[++i];
+        }
+        else if (strcmp("-port", argv[i]) == 0 && i + 1 < argc)
+        {
+            config.port = atoi(argv[++i]);
+        }
+        else if (strcmp("-aim", argv[i]) == 0 && i + 1 < argc)
+        {
+            config.aim = argv[++i];
+        }
+        else if (strcmp("-record", argv[i]) == 0 && i + 1 < argc)
+        {
+            config.record = argv[++i];
+        }
+        else if (strcmp("-latency", argv[i]) == 0 && i + 1 < argc)
+        {
+            config.latencyMs = std::max(0.0, atof(argv[++i]));
+        }
+        else if (strcmp("-jitter", argv[i]) == 0 && i + 1 < argc)
+        {
+            config.jitterMs = std::max(0.0, atof(argv[++i]));
+        }
+        else if (strcmp("-errors", argv[i]) == 0 && i + 1 < argc)
+        {
+            config.errorRate = std::min(1.0, std::max(0.0, atof(argv[++i])));
+        }
+        else if (strcmp("-drops", argv[i]) == 0 && i + 1 < argc)
+        {
+            config.dropRate = std::min(1.0, std::max(0.0, atof(argv[++i])));
+        }
+        else
+        {
+            Usage(argv[0]);
+            return 1;
+        }
+    }
+
+    // Ctrl-C is taken by sigwait below, so every thread started from here on leaves it alone.
+    sigset_t quitSignals;
+    sigemptyset(&quitSignals);
+    sigaddset(&quitSignals, SIGINT);
+    sigaddset(&quitSignals, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &quitSignals, nullptr);
+
+    logStart(nullptr); // the servo thread reports write errors through Log
+    EmulatedI2cDevice bus;
+    ServoController servos(bus, STANDIN_START_PAN, STANDIN_START_TILT);
+
+    std::unique_ptr<AimReceiver> receiver;
+    if (!config.aim.empty())
+    {
+        try
+        {
+            receiver.reset(new AimReceiver(config.aim));
+        }
+        catch (std::exception &e)
+        {
+            std::cerr << e.what() << std::endl;
+            return 1;
+        }
+    }
+
+    httplib::Server server;
+    server.set_tcp_nodelay(true); // httplib writes the headers and the body separately; Nagle would hold the body back
+    server.Get("/aim_camera", [&](const httplib::Request &req, httplib::Response &res) {
+        ReceivedTarget target = {monotonicMicros(), 0, 0, "http", "ok", 0, 0, 0, 0};
+        Fault fault = InjectFault(config);
+        target.pan = atoi(req.get_param_value("pan").c_str());
+        target.tilt = atoi(req.get_param_value("tilt").c_str());
+        target.stampUs = strtoull(req.get_param_value("capture_us").c_str(), nullptr, 10);
+
+        if (!req.has_param("pan") || !req.has_param("tilt"))
+        {
+            target.outcome = "malformed";
+            res.status = 400;
+            res.set_content("pan and tilt are required", "text/plain");
+        }
+        else if (fault == FAULT_DROP && DropConnection(req))
+        {
+            target.outcome = "dropped";
+        }
+        else if (fault != FAULT_NONE)
+        {
+            target.outcome = "error";
+            res.status = 500;
+            res.set_content("INJECTED ERROR", "text/plain");
+        }
+        else
+        {
+            servos.setGoals(target.pan, target.tilt);
+            res.set_content("I GOT THIS", "text/plain");
+        }
+
+        target.handledUs = monotonicMicros();
+        servos.position(target.servoPan, target.servoTilt);
+        Record(target);
+    });
+    server.Get("/clench", [&](const httplib::Request &, httplib::Response &res) {
+        if (InjectFault(config) == FAULT_NONE)
+        {
+            clenches++;
+            res.set_content("CLENCH!", "text/plain");
+        }
+        else
+        {
+            res.status = 500;
+            res.set_content("INJECTED ERROR", "text/plain");
+        }
+    });
+
+    if (!server.bind_to_port(config.host.c_str(), config.port))
+    {
+        std::cerr << "Cannot listen on " << config.host << ":" << config.port << std::endl;
+        return 1;
+    }
+    printf("Servo stand-in on http://%s:%d%s%s, latency %.1f + %.1f ms, %.1f%% errors, %.1f%% drops\n",
+           config.host.c_str(), config.port, receiver ? " and " : "", config.aim.c_str(), config.latencyMs,
+           config.jitterMs, config.errorRate * 100, config.dropRate * 100);
+
+    auto start = std::chrono::steady_clock::now();
+    std::thread listener([&] { server.listen_after_bind(); });
+    std::atomic<bool> stopping{false};
+    std::thread datagrams;
+    if (receiver)
+    {
+        datagrams = std::thread(ReceiveDatagrams, std::cref(config), std::ref(*receiver), std::ref(servos),
+                                std::cref(stopping));
+    }
+
+    int signal;
+    sigwait(&quitSignals, &signal);
+
+    server.stop();
+    listener.join();
+    stopping = true;
+    if (datagrams.joinable())
+    {
+        datagrams.join();
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    PrintSummary(seconds, receiver.get(), servos);
+    if (!config.record.empty())
+    {
+        if (WriteRecord(config.record))
+        {
+            printf("%zu targets written to %s\n", targets.size(), config.record.c_str());
+        }
+        else
+        {
+            std::cerr << "Cannot write " << config.record << std::endl;
+            return 1;
+        }
+    }
+    return 0;
+}
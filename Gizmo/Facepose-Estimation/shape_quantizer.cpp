@@ -0,0 +1,205 @@
+#include <dlib/opencv.h>
+#include <opencv2/opencv.hpp>
+#include <dlib/image_processing/frontal_face_detector.h>
+#include <dlib/image_processing.h>
+#include "QuantizedShapePredictor.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+// Only every Nth frame of a video is evaluated; neighbouring frames hardly differ.
+#define VIDEO_FRAME_STRIDE 10
+
+/**
+ * Shape quantizer - Converts dlib's 68 point shape predictor to a QuantizedShapePredictor and measures what that costs.
+ *
+ *   shape_quantizer quantize <model.dat> <out.qsp> <int8 | fp16>
+ *   shape_quantizer evaluate <model.dat> <model.qsp>[,<model.qsp>...] <image or video>...
+ *
+ * evaluate runs the float model and each quantized one on every face the frontal face detector finds and reports the
+ * landmark error of each quantized model against the float one (pixels, and relative to the outer eye corner
+ * distance), the time per face of all of them and the memory each takes. Giving an int8 and an fp16 model times both
+ * on the same faces.
+ */
+
+struct ErrorStats {
+    unsigned long faces = 0;
+    unsigned long points = 0;
+    double sumPixels = 0;
+    double maxPixels = 0;
+    double sumNormalised = 0; // per face: mean point error / inter-ocular distance
+    double maxNormalised = 0;
+    double floatSeconds = 0;
+    double quantizedSeconds = 0;
+};
+
+static double Seconds(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+/**
+ * AddErrors - Adds how far shape's points are from reference's to stats.
+ */
+static void AddErrors(const dlib::full_object_detection &reference, const dlib::full_object_detection &shape,
+                      ErrorStats &stats) {
+    double faceSum = 0;
+    for (unsigned long i = 0; i < reference.num_parts(); ++i) {
+        double error = dlib::length(reference.part(i) - shape.part(i));
+        faceSum += error;
+        stats.maxPixels = std::max(stats.maxPixels, error);
+    }
+
+    // Outer eye corners, the usual normalisation for the 68 point layout.
+    double interOcular = std::max(1.0, dlib::length(reference.part(36) - reference.part(45)));
+    double normalised = faceSum / reference.num_parts() / interOcular;
+
+    stats.faces++;
+    stats.points += reference.num_parts();
+    stats.sumPixels += faceSum;
+    stats.sumNormalised += normalised;
+    stats.maxNormalised = std::max(stats.maxNormalised, normalised);
+}
+
+/**
+ * CompareOnImage - Runs the float predictor and each quantized one on every face in one image and adds to allStats,
+ * which has an entry per quantized model.
+ */
+static void CompareOnImage(const cv::Mat &image, dlib::frontal_face_detector &detector, const dlib::shape_predictor &floatModel,
+                           const std::vector<std::unique_ptr<QuantizedShapePredictor>> &quantized,
+                           std::vector<ErrorStats> &allStats) {
+    dlib::cv_image<dlib::bgr_pixel> cimg(image);
+    std::vector<dlib::rectangle> faces = detector(cimg);
+
+    for (const dlib::rectangle &face : faces) {
+        auto start = std::chrono::steady_clock::now();
+        dlib::full_object_detection reference = floatModel(cimg, face);
+        double floatSeconds = Seconds(start);
+
+        for (size_t m = 0; m < quantized.size(); ++m) {
+            ErrorStats &stats = allStats[m];
+            stats.floatSeconds += floatSeconds;
+
+            start = std::chrono::steady_clock::now();
+            dlib::full_object_detection shape = (*quantized[m])(cimg, face);
+            stats.quantizedSeconds += Seconds(start);
+
+            AddErrors(reference, shape, stats);
+        }
+    }
+}
+
+static int Quantize(const char *floatPath, const char *outPath, const char *precisionName) {
+    QuantizedShapePredictor::Precision precision;
+    if (strcmp(precisionName, "int8") == 0) {
+        precision = QuantizedShapePredictor::INT8;
+    } else if (strcmp(precisionName, "fp16") == 0) {
+        precision = QuantizedShapePredictor::FP16;
+    } else {
+        std::cerr << "Unknown precision " << precisionName << ", use int8 or fp16" << std::endl;
+        return 1;
+    }
+
+    QuantizedShapePredictor model = QuantizedShapePredictor::quantize(floatPath, precision);
+    model.save(outPath);
+
+    std::cout << floatPath << ": " << QuantizedShapePredictor::floatModelBytes(floatPath) / 1024 << " KiB" << std::endl;
+    std::cout << outPath << ": " << model.memoryBytes() / 1024 << " KiB (" << precisionName << ")" << std::endl;
+    return 0;
+}
+
+static int Evaluate(const char *floatPath, const char *quantizedPaths, int inputCount, char **inputs) {
+    dlib::shape_predictor floatModel;
+    dlib::deserialize(floatPath) >> floatModel;
+
+    std::vector<std::string> paths;
+    std::vector<std::unique_ptr<QuantizedShapePredictor>> quantized;
+    std::string list = quantizedPaths;
+    for (size_t start = 0, comma; start <= list.size(); start = comma + 1) {
+        comma = list.find(',', start);
+        if (comma == std::string::npos) {
+            comma = list.size();
+        }
+        paths.push_back(list.substr(start, comma - start));
+        quantized.emplace_back(new QuantizedShapePredictor);
+        quantized.back()->load(paths.back());
+    }
+
+    dlib::frontal_face_detector detector = dlib::get_frontal_face_detector();
+    std::vector<ErrorStats> allStats(quantized.size());
+
+    for (int i = 0; i < inputCount; ++i) {
+        cv::Mat image = cv::imread(inputs[i]);
+        if (!image.empty()) {
+            CompareOnImage(image, detector, floatModel, quantized, allStats);
+            continue;
+        }
+
+        cv::VideoCapture video(inputs[i]);
+        if (!video.isOpened()) {
+            std::cerr << "Skipping " << inputs[i] << ": not an image or video" << std::endl;
+            continue;
+        }
+        for (unsigned long frame = 0; video.read(image); ++frame) {
+            if (frame % VIDEO_FRAME_STRIDE == 0) {
+                CompareOnImage(image, detector, floatModel, quantized, allStats);
+            }
+        }
+    }
+
+    if (allStats[0].faces == 0) {
+        std::cerr << "No faces found, nothing to compare" << std::endl;
+        return 1;
+    }
+
+    // Every model saw the same faces, so their times and memory go side by side and the errors follow per model.
+    std::vector<const char *> precisionNames;
+    for (auto &model : quantized) {
+        precisionNames.push_back(model->getPrecision() == QuantizedShapePredictor::INT8 ? "int8" : "fp16");
+    }
+    size_t floatBytes = QuantizedShapePredictor::floatModelBytes(floatPath);
+    unsigned long faces = allStats[0].faces;
+
+    printf("faces:              %lu\n", faces);
+    printf("time per face (us): float %.1f", 1e6 * allStats[0].floatSeconds / faces);
+    for (size_t m = 0; m < quantized.size(); ++m) {
+        printf("  %s %.1f", precisionNames[m], 1e6 * allStats[m].quantizedSeconds / faces);
+    }
+    printf("\nmemory (KiB):       float %zu", floatBytes / 1024);
+    for (size_t m = 0; m < quantized.size(); ++m) {
+        size_t quantizedBytes = quantized[m]->memoryBytes();
+        printf("  %s %zu (%.1fx smaller)", precisionNames[m], quantizedBytes / 1024, (double)floatBytes / quantizedBytes);
+    }
+    printf("\n");
+
+    for (size_t m = 0; m < quantized.size(); ++m) {
+        const ErrorStats &stats = allStats[m];
+        printf("\n%s (%s)\n", paths[m].c_str(), precisionNames[m]);
+        printf("error (px):         mean %.3f  max %.3f\n", stats.sumPixels / stats.points, stats.maxPixels);
+        printf("error (inter-ocular): mean %.5f  max %.5f\n", stats.sumNormalised / stats.faces, stats.maxNormalised);
+    }
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    try {
+        if (argc == 5 && strcmp(argv[1], "quantize") == 0) {
+            return Quantize(argv[2], argv[3], argv[4]);
+        }
+        if (argc >= 5 && strcmp(argv[1], "evaluate") == 0) {
+            return Evaluate(argv[2], argv[3], argc - 4, argv + 4);
+        }
+    } catch (std::exception &e) {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+
+    std::cerr << "Usage: " << argv[0] << " quantize <model.dat> <out.qsp> <int8 | fp16>" << std::endl;
+    std::cerr << "       " << argv[0] << " evaluate <model.dat> <model.qsp>[,<model.qsp>...] <image or video>..." << std::endl;
+    return 1;
+}
@@ -6,15 +6,45 @@
 #include <dlib/gui_widgets.h>
 #include "httplib.h"
 #include "TcpSocket.h"
+#include "AimSocket.h"
+#include "Pca9685.h"
+#include "CommanderMessage.h"
+#include "FrameBus.h"
+#include "MjpegStreamer.h"
+#include "WorkerPool.h"
+#include "QuantizedShapePredictor.h"
+#include "FastDownsample.h"
+#include "SessionFile.h"
+#include "WireFormat.h"
+#include "Trace.h"
+#include "PerfCounters.h"
+#include "ThreadPolicy.h"
+#include "ThermalMonitor.h"
+#include "DualCapture.h"
+#include "LandmarkView.h"
+#include "FramePool.h"
+#include "EventBus.h"
+#include "Log.h"
+#include "Latency.h"
 
 #include <string>
 #include <sstream>
 #include <thread>
 #include <algorithm>
+#include <csignal>
 
 #define FACE_DOWNSAMPLE_RATIO 4
+static_assert(FACE_DOWNSAMPLE_RATIO == FAST_DOWNSAMPLE_RATIO, "the fused downsampling kernel only does 1/4");
 #define SKIP_FRAMES 2
 
+#define CAMERA_WIDTH 1280
+#define CAMERA_HEIGHT 720
+#define CAMERA_FPS 21
+#define CAMERA_FLIP_METHOD 2 // The camera is mounted upside down.
+
+// Frames in flight: the one being captured, the one being processed and slack for consumers like the recorder.
+#define FRAME_POOL_FRAMES 4
+
 #define FACE_RADIUS 270
 
 #define OPENCV_PIXELS_MAP_TO_PAN 40
@@ -32,9 +62,53 @@
 #define BASE_STATION_AGX_IP "10.18.96.109"
 #define GIZMO_COMMANDER_PORT "26784"
 
+// Binary commander messages are only sent when a face's facing state changes, or after this long without a change.
+#define COMMANDER_HEARTBEAT_MS 1000
+
+#define SERVO_SERVER_HOST "localhost"
+#define SERVO_SERVER_PORT 5000
+
 int current_tilt = START_TILT;
 int current_pan = START_PAN;
 bool connectToCommander = true;
+bool binaryCommander = false; // Send CommanderMessage frames instead of one "0"/"1" byte per face per frame.
+int commanderHeartbeatMs = COMMANDER_HEARTBEAT_MS;
+std::string commanderHost = BASE_STATION_AGX_IP; // Where GizmoCommander listens; -commanderaddr points elsewhere.
+std::string commanderPort = GIZMO_COMMANDER_PORT;
+const char *frameBusName = nullptr; // If set, captured frames are shared with local processes through this shm ring.
+int streamPort = 0; // If set, annotated frames are served as MJPEG on this port.
+double streamFps = MJPEG_DEFAULT_FPS;
+int streamWidth = MJPEG_DEFAULT_WIDTH;
+bool showWindow = true; // False on a headless Gizmo, where there is no display for cv::imshow.
+int poseWorkers = 1; // Threads sharing the per-face landmark and pose work.
+std::string aimEndpoint; // Empty: aim through ServoServer.py's HTTP API. Otherwise an AimSocket endpoint.
+std::string servoBackend; // "i2c:/dev/i2c-N" or "emulated" drives the PCA9685 from this process instead.
+const char *publishPort = nullptr; // If set, per-frame poses are served to any number of TCP subscribers on this port.
+bool fastDownsample = true; // False: cv::resize for detection and display, and dlib converts to gray itself.
+const char *recordPath = nullptr; // If set, frames and everything decided from them are recorded to this session file.
+const char *replayPath = nullptr; // If set, frames come from this session file and the results are checked against it.
+volatile sig_atomic_t stopRequested = 0; // Set by SIGINT/SIGTERM, so a recording is closed properly.
+const char *tracePath = nullptr; // If set, pipeline spans are written here as Chrome trace JSON on SIGUSR1 and at exit.
+bool perfReportEnabled = false; // Hardware counters per stage, reported every 100 frames.
+bool statsEnabled = false; // Frame time percentiles, period jitter and end-to-end latency every 100 frames.
+bool lockMemory = false; // mlockall() at startup.
+bool thermalEnabled = false; // Back off detection and workers as the Jetson nears its throttling temperature.
+std::string sysfsRoot = "/sys"; // Where the thermal monitor reads temperatures and CPU frequencies.
+cv::Size dualCaptureSize; // If set, the camera delivers a gray detection stream and a landmark stream of this size.
+double landmarkScale = 1.0; // Landmarks are found on the frame resized by this much.
+int landmarkCropWidth = 0; // If set, on a crop around each face scaled to this face width instead.
+int framePoolFrames = 0; // Frame buffers allocated up front; 0 picks a size for what is enabled.
+bool logDecisions = false; // Log facing decision changes as they are made.
+std::vector<std::string> extraCameraSources; // Further cameras (-camera), processed alongside the main one.
+const char *logPath = nullptr; // If set, log records go to this binary file (read it with log_decode) instead of the console.
+const char *quantizedModelPath = nullptr; // If set, landmarks come from this shape_quantizer model instead of the float .dat.
+
+// From the camera to the servos and the commander, for the main camera; printed with -stats. A decision is made when a
+// frame's results are published to the bus, and an ack is ServoServer's answer (the other servo paths have none).
+LatencyHistogram captureToDecision("capture->decision");
+LatencyHistogram servoDecisionToSend("servo decision->send");
+LatencyHistogram servoSendToAck("servo send->ack");
+LatencyHistogram commanderDecisionToSend("commander decision->send");
 
 using namespace std; // Eventually remove this!
 
@@ -120,6 +194,18 @@ cv::Mat get_camera_matrix(float focal_length, cv::Point2d center) {
     return camera_matrix;
 }
 
+/**
+ * get_euler_angles - Converts a solvePnP rotation vector into Euler angles.
+ *
+ * @param rotation_vector The Rodrigues rotation vector returned by solvePnP.
+ * @return Pitch, yaw and roll in degrees (rotation about x, y and z).
+ */
+cv::Vec3d get_euler_angles(const cv::Mat &rotation_vector) {
+    cv::Mat rotation_matrix, mtxR, mtxQ;
+    cv::Rodrigues(rotation_vector, rotation_matrix);
+    return cv::RQDecomp3x3(rotation_matrix, mtxR, mtxQ);
+}
+
 /**
  * DisplayVersion - Displays the OpenCV library version.
  *
@@ -136,6 +222,13 @@ void DisplayVersion() {
  *
  * The command-line arguments `argc` and `argv` are used to determine whether to use a server or default to camera input.
  * Depending, it constructs and returns a string representing the desired input source or video processing pipeline settings.
+ * Flags may be combined: -ip <host:port>, -c, -d, -aim <udp:host:port | unix:/path>, -servo <i2c:/dev/i2c-N | emulated>,
+ * -publish <port>, -commander <ascii | binary>, -commanderaddr <host:port>, -heartbeat <ms>, -framebus </shm-name>,
+ * -stream <port>, -streamfps <fps>, -streamwidth <pixels>, -headless, -workers <n>, -landmarks <model.qsp>, -cvresize,
+ * -record <session file>, -replay <session file>, -trace <trace.json>, -perf,
+ * -sched <role>=<cpus>[:fifo<prio> | :nice<n>] (roles: vision, workers, http, thermal, sinks, cameras), -mlock, -stats,
+ * -thermal, -sysfs <root>, -dualcapture <width>x<height>, -landmarkscale <scale>, -landmarkcrop <face width>,
+ * -framepool <frames>, -log, -logfile <file>, -camera <device index | path | pipeline> (repeatable).
  *
  * @param argc The number of command-line arguments.
  * @param argv An array of character pointers containing the command-line arguments.
@@ -143,38 +236,181 @@ void DisplayVersion() {
  */
 string ParseCLI(int argc, char **argv) {
     bool useIP = false;
+    const char *ipAddress = nullptr;
 
     std::stringstream ss;
 
     // Determine input
     if (argc < 2) {
         std::cout << "No arguments, will default to camera!" << std::endl;
-        useIP = false;
+    }
 
-    } else if (3 == argc) {
-        if (strncmp("-ip", argv[1], 3) == 0) {
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp("-ip", argv[i]) == 0 && i + 1 < argc) {
             std::cout << "server input specified" << std::endl;
             useIP = true;
+            ipAddress = argv[++i];
 
-        } else if (strncmp("-c", argv[1], 2) == 0) {
+        } else if (strcmp("-c", argv[i]) == 0) {
             std::cout << "camera input specified" << std::endl;
             useIP = false;
 
-        } else if (strncmp("-d", argv[1], 2) == 0) {
+        } else if (strcmp("-d", argv[i]) == 0) {
             std::cout << "Debug mode activated. TCP client to GizmoCommander will not be initiated." << std::endl;
             connectToCommander = false;
-	    }
 
-    } else if (3 < argc) {
-        std::cout << "Too many arguments, will default to camera!" << std::endl;
+        } else if (strcmp("-aim", argv[i]) == 0 && i + 1 < argc) {
+            aimEndpoint = argv[++i];
+            std::cout << "Aim commands will be sent as datagrams to " << aimEndpoint << std::endl;
+
+        } else if (strcmp("-servo", argv[i]) == 0 && i + 1 < argc) {
+            servoBackend = argv[++i];
+            std::cout << "Servos will be driven in-process through " << servoBackend << std::endl;
+
+        } else if (strcmp("-publish", argv[i]) == 0 && i + 1 < argc) {
+            publishPort = argv[++i];
+            std::cout << "Publishing poses to subscribers on port " << publishPort << std::endl;
+
+        } else if (strcmp("-commander", argv[i]) == 0 && i + 1 < argc) {
+            binaryCommander = (strcmp("binary", argv[++i]) == 0);
+            std::cout << "Commander messages: " << (binaryCommander ? "binary, on state change" : "ascii, every frame") << std::endl;
+
+        } else if (strcmp("-commanderaddr", argv[i]) == 0 && i + 1 < argc) {
+            std::string address = argv[++i];
+            size_t colon = address.rfind(':');
+            if (colon == std::string::npos) {
+                commanderHost = address;
+            } else {
+                commanderHost = address.substr(0, colon);
+                commanderPort = address.substr(colon + 1);
+            }
+            std::cout << "GizmoCommander at " << commanderHost << ":" << commanderPort << std::endl;
+
+        } else if (strcmp("-heartbeat", argv[i]) == 0 && i + 1 < argc) {
+            commanderHeartbeatMs = atoi(argv[++i]);
+
+        } else if (strcmp("-framebus", argv[i]) == 0 && i + 1 < argc) {
+            frameBusName = argv[++i];
+            std::cout << "Sharing camera frames on " << frameBusName << std::endl;
+
+        } else if (strcmp("-stream", argv[i]) == 0 && i + 1 < argc) {
+            streamPort = atoi(argv[++i]);
+            std::cout << "Serving the debug stream at http://<gizmo>:" << streamPort << "/" << std::endl;
+
+        } else if (strcmp("-streamfps", argv[i]) == 0 && i + 1 < argc) {
+            streamFps = atof(argv[++i]);
+
+        } else if (strcmp("-streamwidth", argv[i]) == 0 && i + 1 < argc) {
+            streamWidth = atoi(argv[++i]);
+
+        } else if (strcmp("-headless", argv[i]) == 0) {
+            showWindow = false;
+
+        } else if (strcmp("-workers", argv[i]) == 0 && i + 1 < argc) {
+            poseWorkers = std::max(1, atoi(argv[++i]));
+            std::cout << "Faces will be processed on " << poseWorkers << " threads" << std::endl;
+
+        } else if (strcmp("-landmarks", argv[i]) == 0 && i + 1 < argc) {
+            quantizedModelPath = argv[++i];
+            std::cout << "Landmarks from the quantized model " << quantizedModelPath << std::endl;
+
+        } else if (strcmp("-cvresize", argv[i]) == 0) {
+            fastDownsample = false;
+            std::cout << "Downsampling with cv::resize instead of the " << FastDownsampleIsa() << " kernel" << std::endl;
+
+        } else if (strcmp("-record", argv[i]) == 0 && i + 1 < argc) {
+            recordPath = argv[++i];
+            std::cout << "Recording the session to " << recordPath << std::endl;
+
+        } else if (strcmp("-replay", argv[i]) == 0 && i + 1 < argc) {
+            replayPath = argv[++i];
+            std::cout << "Replaying " << replayPath << ". Nothing is sent to the commander or the servos." << std::endl;
+
+        } else if (strcmp("-trace", argv[i]) == 0 && i + 1 < argc) {
+            tracePath = argv[++i];
+            std::cout << "Tracing; kill -USR1 " << getpid() << " or exiting writes " << tracePath << std::endl;
+
+        } else if (strcmp("-perf", argv[i]) == 0) {
+            perfReportEnabled = true;
+
+        } else if (strcmp("-sched", argv[i]) == 0 && i + 1 < argc) {
+            if (!parseThreadPolicy(argv[++i])) {
+                std::cout << "Ignoring malformed thread policy " << argv[i] << std::endl;
+            }
+
+        } else if (strcmp("-mlock", argv[i]) == 0) {
+            lockMemory = true;
+
+        } else if (strcmp("-stats", argv[i]) == 0) {
+            statsEnabled = true;
+
+        } else if (strcmp("-thermal", argv[i]) == 0) {
+            thermalEnabled = true;
+
+        } else if (strcmp("-sysfs", argv[i]) == 0 && i + 1 < argc) {
+            sysfsRoot = argv[++i];
+
+        } else if (strcmp("-dualcapture", argv[i]) == 0 && i + 1 < argc) {
+            int width, height;
+            if (sscanf(argv[++i], "%dx%d", &width, &height) == 2 && width > 0 && height > 0) {
+                dualCaptureSize = cv::Size(width, height);
+            } else {
+                std::cout << "Ignoring malformed landmark stream size " << argv[i] << std::endl;
+            }
+
+        } else if (strcmp("-landmarkscale", argv[i]) == 0 && i + 1 < argc) {
+            landmarkScale = std::min(1.0, std::max(0.1, atof(argv[++i])));
+            std::cout << "Landmarks will be found at " << landmarkScale << " scale" << std::endl;
+
+        } else if (strcmp("-landmarkcrop", argv[i]) == 0 && i + 1 < argc) {
+            landmarkCropWidth = std::max(0, atoi(argv[++i]));
+            std::cout << "Landmarks will be found on face crops " << landmarkCropWidth << " pixels wide" << std::endl;
+
+        } else if (strcmp("-framepool", argv[i]) == 0 && i + 1 < argc) {
+            framePoolFrames = std::max(2, atoi(argv[++i]));
+
+        } else if (strcmp("-log", argv[i]) == 0) {
+            logDecisions = true;
+
+        } else if (strcmp("-logfile", argv[i]) == 0 && i + 1 < argc) {
+            logPath = argv[++i];
+
+        } else if (strcmp("-camera", argv[i]) == 0 && i + 1 < argc) {
+            extraCameraSources.push_back(argv[++i]);
+
+        } else {
+            std::cout << "Ignoring unknown argument: " << argv[i] << std::endl;
+        }
+    }
+
+    // A replay recomputes the decisions to compare them; acting on them again would move a camera nobody is in front of.
+    if (replayPath) {
+        connectToCommander = false;
+        if (thermalEnabled) {
+            std::cout << "Ignoring -thermal: a replay has to detect on the recorded schedule" << std::endl;
+            thermalEnabled = false;
+        }
+        if (!extraCameraSources.empty()) {
+            std::cout << "Ignoring -camera: a session holds the main camera only" << std::endl;
+            extraCameraSources.clear();
+        }
+    }
+
+    // Sessions hold full camera frames, and only the camera has the hardware scaler.
+    if (!dualCaptureSize.empty() && (useIP || recordPath || replayPath)) {
+        std::cout << "Ignoring -dualcapture: it needs the camera and cannot be recorded or replayed" << std::endl;
+        dualCaptureSize = cv::Size();
     }
 
     // Determine the stringstream (ss)
     if (useIP) {
-        ss << "http://" << argv[2] << "/";
+        ss << "http://" << ipAddress << "/";
 
     } else {
-        ss << "nvarguscamerasrc !  video/x-raw(memory:NVMM), width=1280, height=720, format=NV12, framerate=21/1 ! nvvidconv flip-method=2 ! video/x-raw, width=1280, height=720, format=BGRx ! videoconvert ! video/x-raw, format=BGR ! appsink";
+        ss << "nvarguscamerasrc !  video/x-raw(memory:NVMM), width=" << CAMERA_WIDTH << ", height=" << CAMERA_HEIGHT
+           << ", format=NV12, framerate=" << CAMERA_FPS << "/1 ! nvvidconv flip-method=" << CAMERA_FLIP_METHOD
+           << " ! video/x-raw, width=" << CAMERA_WIDTH << ", height=" << CAMERA_HEIGHT
+           << ", format=BGRx ! videoconvert ! video/x-raw, format=BGR ! appsink";
     }
 
     std::cout << "Reading input from: " << (useIP ? "a server" : "the camera") << ". Settings: " << ss.str() << std::endl;
@@ -212,52 +448,744 @@ void SetAngleRotation(int distance, ServoAngle angle) {
         current_tilt -= rotation;
 
     } else {
-        std::cout << "Unknown angle: " << angle << "!" << std::endl;
+        LOG_WARN("Unknown angle: %d!", (int)angle);
     }
 }
 
+/**
+ * UpdateAimAngles - Applies a pixel offset of the nose from the image center to the current pan/tilt angles.
+ *
+ * @param x The horizontal offset in pixels.
+ * @param y The vertical offset in pixels.
+ * @param pan Receives the new pan angle, clamped to the valid range.
+ * @param tilt Receives the new tilt angle, clamped to the valid range.
+ */
+void UpdateAimAngles(int x, int y, int &pan, int &tilt) {
+    SetAngleRotation(x, ServoAngle::PAN);
+    SetAngleRotation(y, ServoAngle::TILT);
+
+    // Ensure pan/tilt are within valid range.
+    current_pan = std::clamp(current_pan, MIN_ANGLE, MAX_ANGLE);
+    current_tilt = std::clamp(current_tilt, MIN_ANGLE, MAX_ANGLE);
+
+    pan = current_pan;
+    tilt = current_tilt;
+}
+
 /**
  * do_http_get - Send an HTTP GET request to adjust camera's pan/tilt angles.
  *
  * Adjusts the pan-tilt angles of a camera by sending an HTTP GET request to the host and port. 
- * It first sets the pan and tilt angles using the provided values (x and y), 
- * clamps them within the valid range (0 to 180 degrees),
+ * It first updates the pan and tilt angles using the provided offsets (x and y),
  * then constructs an HTTP request URI (uniform resource ID) with the adjusted angles. 
  *
  * @param host The hostname or IP address of the target HTTP server.
  * @param port The port number to use for the HTTP connection.
- * @param x The desired pan angle to set.
- * @param y The desired tilt angle to set.
+ * @param x The horizontal offset of the face from the image center.
+ * @param y The vertical offset of the face from the image center.
+ * @param captureUs When the frame the face was found in was captured. Sent along as capture_us, which ServoServer.py
+ *                  ignores and servo_standin records.
  */
-void do_http_get(std::string host, int port, int x, int y) {
-    SetAngleRotation(x, ServoAngle::PAN);
-    SetAngleRotation(y, ServoAngle::TILT);
-
-    // Ensure pan/tilt are within valid range.
-    std::clamp(current_pan, 0, 180);
-    std::clamp(current_tilt, 0, 180);
+void do_http_get(std::string host, int port, int x, int y, uint64_t captureUs) {
+    int pan, tilt;
+    UpdateAimAngles(x, y, pan, tilt);
 
-    int pan = current_pan;
-    int tilt = current_tilt;
-
-    std::cout << "PAN: " << pan << " TILT: " << tilt << std::endl;
+    LOG_INFO("PAN: %d TILT: %d", pan, tilt);
 
     // Create an HTTP client and construct the URI for the camera adjustment.
     httplib::Client cli(host, port);
     std::stringstream uri;
-    uri << "/aim_camera?pan=" << pan << "&tilt=" << tilt;
+    uri << "/aim_camera?pan=" << pan << "&tilt=" << tilt << "&capture_us=" << captureUs;
 
+    uint64_t sentUs = monotonicMicros();
     if (auto res = cli.Get(uri.str())) { // Send HTTP GET request.
         if (res->status == 200)  {
-            std::cout << res->body << std::endl; // Display HTTP request body.
+            servoSendToAck.record(sentUs, monotonicMicros());
+            LOG_INFO("%s", res->body); // Display HTTP request body.
         }
 
     } else { // Display HTTP errors if any.
         auto err = res.error();
-        std::cout << "HTTP error: " << httplib::to_string(err) << std::endl;
+        LOG_WARN("HTTP error: %s", httplib::to_string(err));
+    }
+}
+
+/**
+ * OpenServoBus - Opens the I2C device the in-process servo backend talks to.
+ *
+ * @param backend "i2c:/dev/i2c-N" for the real PCA9685, or "emulated" for an in-memory stand-in.
+ * @return The device; throws if the backend is not recognised or the bus cannot be opened.
+ */
+I2cDevice *OpenServoBus(const std::string &backend) {
+    if (backend == "emulated") {
+        return new EmulatedI2cDevice();
+    }
+    if (backend.compare(0, 4, "i2c:") == 0) {
+        return new LinuxI2cDevice(backend.substr(4), PCA9685_ADDRESS);
+    }
+    throw std::runtime_error("Unknown servo backend " + backend);
+}
+
+/**
+ * SendAim - Sends a new camera aim for a face at the given offset from the image center.
+ *
+ * Called on the servo sink's thread. With the in-process servo backend the new goals are handed to its thread.
+ * With a datagram endpoint configured this is a single non-blocking send.
+ * Otherwise the HTTP request to ServoServer.py is made here and waited for.
+ *
+ * @param servos The in-process servo backend, or nullptr.
+ * @param aimSocket The datagram aim transport, or nullptr to use HTTP.
+ * @param aim The BUS_AIM event: the face's offset from the image center, and when it was captured and decided on.
+ */
+void SendAim(ServoController *servos, AimSocket *aimSocket, const BusEvent &aim) {
+    TRACE_SPAN("servo");
+    servoDecisionToSend.record(aim.timestampUs, monotonicMicros());
+    if (servos) {
+        int pan, tilt;
+        UpdateAimAngles(aim.aimX, aim.aimY, pan, tilt);
+        servos->setGoals(pan, tilt);
+
+    } else if (aimSocket) {
+        int pan, tilt;
+        UpdateAimAngles(aim.aimX, aim.aimY, pan, tilt);
+        aimSocket->send(pan, tilt, aim.captureUs);
+
+    } else {
+        do_http_get(SERVO_SERVER_HOST, SERVO_SERVER_PORT, aim.aimX, aim.aimY, aim.captureUs);
+    }
+}
+
+/**
+ * FacePose - Everything worked out for one detected face in one frame.
+ */
+struct FacePose {
+    dlib::full_object_detection shape;
+    std::vector<cv::Point2d> image_points; // The six PnP points, in full-frame pixels.
+    cv::Mat rotation_vector;
+    cv::Mat translation_vector;
+    cv::Point2d nose_end; // The projected end of the 1000 unit "Pinocchio nose".
+    double dist; // Distance between the nose tip and nose_end, which the facing decision is made on.
+    cv::Vec3d euler;
+    bool isFacingCamera;
+    FaceDirection direction;
+};
+
+/**
+ * LandmarkModel - The 68 point landmarker: dlib's float model, or a QuantizedShapePredictor when -landmarks is given.
+ */
+struct LandmarkModel {
+    dlib::shape_predictor floatModel;
+    QuantizedShapePredictor quantized;
+    bool useQuantized = false;
+
+    template <typename image_type>
+    dlib::full_object_detection operator()(const image_type &img, const dlib::rectangle &rect) const {
+        return useQuantized ? quantized(img, rect) : floatModel(img, rect);
+    }
+};
+
+/**
+ * FrameGeometry - What landmarks are found on, relative to the camera frame. Poses, landmarks and aim offsets are always
+ * reported in camera frame pixels, whatever resolution the landmarks were found at.
+ */
+struct FrameGeometry {
+    cv::Size frameSize;     // the camera frame
+    LandmarkView landmarks; // this frame's landmark image: the camera frame, or a smaller copy of it
+    int cropWidth = 0;      // if set, each face is cropped from landmarks and scaled to this width first
+};
+
+/**
+ * EstimateFacePose - Landmarks one face and solves its head pose and facing decision.
+ *
+ * Only reads its inputs, so it can run for several faces of the same frame at once.
+ *
+ * @param pose_model The landmark model.
+ * @param face The detection, in the coordinates of the downsampled detection image.
+ * @param geometry The landmark image of this frame and how it relates to the camera frame.
+ * @param model_points The 3D face model from get_3d_model_points.
+ * @return The landmarks, pose and decision.
+ */
+FacePose EstimateFacePose(const LandmarkModel &pose_model, const dlib::rectangle &face, const FrameGeometry &geometry,
+                          const std::vector<cv::Point3d> &model_points) {
+    FacePose pose;
+
+    // Extract face rectangle.
+    const LandmarkView &frameView = geometry.landmarks;
+    double ratio = FACE_DOWNSAMPLE_RATIO / frameView.scale;
+    dlib::rectangle r(
+        (long)(face.left() * ratio),
+        (long)(face.top() * ratio),
+        (long)(face.right() * ratio),
+        (long)(face.bottom() * ratio));
+
+    // Get facial landmarks.
+    LandmarkView crop;
+    const LandmarkView *view = &frameView;
+    {
+        TRACE_SPAN("landmark");
+        PERF_STAGE(PERF_LANDMARK);
+        if (geometry.cropWidth) {
+            r = CropView(frameView, r, geometry.cropWidth, crop);
+            view = &crop;
+        }
+        pose.shape = pose_model(dlib::cv_image<dlib::bgr_pixel>(view->image), r);
+    }
+
+    // Into camera frame pixels, which FACE_RADIUS and the aim are tuned for. The PnP points keep their fraction.
+    pose.image_points = get_2d_image_points(pose.shape);
+    for (cv::Point2d &point : pose.image_points) {
+        point = view->toFrame(point);
+    }
+    MapShape(*view, pose.shape);
+
+    TRACE_SPAN("solvePnP");
+    PERF_STAGE(PERF_POSE);
+
+    // Calculate camera parameters and angles.
+    double focal_length = geometry.frameSize.width;
+    cv::Mat camera_matrix = get_camera_matrix(focal_length, cv::Point2d(geometry.frameSize.width / 2, geometry.frameSize.height / 2));
+    cv::Mat dist_coeffs = cv::Mat::zeros(4, 1, cv::DataType<double>::type);
+    cv::solvePnP(model_points, pose.image_points, camera_matrix, dist_coeffs, pose.rotation_vector, pose.translation_vector);
+
+    // Project nose endpoint to 2D.
+    std::vector<cv::Point3d> nose_end_point3D;
+    std::vector<cv::Point2d> nose_end_point2D;
+    nose_end_point3D.push_back(cv::Point3d(0, 0, 1000.0));
+    cv::projectPoints(nose_end_point3D, pose.rotation_vector, pose.translation_vector, camera_matrix, dist_coeffs, nose_end_point2D);
+    pose.nose_end = nose_end_point2D[0];
+
+    // Calculate distance from the center.
+    pose.dist = cv::norm(pose.image_points[0] - pose.nose_end);
+    pose.euler = get_euler_angles(pose.rotation_vector);
+
+    // Determine face direction.
+    pose.isFacingCamera = (pose.dist < FACE_RADIUS);
+    if (!pose.isFacingCamera) {
+        pose.direction = (pose.image_points[0].x > pose.nose_end.x) ? LEFT : RIGHT;
+    } else {
+        pose.direction = FORWARD;
+    }
+
+    return pose;
+}
+
+/**
+ * DrawFacePose - Draws the nose line, the facing radius and the direction text for one face.
+ *
+ * @param im The frame to draw on.
+ * @param pose The face to draw.
+ * @param scale Size of im relative to the full-resolution frame the pose was estimated on.
+ */
+void DrawFacePose(cv::Mat &im, const FacePose &pose, double scale = 1.0) {
+    cv::Point2d nose = pose.image_points[0] * scale;
+    cv::line(im, nose, pose.nose_end * scale, cv::Scalar(255, 0, 255), std::max(1, (int)(10 * scale)));
+
+    cv::Scalar radiusColor = (pose.isFacingCamera) ? cv::Scalar(0, 255, 0) : cv::Scalar(0, 0, 250);
+    cv::putText(im, cv::format("Facing %s", GetDirectionString(pose.direction)), cv::Point(50 * scale, im.rows - 50 * scale),
+                cv::FONT_HERSHEY_SIMPLEX, 1.5 * scale, cv::Scalar(0, 0, 255), std::max(1, (int)(5 * scale)));
+    cv::circle(im, nose, FACE_RADIUS * scale, radiusColor, std::max(1, (int)(3 * scale)));
+}
+
+/**
+ * CommanderFaceState - What was last sent to the commander about one face slot.
+ */
+struct CommanderFaceState {
+    int facing = -1; // -1: nothing sent yet
+    uint64_t sentUs = 0;
+};
+
+/**
+ * SendCommanderMessage - Sends one binary commander message and records what it said in state.
+ *
+ * @param socket The commander connection.
+ * @param recorder If set, the session file the sent bytes are written to.
+ * @param state The face's record of what was last sent.
+ * @param msg The message, without its sequence number; the next one is given to it here.
+ * @param event The bus event the decision it carries was made on.
+ * @return true if it was sent.
+ */
+bool SendCommanderMessage(TcpSocket *socket, SessionWriter *recorder, CommanderFaceState &state, CommanderMessage &msg,
+                          const BusEvent &event) {
+    static uint32_t sequence = 0;
+    msg.sequence = ++sequence;
+
+    uint8_t buf[COMMANDER_MESSAGE_SIZE];
+    size_t size = encodeCommanderMessage(msg, buf, sizeof(buf));
+    uint64_t now = monotonicMicros();
+    commanderDecisionToSend.record(event.timestampUs, now);
+    if (socket->send((char*)buf, size) != 0) {
+        return false;
+    }
+    if (recorder) {
+        recorder->write(SESSION_COMMANDER, event.frameNumber, now, std::vector<uint8_t>(buf, buf + size));
+    }
+    state.facing = (msg.flags & COMMANDER_FLAG_FACING) ? 1 : 0;
+    state.sentUs = now;
+    return true;
+}
+
+/**
+ * SendFacingDecision - Reports one face's facing decision to GizmoCommander.
+ *
+ * In ascii mode this sends "1" or "0" every time, as the base station has always expected.
+ * In binary mode a CommanderMessage is sent only when the decision differs from the last one sent for this face,
+ * or as a heartbeat once commanderHeartbeatMs has passed, so the link carries changes rather than a constant stream.
+ * A BUS_FRAME with fewer faces than before sends a COMMANDER_FLAG_LOST message for each face slot that emptied, so a
+ * face that leaves while facing does not stay "facing" at the base station.
+ *
+ * @param socket The commander connection.
+ * @param recorder If set, the session file everything that was sent is written to, heartbeats included.
+ * @param state Per-face record of what was last sent; grown and shrunk with the number of faces.
+ * @param event A BUS_FACE event with the face's pose and facing decision, or the BUS_FRAME before them.
+ */
+void SendFacingDecision(TcpSocket *socket, SessionWriter *recorder, std::vector<CommanderFaceState> &state,
+                        const BusEvent &event) {
+    TRACE_SPAN("commander");
+
+    if (event.type == BUS_FRAME) {
+        if (!binaryCommander) {
+            return;
+        }
+        for (size_t face = event.faces; face < state.size(); face++) {
+            if (state[face].facing < 0) {
+                continue; // nothing was ever sent for it, so there is nothing to take back
+            }
+            CommanderMessage msg = {};
+            msg.face = (uint8_t)face;
+            msg.flags = COMMANDER_FLAG_LOST;
+            msg.timestampUs = event.captureUs;
+            msg.confidence = 1;
+            SendCommanderMessage(socket, recorder, state[face], msg, event);
+        }
+        if (state.size() > event.faces) {
+            state.resize(event.faces);
+        }
+        return;
+    }
+
+    bool isFacingCamera = event.facing;
+    unsigned long face = event.face;
+
+    if (!binaryCommander) {
+        uint64_t now = monotonicMicros();
+        commanderDecisionToSend.record(event.timestampUs, now);
+        if (socket->send((char*)(isFacingCamera ? "1" : "0"), 1) == 0 && recorder) {
+            recorder->write(SESSION_COMMANDER, event.frameNumber, now, {(uint8_t)(isFacingCamera ? '1' : '0')});
+        }
+        return;
+    }
+
+    if (state.size() <= face) {
+        state.resize(face + 1);
+    }
+
+    uint64_t now = monotonicMicros();
+    bool changed = state[face].facing != (isFacingCamera ? 1 : 0);
+    bool heartbeat = now - state[face].sentUs >= (uint64_t)commanderHeartbeatMs * 1000;
+    if (!changed && !heartbeat) {
+        return;
+    }
+
+    CommanderMessage msg;
+    msg.face = (uint8_t)face;
+    msg.direction = event.direction;
+    msg.flags = (isFacingCamera ? COMMANDER_FLAG_FACING : 0) | (changed ? 0 : COMMANDER_FLAG_HEARTBEAT);
+    msg.timestampUs = event.captureUs;
+    msg.pitch = event.euler[0];
+    msg.yaw = event.euler[1];
+    msg.roll = event.euler[2];
+    for (int i = 0; i < 3; i++) {
+        msg.translation[i] = event.translation[i];
+    }
+    // How far the measurement is from the threshold it was compared against, relative to that threshold.
+    msg.confidence = std::min(1.0, std::abs(event.dist - FACE_RADIUS) / FACE_RADIUS);
+
+    SendCommanderMessage(socket, recorder, state[face], msg, event);
+}
+
+/**
+ * ToFaceEvent - The bus event announcing one face's pose and facing decision.
+ *
+ * @param index The face's position in detection order.
+ * @param frameNumber The frame it was found in.
+ * @param captureUs When that frame was captured.
+ * @param pose What EstimateFacePose made of it.
+ */
+BusEvent ToFaceEvent(unsigned long index, unsigned long frameNumber, uint64_t captureUs, const FacePose &pose) {
+    BusEvent event = {};
+    event.type = BUS_FACE;
+    event.face = (uint32_t)index;
+    event.frameNumber = frameNumber;
+    event.timestampUs = monotonicMicros();
+    event.captureUs = captureUs;
+    for (int i = 0; i < 3; i++) {
+        event.euler[i] = pose.euler[i];
+        event.translation[i] = pose.translation_vector.at<double>(i);
+    }
+    event.dist = pose.dist;
+    event.facing = pose.isFacingCamera ? 1 : 0;
+    event.direction = (uint8_t)pose.direction;
+    return event;
+}
+
+/**
+ * ToSessionFace - The session file record of one face.
+ *
+ * @param index The face's position in detection order.
+ * @param face The detection, in detection image coordinates.
+ * @param pose What EstimateFacePose made of it.
+ */
+SessionFace ToSessionFace(unsigned long index, const dlib::rectangle &face, const FacePose &pose) {
+    SessionFace record = {};
+    record.face = (uint8_t)index;
+    record.rect[0] = face.left();
+    record.rect[1] = face.top();
+    record.rect[2] = face.right();
+    record.rect[3] = face.bottom();
+    for (unsigned long i = 0; i < pose.shape.num_parts() && i < SESSION_LANDMARKS; ++i) {
+        record.landmarks[2 * i] = (int16_t)pose.shape.part(i).x();
+        record.landmarks[2 * i + 1] = (int16_t)pose.shape.part(i).y();
+    }
+    for (int i = 0; i < 3; i++) {
+        record.euler[i] = pose.euler[i];
+        record.translation[i] = pose.translation_vector.at<double>(i);
+    }
+    record.dist = pose.dist;
+    record.facing = pose.isFacingCamera ? 1 : 0;
+    record.direction = (uint8_t)pose.direction;
+    return record;
+}
+
+/**
+ * CompareReplayedFrame - Checks what a replayed frame produced against what was recorded for it.
+ *
+ * Detections, landmarks and decisions must match exactly. Poses get a little slack, since solvePnP may round
+ * differently when the recording was made by another build.
+ *
+ * @param frameNumber The frame, for the report.
+ * @param expected The records that followed the frame in the session file.
+ * @param actual The records the replay produced.
+ * @return true if they match. Differences are logged.
+ */
+bool CompareReplayedFrame(unsigned long frameNumber, const std::vector<SessionRecord> &expected, const std::vector<SessionRecord> &actual) {
+    // What was sent to the commander depends on timing and the link, and the detection schedule is an input to the
+    // frame rather than a result of it, so neither is compared.
+    std::vector<const SessionRecord*> results;
+    for (const SessionRecord &record : expected) {
+        if (record.type != SESSION_COMMANDER && record.type != SESSION_DETECT) {
+            results.push_back(&record);
+        }
+    }
+
+    if (results.size() != actual.size()) {
+        LOG_ERROR("Frame %lu: recorded %zu results, replay produced %zu", frameNumber, results.size(), actual.size());
+        return false;
+    }
+
+    for (size_t i = 0; i < results.size(); ++i) {
+        const SessionRecord &want = *results[i];
+        const SessionRecord &got = actual[i];
+        if (want.type != got.type) {
+            LOG_ERROR("Frame %lu: result %zu has a different type", frameNumber, i);
+            return false;
+        }
+
+        if (want.type != SESSION_FACE) {
+            if (want.payload != got.payload) {
+                LOG_ERROR("Frame %lu: result %zu (type %d) differs", frameNumber, i, (int)want.type);
+                return false;
+            }
+            continue;
+        }
+
+        SessionFace a, b;
+        if (!decodeSessionFace(want.payload, a) || !decodeSessionFace(got.payload, b)) {
+            LOG_ERROR("Frame %lu: unreadable face record", frameNumber);
+            return false;
+        }
+        if (memcmp(a.rect, b.rect, sizeof(a.rect)) != 0) {
+            LOG_ERROR("Frame %lu face %d: detection differs", frameNumber, (int)a.face);
+            return false;
+        }
+        if (memcmp(a.landmarks, b.landmarks, sizeof(a.landmarks)) != 0) {
+            LOG_ERROR("Frame %lu face %d: landmarks differ", frameNumber, (int)a.face);
+            return false;
+        }
+        if (a.facing != b.facing || a.direction != b.direction) {
+            LOG_ERROR("Frame %lu face %d: decision differs (%s recorded, %s replayed)", frameNumber, (int)a.face,
+                      GetDirectionString(a.direction), GetDirectionString(b.direction));
+            return false;
+        }
+        for (int k = 0; k < 3; k++) {
+            if (std::abs(a.euler[k] - b.euler[k]) > 0.01 || std::abs(a.translation[k] - b.translation[k]) > 0.1) {
+                LOG_ERROR("Frame %lu face %d: pose differs", frameNumber, (int)a.face);
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+/**
+ * PrintFrameStats - Frame rate, processing time percentiles and capture period jitter since the last call.
+ *
+ * @param label Printed first, to tell cameras apart.
+ * @param fps Frame rate over the same frames.
+ * @param frameMs Time from having a frame to being done with it, per frame.
+ * @param periodMs Time between consecutive captures; its spread is the jitter the servos and commander see.
+ */
+void PrintFrameStats(const char *label, double fps, std::vector<double> &frameMs, std::vector<double> &periodMs) {
+    double p50 = Percentile(frameMs, 0.5);
+    double p99 = Percentile(frameMs, 0.99);
+    double max = Percentile(frameMs, 1.0);
+
+    double period = Percentile(periodMs, 0.5);
+    std::vector<double> jitter;
+    for (double ms : periodMs) {
+        jitter.push_back(std::abs(ms - period));
+    }
+
+    printf("%s%.1f fps | frame ms p50 %.2f p99 %.2f max %.2f | period %.2f ms, jitter p99 %.2f max %.2f\n",
+           label, fps, p50, p99, max, period, Percentile(jitter, 0.99), Percentile(jitter, 1.0));
+}
+
+/**
+ * DetectFaces - Runs the HOG detector on a 1/4 scale image, shrunk further by detectScale when running hot.
+ *
+ * @param detector The calling thread's detector.
+ * @param small The 1/4 scale image, CV_8UC1 gray or CV_8UC3 BGR.
+ * @param detectScale Further scale, 1 for none.
+ * @param scratch Reused for the shrunk image.
+ * @return The faces in 1/4 scale image coordinates, which EstimateFacePose expects.
+ */
+std::vector<dlib::rectangle> DetectFaces(dlib::frontal_face_detector &detector, const cv::Mat &small, double detectScale, cv::Mat &scratch) {
+    const cv::Mat *detectImage = &small;
+    if (detectScale < 1.0) {
+        cv::resize(small, scratch, cv::Size(), detectScale, detectScale, cv::INTER_AREA);
+        detectImage = &scratch;
+    }
+
+    std::vector<dlib::rectangle> faces;
+    if (detectImage->channels() == 1) {
+        faces = detector(dlib::cv_image<unsigned char>(*detectImage));
+    } else {
+        faces = detector(dlib::cv_image<dlib::bgr_pixel>(*detectImage));
+    }
+
+    if (detectScale < 1.0) {
+        for (dlib::rectangle &face : faces) {
+            face = dlib::rectangle((long)(face.left() / detectScale), (long)(face.top() / detectScale),
+                                   (long)(face.right() / detectScale), (long)(face.bottom() / detectScale));
+        }
+    }
+    return faces;
+}
+
+/**
+ * AddReportingSinks - The sinks every camera's bus gets: pose subscribers (-publish) and the decision log (-log).
+ *
+ * @param bus The camera's bus.
+ * @param poseServer The camera's pose subscribers, or nullptr.
+ */
+void AddReportingSinks(EventBus &bus, TcpSocket *poseServer) {
+    if (poseServer) {
+        std::string message; // Reused every frame so publishing does not allocate.
+        uint64_t messageFrame = 0;
+        uint32_t messageFaces = 0;
+        bus.addSink("poses", "sinks", [poseServer, message, messageFrame, messageFaces](const BusEvent &event, bool) mutable {
+            // One "F <frame> <faces>" line per frame, then one "P ..." line per face.
+            char line[160];
+            if (event.type == BUS_FRAME) {
+                snprintf(line, sizeof(line), "F %llu %u\n", (unsigned long long)event.frameNumber, event.faces);
+                message = line;
+                messageFrame = event.frameNumber;
+                messageFaces = event.faces;
+                if (messageFaces > 0) {
+                    return;
+                }
+            } else if (event.type == BUS_FACE && event.frameNumber == messageFrame) {
+                snprintf(line, sizeof(line), "P %u %.2f %.2f %.2f %.1f %.1f %.1f %d %s\n", event.face,
+                         event.euler[1], event.euler[0], event.euler[2],
+                         event.translation[0], event.translation[1], event.translation[2],
+                         event.facing, GetDirectionString(event.direction));
+                message += line;
+                if (event.face + 1 < messageFaces) {
+                    return;
+                }
+            } else {
+                return;
+            }
+            poseServer->broadcast(message.data(), message.size());
+        });
+    }
+    if (logDecisions) {
+        std::vector<int> logged; // per face: facing * 8 + direction last printed, -1 for none
+        bus.addSink("log", "sinks", [logged](const BusEvent &event, bool) mutable {
+            if (event.type != BUS_FACE) {
+                return;
+            }
+            if (logged.size() <= event.face) {
+                logged.resize(event.face + 1, -1);
+            }
+            int decision = event.facing * 8 + event.direction;
+            if (logged[event.face] == decision) {
+                return;
+            }
+            logged[event.face] = decision;
+            LOG_INFO("camera %u frame %llu face %u: %s, %s (yaw %.1f pitch %.1f roll %.1f)", event.camera,
+                     (unsigned long long)event.frameNumber, event.face, event.facing ? "facing" : "not facing",
+                     GetDirectionString(event.direction), event.euler[1], event.euler[0], event.euler[2]);
+        });
+    }
+}
+
+/**
+ * ExtraCamera - A further frame source given with -camera.
+ *
+ * It runs on a thread of its own but shares the main camera's landmark model, worker pool and thermal policy. Its poses
+ * go to its own bus, with pose subscribers on the -publish port plus its index, and to the log. The servos and the
+ * commander follow the main camera only.
+ */
+struct ExtraCamera {
+    int index = 0; // 1, 2, ...; the main camera is 0
+    std::string source;
+    std::string publishPort;
+    dlib::frontal_face_detector detector; // its own copy: running a detector changes its scratch buffers
+    TcpSocket *poseServer = nullptr;
+    EventBus bus;
+    std::thread thread;
+    std::atomic<bool> stopping{false};
+
+    ~ExtraCamera() {
+        stopping = true;
+        if (thread.joinable()) {
+            thread.join();
+        }
+        bus.stop(); // before the pose server its sink writes to goes
+        delete poseServer;
+    }
+};
+
+/**
+ * RunExtraCamera - Capture, detection, landmarks and pose for one ExtraCamera, until it is stopped or its source ends.
+ *
+ * @param camera The camera, with the detector copy it runs.
+ * @param pose_model Shared with every camera; only read.
+ * @param workerPool Shared with every camera; its batches take turns.
+ * @param thermal The thermal policy to follow, or nullptr.
+ * @param model_points The 3D model solvePnP fits to.
+ */
+void RunExtraCamera(ExtraCamera &camera, const LandmarkModel &pose_model, WorkerPool &workerPool, ThermalMonitor *thermal,
+                    const std::vector<cv::Point3d> &model_points) {
+    std::string name = "camera " + std::to_string(camera.index);
+    traceSetThreadName(name.c_str());
+    applyThreadPolicy("cameras");
+
+    try {
+        cv::VideoCapture cap;
+        bool isIndex = !camera.source.empty() && camera.source.find_first_not_of("0123456789") == std::string::npos;
+        if (isIndex) {
+            cap.open(atoi(camera.source.c_str()));
+        } else {
+            cap.open(camera.source);
+        }
+        if (!cap.isOpened()) {
+            LOG_ERROR("Camera %d: unable to open %s", camera.index, camera.source);
+            return;
+        }
+
+        cv::Mat im, im_small, im_detect;
+        FrameGeometry geometry;
+        geometry.cropWidth = landmarkCropWidth;
+        std::vector<dlib::rectangle> faces;
+        std::vector<FacePose> poses;
+        std::vector<double> frameMs, periodMs;
+        uint64_t previousCaptureUs = 0;
+        uint64_t statsStartUs = monotonicMicros();
+        std::string label = name + ": ";
+
+        for (unsigned long frameNumber = 0; !stopRequested && !camera.stopping; frameNumber++) {
+            TRACE_SPAN_ARG("frame", frameNumber);
+            {
+                TRACE_SPAN("capture");
+                cap >> im;
+            }
+            if (im.empty()) {
+                LOG_WARN("Camera %d: %s has no more frames", camera.index, camera.source);
+                break;
+            }
+            uint64_t captureUs = monotonicMicros();
+            geometry.frameSize = im.size();
+
+            int detectInterval = SKIP_FRAMES;
+            double detectScale = 1.0;
+            if (thermal) {
+                ThermalPolicy policy = thermal->policy();
+                detectInterval = policy.detectInterval;
+                detectScale = policy.detectScale;
+            }
+
+            if (frameNumber % detectInterval == 0) {
+                TRACE_SPAN("detect");
+                if (fastDownsample) {
+                    FastDownsample(im, im_small);
+                } else {
+                    cv::resize(im, im_small, cv::Size(), 1.0 / FACE_DOWNSAMPLE_RATIO, 1.0 / FACE_DOWNSAMPLE_RATIO);
+                }
+                faces = DetectFaces(camera.detector, im_small, detectScale, im_detect);
+            }
+
+            if (!faces.empty()) {
+                TRACE_SPAN("landmark view");
+                ScaledView(im, 1.0, landmarkScale, geometry.landmarks);
+            }
+            poses.resize(faces.size());
+            workerPool.parallelFor(faces.size(), [&](size_t i) {
+                poses[i] = EstimateFacePose(pose_model, faces[i], geometry, model_points);
+            });
+
+            BusEvent frameEvent = {};
+            frameEvent.type = BUS_FRAME;
+            frameEvent.camera = (uint8_t)camera.index;
+            frameEvent.frameNumber = frameNumber;
+            frameEvent.timestampUs = monotonicMicros();
+            frameEvent.captureUs = captureUs;
+            frameEvent.faces = (uint32_t)poses.size();
+            camera.bus.publish(frameEvent);
+            for (unsigned long i = 0; i < poses.size(); ++i) {
+                BusEvent faceEvent = ToFaceEvent(i, frameNumber, captureUs, poses[i]);
+                faceEvent.camera = (uint8_t)camera.index;
+                camera.bus.publish(faceEvent);
+            }
+
+            if (statsEnabled) {
+                frameMs.push_back((monotonicMicros() - captureUs) / 1000.0);
+                if (previousCaptureUs) {
+                    periodMs.push_back((captureUs - previousCaptureUs) / 1000.0);
+                }
+                previousCaptureUs = captureUs;
+
+                if (frameMs.size() == 100) {
+                    uint64_t now = monotonicMicros();
+                    PrintFrameStats(label.c_str(), 100 / ((now - statsStartUs) / 1e6), frameMs, periodMs);
+                    std::cout << label << camera.bus.describe() << std::endl;
+                    statsStartUs = now;
+                    frameMs.clear();
+                    periodMs.clear();
+                }
+            }
+        }
+
+    } catch (std::exception &e) {
+        LOG_ERROR("Camera %d stopped: %s", camera.index, e.what());
     }
 }
 
+/**
+ * RequestStop - SIGINT/SIGTERM handler. The main loop finishes its frame and shuts down cleanly.
+ */
+void RequestStop(int) { stopRequested = 1; }
+
 /**
  * openCam - Tries 
 */
@@ -279,154 +1207,527 @@ void do_http_get(std::string host, int port, int x, int y) {
 int main(int argc, char **argv) {
     DisplayVersion(); // Display OpenCV library version.
 
-    TcpSocket* gizmoCommandSocket = nullptr; // Initialize a pointer to a TCP socket for commander communication.
+    std::string source = ParseCLI(argc, argv); // Parse first, the flags decide what gets connected below.
+
+    logStart(logPath); // before any thread that logs
+
+    if (tracePath) {
+        traceEnabled = true;
+        traceSetThreadName("vision");
+        traceDumpOnSignal(SIGUSR1, tracePath);
+    }
+
+    if (perfReportEnabled) {
+        perfStart(); // on the main thread; worker threads open their own counters on first use
+    }
+
+    if (lockMemory) {
+        lockAllMemory();
+    }
+
+    // Owned by main's scope so that every way out, exceptions included, stops their threads before Log's and Trace's
+    // state goes at exit. The bus, whose sinks use them, lives inside the try and so is gone first; the servos go
+    // before the device they drive.
+    std::unique_ptr<TcpSocket> gizmoCommandSocket; // Commander communication, if enabled.
+    std::unique_ptr<AimSocket> aimSocket; // Datagram aim transport, if one was requested.
+    std::unique_ptr<I2cDevice> servoBus; // I2C device of the in-process servo backend, if one was requested.
+    std::unique_ptr<ServoController> servos;
+    std::unique_ptr<TcpSocket> poseServer; // Fan-out of per-frame poses to subscribers, if requested.
+    std::unique_ptr<MjpegStreamer> debugStream; // Annotated frames over HTTP, if requested.
 
     try {
         if (connectToCommander) { // If enabled, create a TCP socket for commander communication.
-            gizmoCommandSocket = new TcpSocket(GIZMO_COMMANDER_PORT, BASE_STATION_AGX_IP);
+            gizmoCommandSocket.reset(new TcpSocket(commanderPort.c_str(), commanderHost.c_str()));
+            gizmoCommandSocket->setReconnect(true); // a restarted base station gets its decisions again
+        }
+
+        if (!aimEndpoint.empty()) {
+            aimSocket.reset(new AimSocket(aimEndpoint));
+        }
+
+        if (!servoBackend.empty()) {
+            servoBus.reset(OpenServoBus(servoBackend));
+            servos.reset(new ServoController(*servoBus, START_PAN, START_TILT));
+        }
+
+        if (publishPort) {
+            poseServer.reset(new TcpSocket(publishPort));
+            poseServer->startServer();
+        }
+
+        if (streamPort) {
+            debugStream.reset(new MjpegStreamer(streamPort, streamFps, streamWidth));
         }
 
         cv::VideoCapture cap; // Open and configure the camera.
-        cap.open(ParseCLI(argc, argv));
+        std::unique_ptr<DualCapture> dual; // Or take detection and landmark frames from the hardware scaler.
+        std::unique_ptr<SessionReader> replay; // Or read the frames of a recorded session.
+        SessionRecord replayFrame;
+        std::vector<SessionRecord> expected, actual; // Results recorded for / produced from the current frame.
+        cv::Mat im;
+        cv::Mat im_small, im_small_gray, im_display;
+
+        if (replayPath) {
+            replay.reset(new SessionReader(replayPath));
+            if (!replay->nextFrame(replayFrame, expected) || !SessionReader::decodeFrame(replayFrame, im)) {
+                cerr << replayPath << " holds no frames" << (replay->error().empty() ? "" : ": ") << replay->error() << endl;
+                return 1;
+            }
+            replay->rewind(); // the first frame is processed like every other one
+
+            // Results are only comparable when computed the same way, whatever this run was started with.
+            if (replay->hasSettings()) {
+                const SessionSettings &recorded = replay->settings();
+                if (recorded.landmarkScale != (float)landmarkScale || recorded.landmarkCropWidth != landmarkCropWidth ||
+                    (recorded.fastDownsample != 0) != fastDownsample) {
+                    std::cout << "Replaying with the recorded settings: landmark scale " << recorded.landmarkScale
+                              << ", landmark crop " << recorded.landmarkCropWidth
+                              << (recorded.fastDownsample ? "" : ", -cvresize") << std::endl;
+                }
+                landmarkScale = recorded.landmarkScale;
+                landmarkCropWidth = recorded.landmarkCropWidth;
+                fastDownsample = recorded.fastDownsample != 0;
+                if ((recorded.quantizedLandmarks != 0) != (quantizedModelPath != nullptr)) {
+                    std::cout << "Warning: recorded with the " << (recorded.quantizedLandmarks ? "quantized" : "float")
+                              << " landmark model, so landmarks will differ" << std::endl;
+                }
+            } else {
+                std::cout << replayPath << " does not say how it was recorded; replaying with this run's settings" << std::endl;
+            }
+
+        } else if (!dualCaptureSize.empty()) {
+            dual.reset(new DualCapture(cv::Size(CAMERA_WIDTH, CAMERA_HEIGHT), CAMERA_FPS, CAMERA_FLIP_METHOD,
+                                       cv::Size(CAMERA_WIDTH / FACE_DOWNSAMPLE_RATIO, CAMERA_HEIGHT / FACE_DOWNSAMPLE_RATIO),
+                                       dualCaptureSize));
+            std::cout << "Dual capture: " << dual->description() << std::endl;
+
+            if (!dual->read(im_small_gray, im)) {
+                cerr << "Unable to connect to the camera" << endl;
+                return 1;
+            }
+
+        } else {
+            cap.open(source);
 
-        if (!cap.isOpened()) { // Check if the camera is successfully opened.
-            cerr << "Unable to connect to the camera" << endl;
-            return 1;
+            if (!cap.isOpened()) { // Check if the camera is successfully opened.
+                cerr << "Unable to connect to the camera" << endl;
+                return 1;
+            }
+
+            // Get the first frame and allocate memory.
+            cap >> im;
         }
 
         // Initialize variables for frame rate calculation.
         double fps = 30.0; // Placeholder. Actual value calculated after 100 frames.
-        cv::Mat im;
-
-        // Get the first frame and allocate memory.
-        cap >> im;
-        cv::Mat im_small, im_display;
+        FrameGeometry geometry;
+        geometry.frameSize = dual ? cv::Size(CAMERA_WIDTH, CAMERA_HEIGHT) : im.size();
+        geometry.cropWidth = landmarkCropWidth;
+        double imageToFrame = (double)geometry.frameSize.width / im.cols;
+        cv::Size displaySize(geometry.frameSize.width / 2, geometry.frameSize.height / 2);
         cv::resize(im, im_small, cv::Size(), 1.0 / FACE_DOWNSAMPLE_RATIO, 1.0 / FACE_DOWNSAMPLE_RATIO);
-        cv::resize(im, im_display, cv::Size(), 0.5, 0.5);
-        cv::Size size = im.size();
+        cv::resize(im, im_display, displaySize);
+
+        // Every captured frame goes into one of these. A recording holds on to frames until they are compressed.
+        if (framePoolFrames == 0) {
+            framePoolFrames = recordPath ? FRAME_POOL_FRAMES + SESSION_MAX_QUEUED : FRAME_POOL_FRAMES;
+        }
+        std::unique_ptr<FramePool> framePool(new FramePool(framePoolFrames, im.size(), im.type()));
+
+        std::unique_ptr<SessionWriter> recorder; // Declared after the pool, so on the way out it lets go of its frames first.
+        if (recordPath) {
+            SessionSettings settings;
+            settings.landmarkScale = (float)landmarkScale;
+            settings.landmarkCropWidth = landmarkCropWidth;
+            settings.fastDownsample = fastDownsample ? 1 : 0;
+            settings.quantizedLandmarks = quantizedModelPath ? 1 : 0;
+            settings.detectInterval = SKIP_FRAMES;
+            settings.detectScale = 1;
+            recorder.reset(new SessionWriter(recordPath, settings));
+            signal(SIGINT, RequestStop);
+            signal(SIGTERM, RequestStop);
+        }
+
+        // Sized from the first frame; all frames from one camera are alike. Its ring is unlinked from /dev/shm however the
+        // loop ends.
+        std::unique_ptr<FrameBusWriter> frameBus;
+        if (frameBusName) {
+            frameBus.reset(new FrameBusWriter(frameBusName, im.step[0] * im.rows));
+        }
 
         // Load face detection and pose estimation models.
         dlib::frontal_face_detector detector = dlib::get_frontal_face_detector();
-        dlib::shape_predictor pose_model;
-        dlib::deserialize("shape_predictor_68_face_landmarks.dat") >> pose_model; // Try 5 face landmarks as well.
+        LandmarkModel pose_model;
+        if (quantizedModelPath) {
+            pose_model.quantized.load(quantizedModelPath);
+            pose_model.useQuantized = true;
+        } else {
+            dlib::deserialize("shape_predictor_68_face_landmarks.dat") >> pose_model.floatModel; // Try 5 face landmarks as well.
+        }
+
+        // What is decided about each frame is published once; the commander link, the servos, pose subscribers and the
+        // log each take it from the bus on their own thread, so none of them can hold up the next frame. The recorder
+        // and the replay check stay in the loop, because their records have to follow their frame in order.
+        std::unique_ptr<EventBus> bus(new EventBus());
+        if (connectToCommander) {
+            std::vector<CommanderFaceState> commanderState;
+            TcpSocket *commander = gizmoCommandSocket.get();
+            SessionWriter *commanderLog = recorder.get();
+            unsigned long connection = 0;
+            bus->addSink("commander", "sinks", [commander, commanderLog, commanderState, connection](const BusEvent &event, bool) mutable {
+                // A new connection is a commander that knows nothing yet: every face's state is news to it again.
+                if (commander->reconnects != connection) {
+                    connection = commander->reconnects;
+                    commanderState.clear();
+                }
+                if (event.type == BUS_FACE || event.type == BUS_FRAME) {
+                    SendFacingDecision(commander, commanderLog, commanderState, event);
+                }
+            });
+        }
+        if (!replay) {
+            ServoController *servoController = servos.get();
+            AimSocket *aimTransport = aimSocket.get();
+            BusEvent aim = {};
+            bool aimPending = false;
+            // Only the newest aim is sent; those that arrive while a request is in flight are out of date by then.
+            bus->addSink("servo", "http", [servoController, aimTransport, aim, aimPending](const BusEvent &event, bool caughtUp) mutable {
+                if (event.type == BUS_AIM) {
+                    aim = event;
+                    aimPending = true;
+                }
+                if (aimPending && caughtUp) {
+                    SendAim(servoController, aimTransport, aim);
+                    aimPending = false;
+                }
+            });
+        }
+        AddReportingSinks(*bus, poseServer.get());
 
         int count = 0;
+        unsigned long frameNumber = 0;
         std::vector<dlib::rectangle> faces;
+        std::vector<FacePose> poses;
+        const std::vector<cv::Point3d> model_points = get_3d_model_points();
+        WorkerPool workerPool(poseWorkers, "workers");
+        std::unique_ptr<ThermalMonitor> thermal(thermalEnabled ? new ThermalMonitor(sysfsRoot, SKIP_FRAMES, poseWorkers) : nullptr);
+        int detectInterval = SKIP_FRAMES;
+        double detectScale = 1.0; // relative to the 1/4 detection image
+        if (replay && replay->hasSettings()) {
+            detectInterval = std::max(1, (int)replay->settings().detectInterval);
+            detectScale = replay->settings().detectScale;
+        }
+        // The schedule the session file last said was in use; a SESSION_DETECT record follows any frame that changes it.
+        int recordedInterval = detectInterval;
+        double recordedScale = detectScale;
+        cv::Mat im_detect;
+
+        // Frame statistics (-stats).
+        std::vector<double> frameMs, periodMs;
+        uint64_t previousCaptureUs = 0;
+
+        // Replay statistics.
+        unsigned long replayedFrames = 0, mismatchedFrames = 0;
+        uint64_t firstCaptureUs = 0, lastCaptureUs = 0;
+        uint64_t replayStartUs = monotonicMicros();
+
+        // Further cameras share the landmark model, the workers and the thermal policy with this one.
+        std::vector<std::unique_ptr<ExtraCamera>> extraCameras;
+        for (size_t k = 0; k < extraCameraSources.size(); ++k) {
+            std::unique_ptr<ExtraCamera> camera(new ExtraCamera);
+            camera->index = (int)k + 1;
+            camera->source = extraCameraSources[k];
+            // Copied here, before the main loop starts running the original.
+            camera->detector = detector;
+            if (publishPort) {
+                camera->publishPort = std::to_string(atoi(publishPort) + camera->index);
+                camera->poseServer = new TcpSocket(camera->publishPort.c_str());
+                camera->poseServer->startServer();
+            }
+            AddReportingSinks(camera->bus, camera->poseServer);
+            camera->thread = std::thread(RunExtraCamera, std::ref(*camera), std::cref(pose_model),
+                                         std::ref(workerPool), thermal.get(), std::cref(model_points));
+            extraCameras.push_back(std::move(camera));
+        }
+
+        // Only now, so the helper threads started above do not inherit the loop's CPUs and priority.
+        applyThreadPolicy("vision");
 
         // Grab and process frames until the main window is closed by the user.
         double t = (double)cv::getTickCount();
-        while (1) {
+        while (!stopRequested) {
+            TRACE_SPAN_ARG("frame", frameNumber);
+
             // Initialize frame time measurement if count is 0.
             if (count == 0) {
                 t = cv::getTickCount();
             }
 
-            // Capture a frame from the camera.
-            cap >> im;
-
-            // Resize the image for face detection.
-            cv::resize(im, im_small, cv::Size(), 1.0 / FACE_DOWNSAMPLE_RATIO, 1.0 / FACE_DOWNSAMPLE_RATIO);
-
-            // Change to dlib's image format. No memory is copied.
-            dlib::cv_image<dlib::bgr_pixel> cimg_small(im_small);
-            dlib::cv_image<dlib::bgr_pixel> cimg(im);
-
-            // Detect faces periodically.
-            if (count % SKIP_FRAMES == 0) {
-                faces = detector(cimg_small);
-            }
-
-            // Pose estimation and camera control for each detected face.
-            std::vector<cv::Point3d> model_points = get_3d_model_points();
-            std::vector<dlib::full_object_detection> shapes;
-
-            for (unsigned long i = 0; i < faces.size(); ++i) {
-                // Extract face rectangle.
-                dlib::rectangle r(
-                    (long)(faces[i].left() * FACE_DOWNSAMPLE_RATIO),
-                    (long)(faces[i].top() * FACE_DOWNSAMPLE_RATIO),
-                    (long)(faces[i].right() * FACE_DOWNSAMPLE_RATIO),
-                    (long)(faces[i].bottom() * FACE_DOWNSAMPLE_RATIO));
-
-                // Get facial landmarks.
-                dlib::full_object_detection shape = pose_model(cimg, r);
-                shapes.push_back(shape);
-                std::vector<cv::Point2d> image_points = get_2d_image_points(shape);
-
-                // Calculate camera parameters and angles.
-                double focal_length = im.cols;
-                cv::Mat camera_matrix = get_camera_matrix(focal_length, cv::Point2d(im.cols / 2, im.rows / 2));
-                cv::Mat rotation_vector;
-                cv::Mat rotation_matrix;
-                cv::Mat translation_vector;
-                cv::Mat dist_coeffs = cv::Mat::zeros(4, 1, cv::DataType<double>::type);
-                cv::solvePnP(model_points, image_points, camera_matrix, dist_coeffs, rotation_vector, translation_vector);
-
-                // Project nose endpoint to 2D and draw line.
-                std::vector<cv::Point3d> nose_end_point3D;
-                std::vector<cv::Point2d> nose_end_point2D;
-                nose_end_point3D.push_back(cv::Point3d(0, 0, 1000.0));
-                cv::projectPoints(nose_end_point3D, rotation_vector, translation_vector, camera_matrix, dist_coeffs, nose_end_point2D);
-                cv::line(im, image_points[0], nose_end_point2D[0], cv::Scalar(255, 0, 255), 10);
-
-                // Calculate distance from the center.
-                double dist = cv::norm(image_points[0] - nose_end_point2D[0]);
+            // Follow the thermal policy, which changes at most once a second.
+            if (thermal) {
+                ThermalPolicy policy = thermal->policy();
+                detectInterval = policy.detectInterval;
+                detectScale = policy.detectScale;
+                workerPool.setParallelism(policy.workers);
+            }
 
-                // Calculate middle point.
-                CvPoint middle;
-                cv::Size sz = im.size();
-                middle.x = sz.width / 2;
-                middle.y = sz.height / 2;
-                int dist_from_middle = image_points[0].x - middle.x;
+            // Capture a frame from the camera, or take the next recorded one, into a pool buffer.
+            FrameRef frame;
+            {
+                TRACE_SPAN("capture");
+                PERF_STAGE(PERF_CAPTURE);
+                frame = framePool->acquire();
+                im = frame.mat();
+                if (replay) {
+                    if (!replay->nextFrame(replayFrame, expected) || !SessionReader::decodeFrame(replayFrame, im)) {
+                        break;
+                    }
+                    if (replayedFrames == 0) {
+                        firstCaptureUs = replayFrame.timestampUs;
+                    }
+                    lastCaptureUs = replayFrame.timestampUs;
+                    actual.clear();
+                    for (const SessionRecord &record : expected) {
+                        if (record.type == SESSION_DETECT && record.payload.size() >= 6) {
+                            detectInterval = std::max(1, (int)getLe(record.payload.data(), 2));
+                            detectScale = getFloatLe(record.payload.data() + 2);
+                        }
+                    }
+                } else if (dual) {
+                    if (!dual->read(im_small_gray, im)) {
+                        break;
+                    }
+                } else {
+                    cap >> im;
+                }
+            }
+            uint64_t captureUs = monotonicMicros();
+            // When the camera's own timestamp is known, latency is measured from the moment it took the frame rather
+            // than from when read() handed it over, which leaves out the time spent in the capture pipeline.
+            uint64_t exposureUs = dual && dual->lastCaptureUs ? dual->lastCaptureUs : captureUs;
+
+            // Share and record the raw frame before anything draws on it.
+            if (frameBus) {
+                frameBus->publish(im.data, im.rows, im.cols, im.type(), im.step[0], frameNumber, captureUs);
+            }
+            if (recorder) {
+                recorder->writeFrame(frame, frameNumber, captureUs);
+                if (detectInterval != recordedInterval || detectScale != recordedScale) {
+                    std::vector<uint8_t> payload(6);
+                    putLe(payload.data(), (uint16_t)detectInterval, 2);
+                    putFloatLe(payload.data() + 2, (float)detectScale);
+                    recorder->write(SESSION_DETECT, frameNumber, captureUs, std::move(payload));
+                    recordedInterval = detectInterval;
+                    recordedScale = detectScale;
+                }
+            }
 
-                // Send HTTP requests for camera control periodically.
-                if (0 == (count % 4)) {
-                    std::thread http_thread(do_http_get, "localhost", 5000, image_points[0].x - middle.x, image_points[0].y - middle.y);
-                    http_thread.detach();
+            // Downsample for face detection, and for the window if it is open, reading the frame once.
+            // The dual capture has already had its detection frame scaled by the hardware.
+            bool displayFromKernel = fastDownsample && showWindow && !dual;
+            if (!dual) {
+                TRACE_SPAN("downsample");
+                if (fastDownsample) {
+                    FastDownsample(im, im_small_gray, displayFromKernel ? &im_display : nullptr);
+                } else {
+                    cv::resize(im, im_small, cv::Size(), 1.0 / FACE_DOWNSAMPLE_RATIO, 1.0 / FACE_DOWNSAMPLE_RATIO);
                 }
+            }
+
 
-                // Determine face direction.
-                bool isFacingCamera = (dist < FACE_RADIUS);
-                FaceDirection direction = NONE;
+            // Detect faces periodically. HOG works on gray, which the kernel has already produced.
+            if (frameNumber % detectInterval == 0) {
+                TRACE_SPAN("detect");
+                PERF_STAGE(PERF_DETECT);
+                bool detectOnGray = fastDownsample || dual;
+                faces = DetectFaces(detector, detectOnGray ? im_small_gray : im_small, detectScale, im_detect);
+            }
 
-                // Update camera control.
-                if (!isFacingCamera) { 
-                    if (connectToCommander) { gizmoCommandSocket->send((char*)"0", 1); }
+            // Landmarks and pose for every face, spread over the worker pool. Results land in detection order.
+            if (!faces.empty()) {
+                TRACE_SPAN("landmark view");
+                ScaledView(im, imageToFrame, landmarkScale, geometry.landmarks);
+            }
+            poses.resize(faces.size());
+            workerPool.parallelFor(faces.size(), [&](size_t i) {
+                poses[i] = EstimateFacePose(pose_model, faces[i], geometry, model_points);
+            });
+
+            BusEvent frameEvent = {};
+            frameEvent.type = BUS_FRAME;
+            frameEvent.frameNumber = frameNumber;
+            frameEvent.timestampUs = monotonicMicros();
+            frameEvent.captureUs = exposureUs;
+            frameEvent.faces = (uint32_t)poses.size();
+            bus->publish(frameEvent);
+            captureToDecision.record(exposureUs, frameEvent.timestampUs);
+
+            // The recorder may still be holding the raw frame. Draw on a copy then.
+            if (!poses.empty() && !frame.unique()) {
+                FrameRef annotated = framePool->acquire();
+                im.copyTo(annotated.mat());
+                frame = annotated;
+                im = frame.mat();
+            }
 
-                    if (image_points[0].x > nose_end_point2D[0].x) {
-                        direction = LEFT;
-                    } else { direction = RIGHT; }
+            // Decisions, camera control and drawing for each face, in detection order.
+            for (unsigned long i = 0; i < poses.size(); ++i) {
+                const FacePose &pose = poses[i];
 
-                } else {
-                    direction = FORWARD;
-                    if (connectToCommander) { gizmoCommandSocket->send((char*)"1", 1); }
+                // Calculate middle point.
+                cv::Point middle(geometry.frameSize.width / 2, geometry.frameSize.height / 2);
+
+                if (recorder || replay) {
+                    std::vector<uint8_t> payload;
+                    encodeSessionFace(ToSessionFace(i, faces[i], pose), payload);
+                    if (recorder) {
+                        recorder->write(SESSION_FACE, frameNumber, monotonicMicros(), std::move(payload));
+                    } else {
+                        actual.push_back({SESSION_FACE, frameNumber, 0, std::move(payload)});
+                    }
+                }
+
+                bus->publish(ToFaceEvent(i, frameNumber, exposureUs, pose));
+
+                // Send camera control periodically.
+                if (0 == (count % 4)) {
+                    int aimX = pose.image_points[0].x - middle.x;
+                    int aimY = pose.image_points[0].y - middle.y;
+                    if (recorder || replay) {
+                        std::vector<uint8_t> payload(8);
+                        putLe(payload.data(), (uint32_t)aimX, 4);
+                        putLe(payload.data() + 4, (uint32_t)aimY, 4);
+                        if (recorder) {
+                            recorder->write(SESSION_AIM, frameNumber, monotonicMicros(), std::move(payload));
+                        } else {
+                            actual.push_back({SESSION_AIM, frameNumber, 0, std::move(payload)});
+                        }
+                    }
+                    BusEvent aim = {};
+                    aim.type = BUS_AIM;
+                    aim.face = (uint32_t)i;
+                    aim.frameNumber = frameNumber;
+                    aim.timestampUs = monotonicMicros();
+                    aim.captureUs = exposureUs;
+                    aim.aimX = aimX;
+                    aim.aimY = aimY;
+                    bus->publish(aim);
                 }
 
                 // Draw direction and face radius on the image.
-                cv::Scalar radiusColor = (isFacingCamera) ? cv::Scalar(0, 255, 0) : cv::Scalar(0, 0, 250);
-                cv::putText(im, cv::format("Facing %s", GetDirectionString(direction)), cv::Point(50, size.height - 50), cv::FONT_HERSHEY_SIMPLEX, 1.5, cv::Scalar(0, 0, 255), 5);
-                cv::circle(im, image_points[0], FACE_RADIUS, radiusColor, 3);
+                TRACE_SPAN("draw");
+                DrawFacePose(im, pose, 1.0 / imageToFrame);
+                if (displayFromKernel) {
+                    DrawFacePose(im_display, pose, 0.5);
+                }
+            }
+
+            if (replay) {
+                replayedFrames++;
+                if (!CompareReplayedFrame(frameNumber, expected, actual)) {
+                    mismatchedFrames++;
+                }
+            }
+
+            if (debugStream) {
+                debugStream->offer(im);
             }
 
             // Resize the image for display and show it.
-            im_display = im;
-            cv::resize(im, im_display, cv::Size(), 0.5, 0.5);
-            cv::imshow("Fast Facial Landmark Detector", im_display);
+            if (showWindow) {
+                TRACE_SPAN("display");
+                if (!displayFromKernel) {
+                    cv::resize(im, im_display, displaySize);
+                }
+                cv::imshow("Fast Facial Landmark Detector", im_display);
 
-            // Check for user key press events.
-            if (cv::waitKey(5) >= 0) {
-                break;
+                // Check for user key press events.
+                if (cv::waitKey(5) >= 0) {
+                    break;
+                }
+            }
+
+            if (statsEnabled) {
+                frameMs.push_back((monotonicMicros() - captureUs) / 1000.0);
+                if (previousCaptureUs) {
+                    periodMs.push_back((captureUs - previousCaptureUs) / 1000.0);
+                }
+                previousCaptureUs = captureUs;
             }
 
             // Update frame count and calculate frame rate.
             count++;
+            frameNumber++;
             if (count == 100) {
                 t = ((double)cv::getTickCount() - t) / cv::getTickFrequency();
                 fps = 100.0 / t;
                 count = 0;
+
+                if (statsEnabled) {
+                    PrintFrameStats(extraCameras.empty() ? "" : "camera 0: ", fps, frameMs, periodMs);
+                    if (thermal) {
+                        std::cout << thermal->describe() << std::endl;
+                    }
+                    if (dual) {
+                        printf("dual capture: %lu samples without a partner so far\n", dual->unmatched);
+                    }
+                    std::cout << framePool->describe() << std::endl;
+                    std::cout << bus->describe() << std::endl;
+                    for (LatencyHistogram *latency : {&captureToDecision, &servoDecisionToSend, &servoSendToAck,
+                                                      &commanderDecisionToSend}) {
+                        std::string line = latency->describe();
+                        if (!line.empty()) {
+                            std::cout << line << std::endl;
+                        }
+                    }
+                    frameMs.clear();
+                    periodMs.clear();
+                }
+                if (perfReportEnabled) {
+                    printf("%.1f fps\n%s", fps, perfReport().c_str());
+                }
+            }
+
+            traceDumpIfRequested();
+        }
+
+        for (auto &camera : extraCameras) {
+            camera->stopping = true; // all at once, then wait for each
+        }
+        extraCameras.clear();
+
+        bus.reset(); // after the sinks have handled what was published
+        // Then the outputs the sinks used, so their threads are gone before the trace is dumped.
+        debugStream.reset();
+        poseServer.reset();
+        servos.reset();
+        servoBus.reset();
+        aimSocket.reset();
+        gizmoCommandSocket.reset();
+        thermal.reset();
+        dual.reset();
+        frameBus.reset();
+
+        if (tracePath) {
+            traceDump(tracePath);
+        }
+
+        if (replay) {
+            logStop(); // the differences first, then the summary
+            double seconds = (monotonicMicros() - replayStartUs) / 1e6;
+            double recordedSeconds = (lastCaptureUs - firstCaptureUs) / 1e6;
+            printf("Replayed %lu frames in %.2f s (%.1f fps; %.1f fps when recorded). %lu frames differed.\n",
+                   replayedFrames, seconds, replayedFrames / seconds,
+                   recordedSeconds > 0 ? (replayedFrames - 1) / recordedSeconds : 0.0, mismatchedFrames);
+            if (!replay->error().empty()) {
+                printf("Replay stopped early: %s\n", replay->error().c_str());
+                return 2;
             }
+            return mismatchedFrames == 0 ? 0 : 2;
         }
 
+        recorder.reset(); // writes out what is still queued, and only then does the pool go
+
     } catch (dlib::serialization_error &e) { // Model file serialization exception.
         cout << "You need dlib's default face landmarking model file to run this example." << endl;
         cout << "You can get it from the following URL: " << endl;